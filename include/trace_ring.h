@@ -0,0 +1,111 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TRACE_RING_H_
+#define _TRACE_RING_H_
+
+/*
+ * Binary trace rings.
+ *
+ * Every thread records into its own ring of fixed-size records, so writing
+ * a record takes no locks and no system calls besides reading the clock.
+ * Rings overwrite their oldest records. trace_ring_save() takes a snapshot
+ * of all rings of the process, to be decoded by the tracedump tool.
+ *
+ * Event names are pointers to strings with static storage duration, usually
+ * __func__. They are only resolved to text when a snapshot is saved.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Records per thread, must be a power of two */
+#define TRACE_RING_SIZE		1024
+
+enum trace_event_type {
+	TRACE_ENTER,
+	TRACE_LEAVE,
+	TRACE_EVENT,
+};
+
+struct trace_record {
+	/* CLOCK_MONOTONIC, ns */
+	uint64_t tstamp;
+	/* const char * in memory, offset to the string table in files */
+	uint64_t name;
+	uint32_t type;
+	uint32_t arg0;
+	uint32_t arg1;
+	uint32_t reserved;
+};
+
+/*
+ * File format: trace_file_header, the string table, then for each thread
+ * trace_file_thread followed by its records, oldest first.
+ */
+#define TRACE_FILE_MAGIC	0x52435254	/* "TRCR" */
+#define TRACE_FILE_VERSION	1
+
+struct trace_file_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t thread_count;
+	uint32_t strings_size;
+};
+
+struct trace_file_thread {
+	uint32_t tid;
+	uint32_t count;
+};
+
+/* Recording is off by default, trace_ring_enable() switches it at runtime */
+extern volatile int32_t trace_ring_enabled;
+
+void trace_ring_enable(int enable);
+
+void trace_ring_record(const char *name, uint32_t type,
+					uint32_t arg0, uint32_t arg1);
+
+/* Returns 0 on success, negative errno value on error */
+int trace_ring_save(const char *path);
+
+#ifdef __cplusplus
+}
+
+/* Records enter and leave of a scope */
+class TraceScope {
+	const char *mName;
+public:
+	TraceScope(const char *name) :
+		mName(name)
+	{
+		if (trace_ring_enabled)
+			trace_ring_record(mName, TRACE_ENTER, 0, 0);
+	}
+
+	~TraceScope()
+	{
+		if (trace_ring_enabled)
+			trace_ring_record(mName, TRACE_LEAVE, 0, 0);
+	}
+};
+#endif
+
+#endif /* _TRACE_RING_H_ */
@@ -5,14 +5,24 @@ ifneq ($(filter spica,$(TARGET_DEVICE)),)
 include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= aplay.c alsa_pcm.c alsa_mixer.c
 LOCAL_MODULE:= aplay
-LOCAL_SHARED_LIBRARIES:= libc libcutils
+LOCAL_SHARED_LIBRARIES:= libc libcutils libm
 LOCAL_MODULE_TAGS:= debug
 include $(BUILD_EXECUTABLE)
 
 include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= arec.c alsa_pcm.c
 LOCAL_MODULE:= arec
-LOCAL_SHARED_LIBRARIES:= libc libcutils
+LOCAL_SHARED_LIBRARIES:= libc libcutils libm
+LOCAL_MODULE_TAGS:= debug
+include $(BUILD_EXECUTABLE)
+
+# The simulated card is built into alsabench and the host library only,
+# pcm_open() in libaudio and the other tools always uses the kernel driver
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= alsabench.c alsa_pcm.c alsa_pcm_sim.c
+LOCAL_CFLAGS += -DWITH_PCM_SIM
+LOCAL_MODULE:= alsabench
+LOCAL_SHARED_LIBRARIES:= libc libcutils libm
 LOCAL_MODULE_TAGS:= debug
 include $(BUILD_EXECUTABLE)
 
@@ -23,6 +33,37 @@ LOCAL_SHARED_LIBRARIES := libc libcutils
 LOCAL_MODULE_TAGS:= debug
 include $(BUILD_EXECUTABLE)
 
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= resample_bench.cpp Resampler.cpp
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+LOCAL_MODULE:= resample_bench
+LOCAL_STATIC_LIBRARIES:= libtracering liblog
+LOCAL_LDLIBS:= -lm -lrt -lpthread
+ifeq ($(HOST_ARCH),x86)
+  LOCAL_CFLAGS += -O2 -msse2
+endif
+LOCAL_MODULE_TAGS:= optional
+include $(BUILD_HOST_EXECUTABLE)
+
+# pcm layer on the simulated card, for running libaudio code on the host
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= alsa_pcm.c alsa_pcm_sim.c
+LOCAL_CFLAGS += -DWITH_PCM_SIM
+LOCAL_MODULE:= libalsa_pcm_host
+LOCAL_MODULE_TAGS:= optional
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+# alsabench on the simulated card, run with ALSA_PCM_SIM_LOOPBACK set.
+# Adding ALSA_PCM_SIM_XRUN=8 and -m runs the xrun recovery of the mmap
+# transport, which has to go on with xruns counted instead of hanging.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= alsabench.c
+LOCAL_MODULE:= alsabench
+LOCAL_STATIC_LIBRARIES:= libalsa_pcm_host liblog
+LOCAL_LDLIBS:= -lm -lrt -lpthread
+LOCAL_MODULE_TAGS:= optional
+include $(BUILD_HOST_EXECUTABLE)
+
 include $(CLEAR_VARS)
 LOCAL_ARM_MODE:= arm
 LOCAL_SRC_FILES:= \
@@ -31,12 +72,21 @@ LOCAL_SRC_FILES:= \
 	alsa_pcm.c \
 	AudioRouter.cpp \
 	AudioStreamOutALSA.cpp \
+	AudioStreamOutClient.cpp \
 	AudioStreamInALSA.cpp \
+	BluetoothBridge.cpp \
 	ChannelMixer.cpp \
-	DownSampler.cpp
+	OutputMixer.cpp \
+	Resampler.cpp \
+	RingBuffer.cpp \
+	StandbyTimer.cpp \
+	StreamLock.cpp \
+	StreamStats.cpp \
+	VolumeRamp.cpp
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
 LOCAL_MODULE:= libaudio
-LOCAL_STATIC_LIBRARIES:= libaudiointerface
-LOCAL_SHARED_LIBRARIES:= libc libcutils libutils libmedia libhardware_legacy
+LOCAL_STATIC_LIBRARIES:= libaudiointerface libtracering
+LOCAL_SHARED_LIBRARIES:= libc libm libcutils libutils libmedia libhardware_legacy
 ifeq ($(BOARD_HAVE_BLUETOOTH),true)
   LOCAL_SHARED_LIBRARIES += liba2dp
 endif
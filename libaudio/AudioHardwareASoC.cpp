@@ -37,13 +37,19 @@
 
 #include "AudioHardwareASoC.h"
 #include "AudioStreamOutALSA.h"
+#include "AudioStreamOutClient.h"
 #include "AudioStreamInALSA.h"
+#include "OutputMixer.h"
 #include "AudioRouter.h"
+#include "BluetoothBridge.h"
+#include "StandbyTimer.h"
 #include "utils.h"
 
-namespace android {
+extern "C" {
+#include "alsa_audio.h"
+};
 
-int Tracer::level;
+namespace android {
 
 /*
  * AudioHardware
@@ -53,6 +59,14 @@ AudioHardware::AudioHardware() :
 	mMicMute(false),
 	mInCallAudioMode(false),
 	mVoiceVolume(0.0f),
+	mStandbyDelay(AUDIO_HW_STANDBY_DELAY_MS),
+	mVolumeDeadline(0),
+	mVolumeWritten(0),
+	mWakeLockRefs(0),
+	mWakeLockHeld(false),
+	mReleasedRoutes(0),
+	mPowerDeadline(0),
+	mInputRateCount(0),
 	mDriverOp(DRV_NONE),
 	mStatus(NO_INIT)
 {
@@ -66,6 +80,22 @@ AudioHardware::AudioHardware() :
 		return;
 	}
 
+	TRACE_DRIVER_IN(DRV_PCM_OPEN)
+	mInputRateCount = pcm_get_rates(PCM_IN, mInputRates,
+							NELEM(mInputRates));
+	TRACE_DRIVER_OUT
+
+	for (unsigned i = 0; i < mInputRateCount; ++i)
+		LOGD("Codec capture rate %u Hz", mInputRates[i]);
+
+	mStandbyTimer = new StandbyTimer(this);
+
+	if (mStandbyTimer->run("AudioStandbyTimer") != NO_ERROR) {
+		LOGE("Failed to start standby timer thread");
+		mStandbyTimer.clear();
+		return;
+	}
+
 	mStatus = NO_ERROR;
 }
 
@@ -73,71 +103,156 @@ AudioHardware::~AudioHardware()
 {
 	TRACE();
 
+	if (mStandbyTimer != 0)
+		mStandbyTimer->stop();
+
 	for (size_t index = 0; index < mInputs.size(); index++)
 		closeInputStream(mInputs[index].get());
 
 	mInputs.clear();
-	closeOutputStream((AudioStreamOut *)mOutput.get());
+
+	while (!mOutputs.isEmpty())
+		closeOutputStream((AudioStreamOut *)mOutputs[0].get());
+
+	applyPower_l();
 	mRouter.clear();
 
 	mStatus = NO_INIT;
 }
 
+status_t AudioHardware::openHardwareOutput_l(uint32_t devices, int *format,
+				uint32_t *channels, uint32_t *sampleRate)
+{
+	TRACE();
+	sp<AudioStreamOutALSA> output;
+	sp<OutputMixer> mixer;
+	status_t rc;
+
+	output = new AudioStreamOutALSA();
+	rc = output->set(this, devices, format, channels, sampleRate);
+
+	if (rc != NO_ERROR)
+		return rc;
+
+	mixer = new OutputMixer(output, mRouter);
+	rc = mixer->initCheck();
+
+	if (rc != NO_ERROR)
+		return rc;
+
+	rc = mixer->run("OutputMixer", ANDROID_PRIORITY_URGENT_AUDIO);
+
+	if (rc != NO_ERROR) {
+		LOGE("Failed to start output mixer thread");
+		return rc;
+	}
+
+	mOutput = output;
+	mMixer = mixer;
+
+	return NO_ERROR;
+}
+
+/*
+ * Stops the mixer and releases the hardware output, once the last
+ * output stream is closed.
+ */
+void AudioHardware::closeHardwareOutput()
+{
+	TRACE();
+	sp<AudioStreamOutALSA> spOut;
+	sp<OutputMixer> mixer;
+
+	{
+		Mutex::Autolock lock(mLock);
+
+		if (!mOutputs.isEmpty() || mMixer == 0)
+			return;
+
+		mixer = mMixer;
+	}
+
+	// the mixer thread might need mLock to finish its write
+	mixer->stop();
+
+	{
+		Mutex::Autolock lock(mLock);
+
+		if (!mOutputs.isEmpty())
+			return;
+
+		mMixer.clear();
+		spOut = mOutput;
+		mOutput.clear();
+	}
+
+	spOut.clear();
+}
+
 AudioStreamOut *AudioHardware::openOutputStream(
 	uint32_t devices, int *format, uint32_t *channels,
 	uint32_t *sampleRate, status_t *status)
 {
 	TRACE();
-	sp <AudioStreamOutALSA> out;
-	status_t rc;
+	sp <AudioStreamOutClient> out;
+	status_t rc = NO_ERROR;
 
 	{
 		// scope for the lock
 		Mutex::Autolock lock(mLock);
 
-		// only one output stream allowed
-		if (mOutput != 0) {
-			if (status)
-				*status = INVALID_OPERATION;
+		if (mOutput == 0)
+			rc = openHardwareOutput_l(devices, format,
+							channels, sampleRate);
 
-			return 0;
+		if (rc == NO_ERROR) {
+			out = new AudioStreamOutClient();
+			rc = out->set(mMixer, devices, format,
+							channels, sampleRate);
 		}
 
-		out = new AudioStreamOutALSA();
-
-		rc = out->set(this, devices, format, channels, sampleRate);
-
-		if (rc == NO_ERROR)
-			mOutput = out;
+		if (rc == NO_ERROR) {
+			mOutputs.add(out);
+			mMixer->addStream(out.get());
+		}
 	}
 
 	if (rc != NO_ERROR) {
 		if (out != 0)
 			out.clear();
+
+		closeHardwareOutput();
 	}
 
 	if (status)
 		*status = rc;
 
+	LOGV("AudioHardware::openOutputStream()%p", out.get());
 	return out.get();
 }
 
 void AudioHardware::closeOutputStream(AudioStreamOut *out)
 {
 	TRACE();
-	sp <AudioStreamOutALSA> spOut;
+	sp <AudioStreamOutClient> spOut;
 	{
 		Mutex::Autolock lock(mLock);
 
-		if (mOutput == 0 || mOutput.get() != out) {
+		ssize_t index = mOutputs.indexOf((AudioStreamOutClient *)out);
+
+		if (index < 0) {
 			LOGW("Attempt to close invalid output stream");
 			return;
 		}
 
-		spOut = mOutput;
-		mOutput.clear();
+		spOut = mOutputs[index];
+		mOutputs.removeAt(index);
+		mMixer->removeStream(spOut.get());
 	}
+	LOGV("AudioHardware::closeOutputStream()%p", out);
 	spOut.clear();
+
+	closeHardwareOutput();
 }
 
 AudioStreamIn *AudioHardware::openInputStream(
@@ -280,6 +395,8 @@ status_t AudioHardware::setMode(int mode)
 			spIn->doStandby_l();
 		}
 
+		// the call starts from a clean codec, do not wait for the timer
+		applyPower_l();
 		mRouter->setRouteDisable(AudioRouter::ROUTE_INPUT, true);
 		mRouter->setRouteDisable(AudioRouter::ROUTE_OUTPUT, true);
 		mRouter->setVoiceVolume(mVoiceVolume);
@@ -295,6 +412,7 @@ status_t AudioHardware::setMode(int mode)
 		mRouter->setRouteDisable(AudioRouter::ROUTE_OUTPUT, false);
 		mRouter->setRouteDisable(AudioRouter::ROUTE_INPUT, false);
 		mRouter->setVoiceVolume(0.0f);
+		scheduleVolume_l();
 
 		if (spOut != 0) {
 			LOGV("setMode() off call force output standby");
@@ -351,6 +469,15 @@ status_t AudioHardware::getMicMute(bool *state)
 status_t AudioHardware::setParameters(const String8 &keyValuePairs)
 {
 	TRACE();
+	AudioParameter param = AudioParameter(keyValuePairs);
+	String8 key = String8(AUDIO_PARAMETER_STANDBY_DELAY);
+	int delay;
+
+	if (param.getInt(key, delay) == NO_ERROR && delay >= 0) {
+		LOGD("standby delay %d ms", delay);
+		mStandbyDelay = delay;
+	}
+
 	return NO_ERROR;
 }
 
@@ -359,12 +486,54 @@ String8 AudioHardware::getParameters(const String8 &keys)
 	TRACE();
 	AudioParameter request = AudioParameter(keys);
 	AudioParameter reply = AudioParameter();
+	String8 key = String8(AUDIO_PARAMETER_STREAM_STATS);
+	String8 value;
 
 	LOGV("getParameters() %s", keys.string());
 
+	if (request.get(String8(AUDIO_PARAMETER_STANDBY_DELAY), value)
+								== NO_ERROR)
+		reply.addInt(String8(AUDIO_PARAMETER_STANDBY_DELAY),
+							(int)mStandbyDelay);
+
+	if (request.get(key, value) == NO_ERROR) {
+		struct audio_stream_stats stats;
+		AutoMutex lock(mLock);
+
+		value.clear();
+
+		if (mOutput != 0) {
+			mOutput->getStats(&stats);
+			StreamStats::appendHex(value, &stats);
+		}
+
+		for (size_t i = 0; i < mInputs.size(); ++i) {
+			mInputs[i]->getStats(&stats);
+			StreamStats::appendHex(value, &stats);
+		}
+
+		/* The streams AudioFlinger writes to, mixed into mOutput */
+		for (size_t i = 0; i < mOutputs.size(); ++i) {
+			mOutputs[i]->getStats(&stats);
+			StreamStats::appendHex(value, &stats);
+		}
+
+		reply.add(key, value);
+	}
+
 	return reply.toString();
 }
 
+/* Capture at rates the codec runs at natively needs no resampling */
+bool AudioHardware::inputRateSupported(uint32_t rate) const
+{
+	for (unsigned i = 0; i < mInputRateCount; ++i)
+		if (mInputRates[i] == rate)
+			return true;
+
+	return false;
+}
+
 size_t AudioHardware::getInputBufferSize(uint32_t sampleRate,
 		int format, int channelCount)
 {
@@ -383,9 +552,13 @@ size_t AudioHardware::getInputBufferSize(uint32_t sampleRate,
 	switch (sampleRate) {
 	case 8000:
 	case 11025:
+	case 12000:
 	case 16000:
 	case 22050:
+	case 24000:
+	case 32000:
 	case 44100:
+	case 48000:
 		break;
 	default:
 		LOGE("getInputBufferSize bad sample rate: %d", sampleRate);
@@ -402,8 +575,10 @@ status_t AudioHardware::setVoiceVolume(float volume)
 
 	mVoiceVolume = volume;
 
-	if (mInCallAudioMode)
+	if (mInCallAudioMode) {
 		mRouter->setVoiceVolume(volume);
+		scheduleVolume_l();
+	}
 
 	return NO_ERROR;
 }
@@ -414,10 +589,108 @@ status_t AudioHardware::setMasterVolume(float volume)
 	AutoMutex lock(mLock);
 
 	mRouter->setMasterVolume(volume);
+	scheduleVolume_l();
 
 	return NO_ERROR;
 }
 
+/*
+ * Codec volume levels are written by the standby timer, right away if
+ * the last write is older than AUDIO_HW_VOLUME_SETTLE_MS, at the end of
+ * that window otherwise. Changes in the meantime only move the target.
+ */
+void AudioHardware::scheduleVolume_l()
+{
+	TRACE();
+	nsecs_t now = systemTime();
+
+	if (mVolumeDeadline)
+		return;
+
+	mVolumeDeadline = mVolumeWritten
+			+ milliseconds(AUDIO_HW_VOLUME_SETTLE_MS);
+
+	if (mVolumeDeadline < now)
+		mVolumeDeadline = now;
+
+	scheduleStandby(mVolumeDeadline);
+}
+
+/*
+ * All streams share one wake lock, taken when the first of them leaves
+ * standby. Streams going to standby hand their reference and their route
+ * over to the standby timer, which drops them AUDIO_HW_POWER_HOLD_MS after
+ * the last release. A stream waking up within that window takes both back,
+ * so short sound bursts cost neither a sysfs write nor a route cycle. The
+ * wake lock stays held until the routes are down, so the codec does not
+ * stay powered through suspend.
+ */
+void AudioHardware::acquireWakeLock_l()
+{
+	TRACE();
+
+	if (mWakeLockRefs++ || mWakeLockHeld)
+		return;
+
+	acquire_wake_lock(PARTIAL_WAKE_LOCK, "AudioLock");
+	mWakeLockHeld = true;
+}
+
+void AudioHardware::releaseWakeLock_l()
+{
+	TRACE();
+
+	if (--mWakeLockRefs == 0)
+		schedulePower_l();
+}
+
+void AudioHardware::releaseAudioRoute_l(AudioRouter::RouteType type)
+{
+	TRACE();
+
+	mReleasedRoutes |= BIT(type);
+	schedulePower_l();
+}
+
+void AudioHardware::schedulePower_l()
+{
+	TRACE();
+
+#if AUDIO_HW_POWER_HOLD_MS
+	mPowerDeadline = systemTime() + milliseconds(AUDIO_HW_POWER_HOLD_MS);
+	scheduleStandby(mPowerDeadline);
+#else
+	applyPower_l();
+#endif
+}
+
+void AudioHardware::applyPower_l()
+{
+	TRACE();
+
+	for (int type = 0; type < AudioRouter::ROUTE_COUNT; ++type) {
+		if (!(mReleasedRoutes & BIT(type)) || mRouter == 0)
+			continue;
+
+		nsecs_t start = systemTime();
+
+		LOGV("releasing route type %d", type);
+
+		if (mRouter->setAudioRoute((AudioRouter::RouteType)type, 0)
+		    && type == AudioRouter::ROUTE_OUTPUT && mOutput != 0)
+			mOutput->routeSwitched(start);
+	}
+
+	mReleasedRoutes = 0;
+
+	if (!mWakeLockRefs && mWakeLockHeld) {
+		release_wake_lock("AudioLock");
+		mWakeLockHeld = false;
+	}
+
+	mPowerDeadline = 0;
+}
+
 static const int kDumpLockRetries = 50;
 static const int kDumpLockSleep = 20000;
 
@@ -460,17 +733,31 @@ status_t AudioHardware::dump(int fd, const Vector<String16> &args)
 	snprintf(buffer, SIZE, "\tIn Call Audio Mode %s\n",
 		 (mInCallAudioMode) ? "ON" : "OFF");
 	result.append(buffer);
+	result.append("\tCodec capture rates:");
+	for (unsigned i = 0; i < mInputRateCount; ++i) {
+		snprintf(buffer, SIZE, " %u", mInputRates[i]);
+		result.append(buffer);
+	}
+	result.append("\n");
+	snprintf(buffer, SIZE, "\tWake lock %s (%d refs), released routes "
+				"0x%x%s\n", mWakeLockHeld ? "held" : "free",
+				mWakeLockRefs, mReleasedRoutes,
+				mPowerDeadline ? ", release pending" : "");
+	result.append(buffer);
 #ifdef DRIVER_TRACE
 	snprintf(buffer, SIZE, "\tmDriverOp: %d\n", mDriverOp);
 	result.append(buffer);
 #endif
 
-	snprintf(buffer, SIZE, "\n\tmOutput %p dump:\n", mOutput.get());
+	snprintf(buffer, SIZE, "\n\t%d outputs opened\n", mOutputs.size());
 	result.append(buffer);
 	write(fd, result.string(), result.size());
 
-	if (mOutput != 0)
-		mOutput->dump(fd, args);
+	if (mMixer != 0)
+		mMixer->dump(fd, args);
+
+	if (mRouter != 0)
+		mRouter->bluetoothBridge()->dump(fd, args);
 
 	snprintf(buffer, SIZE, "\n\t%d inputs opened:\n", mInputs.size());
 	write(fd, buffer, strlen(buffer));
@@ -481,9 +768,90 @@ status_t AudioHardware::dump(int fd, const Vector<String16> &args)
 		mInputs[i]->dump(fd, args);
 	}
 
+	for (size_t i = 0; i < args.size(); i++) {
+		if (args[i] == String16("--trace-on")
+		    || args[i] == String16("--trace-off")) {
+			trace_ring_enable(args[i] == String16("--trace-on"));
+			continue;
+		}
+
+		if (args[i] != String16("--trace"))
+			continue;
+
+		int ret = trace_ring_save(AUDIO_HW_TRACE_PATH);
+
+		snprintf(buffer, SIZE, "\n\tTrace ring saved to %s: %s\n",
+				AUDIO_HW_TRACE_PATH, strerror(-ret));
+		write(fd, buffer, strlen(buffer));
+		break;
+	}
+
 	return NO_ERROR;
 }
 
+void AudioHardware::scheduleStandby(nsecs_t when)
+{
+	TRACE();
+
+	if (mStandbyTimer != 0)
+		mStandbyTimer->schedule(when);
+}
+
+/*
+ * Puts streams paused for the whole standby delay to standby, writes
+ * pending codec volume levels and drops the wake lock and routes released
+ * by streams which stayed in standby. Returns the time of the next check, 0 if
+ * there is nothing left to do.
+ */
+nsecs_t AudioHardware::checkStandbyDelay(nsecs_t now)
+{
+	TRACE();
+	sp<AudioStreamOutALSA> spOut;
+	Vector<sp<AudioStreamInALSA> > inputs;
+	nsecs_t next = 0;
+	nsecs_t when;
+
+	// stream locks come before mLock, so work on references
+	mLock.lock();
+
+	if (mVolumeDeadline && now >= mVolumeDeadline) {
+		mRouter->applyVolume();
+		mVolumeWritten = now;
+		mVolumeDeadline = 0;
+	}
+
+	if (mPowerDeadline && now >= mPowerDeadline)
+		applyPower_l();
+
+	next = mVolumeDeadline;
+
+	if (mPowerDeadline && (!next || mPowerDeadline < next))
+		next = mPowerDeadline;
+
+	spOut = mOutput;
+
+	for (size_t i = 0; i < mInputs.size(); ++i)
+		inputs.add(mInputs[i]);
+
+	mLock.unlock();
+
+	if (spOut != 0) {
+		when = spOut->checkStandbyDelay(now);
+
+		if (when && (!next || when < next))
+			next = when;
+	}
+
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		when = inputs[i]->checkStandbyDelay(now);
+
+		if (when && (!next || when < next))
+			next = when;
+	}
+
+	return next;
+}
+
 status_t AudioHardware::setIncallPath(uint32_t device)
 {
 	TRACE();
@@ -22,6 +22,7 @@
 #include <sys/types.h>
 
 #include <utils/threads.h>
+#include <utils/Timers.h>
 #include <utils/SortedVector.h>
 
 #include <hardware_legacy/AudioHardwareBase.h>
@@ -34,14 +35,34 @@
 namespace android {
 
 class AudioStreamOutALSA;
+class AudioStreamOutClient;
 class AudioStreamInALSA;
+class OutputMixer;
+class StandbyTimer;
 
 class AudioHardware : public AudioHardwareBase {
 	Mutex mLock;
 
+	// hardware output, all output streams are mixed into
 	sp<AudioStreamOutALSA> mOutput;
+	sp<OutputMixer> mMixer;
+	SortedVector<sp<AudioStreamOutClient> > mOutputs;
 	SortedVector<sp<AudioStreamInALSA> > mInputs;
 	sp<AudioRouter> mRouter;
+	sp<StandbyTimer> mStandbyTimer;
+	uint32_t mStandbyDelay;
+	// codec volume write scheduled on the standby timer, 0 if none
+	nsecs_t mVolumeDeadline;
+	nsecs_t mVolumeWritten;
+	// one wake lock for all streams out of standby, dropped together with
+	// the routes streams left behind once mPowerDeadline expires
+	int mWakeLockRefs;
+	bool mWakeLockHeld;
+	uint32_t mReleasedRoutes;
+	nsecs_t mPowerDeadline;
+	// capture rates of the codec, probed at start up
+	unsigned mInputRates[8];
+	unsigned mInputRateCount;
 
 	bool mMicMute;
 	bool mInCallAudioMode;
@@ -56,6 +77,12 @@ class AudioHardware : public AudioHardwareBase {
 	uint32_t getInputRouteFromDevice(uint32_t device);
 	uint32_t getVoiceOutRouteFromDevice(uint32_t device);
 	uint32_t getVoiceInRouteFromDevice(uint32_t device);
+	status_t openHardwareOutput_l(uint32_t devices, int *format,
+				uint32_t *channels, uint32_t *sampleRate);
+	void closeHardwareOutput();
+	void scheduleVolume_l();
+	void schedulePower_l();
+	void applyPower_l();
 
 protected:
 	virtual status_t dump(int fd, const Vector<String16> &args);
@@ -92,14 +119,34 @@ public:
 	status_t setOutputPath(uint32_t device);
 	status_t setInputPath(uint32_t device);
 
-	void setAudioRoute(AudioRouter::RouteType type, uint32_t route)
+	/* Returns true if the codec got reprogrammed */
+	bool setAudioRoute(AudioRouter::RouteType type, uint32_t route)
 	{
-		if (mRouter != NULL)
-			mRouter->setAudioRoute(type, route);
+		mReleasedRoutes &= ~BIT(type);
+
+		if (mRouter == NULL)
+			return false;
+
+		return mRouter->setAudioRoute(type, route);
 	}
 
+	/* Stream power transitions, called with lock() held */
+	void acquireWakeLock_l();
+	void releaseWakeLock_l();
+	void releaseAudioRoute_l(AudioRouter::RouteType type);
+
 	sp <AudioStreamInALSA> getInput();
 
+	uint32_t standbyDelay() const
+	{
+		return mStandbyDelay;
+	}
+
+	bool inputRateSupported(uint32_t rate) const;
+
+	void scheduleStandby(nsecs_t when);
+	nsecs_t checkStandbyDelay(nsecs_t now);
+
 	sp <AudioStreamOutALSA> getOutput()
 	{
 		return mOutput;
@@ -21,6 +21,12 @@
 #include "AudioPolicyManager.h"
 #include <media/mediarecorder.h>
 
+#include "config.h"
+
+extern "C" {
+#include "alsa_audio.h"
+};
+
 namespace android {
 
 /*
@@ -28,6 +34,168 @@ namespace android {
  * Common audio policy manager code is implemented in AudioPolicyManagerBase class
  */
 
+/*
+ * Music goes to a second output, mixed by the audio HAL together with the
+ * primary one. While music plays alone, the HAL runs the codec with the
+ * deep buffer profile and the CPU can sleep through its long periods.
+ * As soon as anything starts on the primary output, the HAL switches to
+ * the shorter periods of the normal profile.
+ */
+
+AudioPolicyManager::AudioPolicyManager(
+			AudioPolicyClientInterface *clientInterface) :
+	AudioPolicyManagerBase(clientInterface),
+	mDeepBufferOutput(0)
+{
+#if AUDIO_POLICY_DEEP_BUFFER_MUSIC
+	if (mHardwareOutput)
+		openDeepBufferOutput();
+#endif
+}
+
+/*
+ * AudioFlinger sizes its mix buffer from the frame count of the output,
+ * and rereads it on frame count change only while the output has no
+ * tracks, so the deep buffer profile is selected right after opening.
+ */
+void AudioPolicyManager::openDeepBufferOutput()
+{
+	AudioOutputDescriptor *outputDesc = new AudioOutputDescriptor();
+	AudioParameter param;
+
+	outputDesc->mDevice = mOutputs.valueFor(mHardwareOutput)->device();
+	mDeepBufferOutput = mpClientInterface->openOutput(&outputDesc->mDevice,
+						&outputDesc->mSamplingRate,
+						&outputDesc->mFormat,
+						&outputDesc->mChannels,
+						&outputDesc->mLatency,
+						outputDesc->mFlags);
+
+	if (!mDeepBufferOutput) {
+		LOGE("Failed to open deep buffer output, "
+					"music stays on primary output");
+		delete outputDesc;
+		return;
+	}
+
+	param.addInt(String8(AudioParameter::keyFrameCount),
+					AUDIO_HW_OUT_DEEP_PERIOD_SZ);
+	mpClientInterface->setParameters(mDeepBufferOutput, param.toString());
+
+	outputDesc->mLatency = AUDIO_HW_OUT_LATENCY(AUDIO_HW_OUT_DEEP_PERIOD_SZ,
+					AUDIO_HW_OUT_DEEP_PERIOD_CNT,
+					outputDesc->mSamplingRate);
+	addOutput(mDeepBufferOutput, outputDesc);
+
+	LOGV("deep buffer output %d, latency %d ms", mDeepBufferOutput,
+						outputDesc->mLatency);
+}
+
+/*
+ * Both outputs share one codec route. The deep buffer output follows the
+ * primary one while it plays anything and its own streams otherwise, and
+ * the primary descriptor is kept in sync with whatever got routed.
+ */
+void AudioPolicyManager::checkDeepBufferDevice(bool force)
+{
+	uint32_t device;
+
+	if (!mDeepBufferOutput)
+		return;
+
+	device = getNewDevice(mHardwareOutput);
+
+	if (!device)
+		device = getNewDevice(mDeepBufferOutput);
+
+	setOutputDevice(mDeepBufferOutput, device, force);
+
+	if (device)
+		mOutputs.valueFor(mHardwareOutput)->mDevice =
+			mOutputs.valueFor(mDeepBufferOutput)->device();
+}
+
+status_t AudioPolicyManager::setDeviceConnectionState(
+			AudioSystem::audio_devices device,
+			AudioSystem::device_connection_state state,
+			const char *device_address)
+{
+	status_t status;
+
+	status = AudioPolicyManagerBase::setDeviceConnectionState(device,
+						state, device_address);
+	checkDeepBufferDevice();
+
+	return status;
+}
+
+void AudioPolicyManager::setPhoneState(int state)
+{
+	AudioPolicyManagerBase::setPhoneState(state);
+	checkDeepBufferDevice();
+}
+
+void AudioPolicyManager::setForceUse(AudioSystem::force_use usage,
+				AudioSystem::forced_config config)
+{
+	AudioPolicyManagerBase::setForceUse(usage, config);
+	checkDeepBufferDevice();
+}
+
+audio_io_handle_t AudioPolicyManager::getOutput(
+			AudioSystem::stream_type stream, uint32_t samplingRate,
+			uint32_t format, uint32_t channels,
+			AudioSystem::output_flags flags)
+{
+	audio_io_handle_t output;
+
+	output = AudioPolicyManagerBase::getOutput(stream, samplingRate,
+						format, channels, flags);
+
+	/* Only music mixed on the primary output moves, not A2DP or direct */
+	if (output == mHardwareOutput && mDeepBufferOutput
+	    && stream == AudioSystem::MUSIC)
+		output = mDeepBufferOutput;
+
+	return output;
+}
+
+status_t AudioPolicyManager::startOutput(audio_io_handle_t output,
+				AudioSystem::stream_type stream, int session)
+{
+	status_t status;
+
+	status = AudioPolicyManagerBase::startOutput(output, stream, session);
+	checkDeepBufferDevice();
+
+	return status;
+}
+
+status_t AudioPolicyManager::stopOutput(audio_io_handle_t output,
+				AudioSystem::stream_type stream, int session)
+{
+	status_t status;
+
+	status = AudioPolicyManagerBase::stopOutput(output, stream, session);
+	checkDeepBufferDevice();
+
+	return status;
+}
+
+/* Global effects belong where the music is */
+audio_io_handle_t AudioPolicyManager::getOutputForEffect(
+					effect_descriptor_t *desc)
+{
+	audio_io_handle_t output;
+
+	output = AudioPolicyManagerBase::getOutputForEffect(desc);
+
+	if (output == mHardwareOutput && mDeepBufferOutput)
+		output = mDeepBufferOutput;
+
+	return output;
+}
+
 /* class factory */
 
 
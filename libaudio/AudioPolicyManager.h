@@ -28,11 +28,29 @@ class AudioPolicyManager: public AudioPolicyManagerBase
 {
 
 public:
-	AudioPolicyManager(AudioPolicyClientInterface *clientInterface)
-		: AudioPolicyManagerBase(clientInterface) {}
+	AudioPolicyManager(AudioPolicyClientInterface *clientInterface);
 
 	virtual ~AudioPolicyManager() {}
 
+	virtual status_t setDeviceConnectionState(
+			AudioSystem::audio_devices device,
+			AudioSystem::device_connection_state state,
+			const char *device_address);
+	virtual void setPhoneState(int state);
+	virtual void setForceUse(AudioSystem::force_use usage,
+			AudioSystem::forced_config config);
+	virtual audio_io_handle_t getOutput(AudioSystem::stream_type stream,
+			uint32_t samplingRate = 0,
+			uint32_t format = AudioSystem::FORMAT_DEFAULT,
+			uint32_t channels = 0,
+			AudioSystem::output_flags flags =
+				AudioSystem::OUTPUT_FLAG_INDIRECT);
+	virtual status_t startOutput(audio_io_handle_t output,
+			AudioSystem::stream_type stream, int session = 0);
+	virtual status_t stopOutput(audio_io_handle_t output,
+			AudioSystem::stream_type stream, int session = 0);
+	virtual audio_io_handle_t getOutputForEffect(effect_descriptor_t *desc);
+
 protected:
 	/*
 	 * true is current platform implements a back microphone
@@ -52,6 +70,12 @@ protected:
 	}
 #endif
 
+private:
+	void openDeepBufferOutput();
+	void checkDeepBufferDevice(bool force = false);
+
+	/* music output using the deep buffer profile, 0 if not open */
+	audio_io_handle_t mDeepBufferOutput;
 };
 
 };
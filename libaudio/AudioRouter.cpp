@@ -18,8 +18,13 @@
 #define LOG_NDEBUG 0
 #define LOG_TAG "AudioRouter"
 
+#include <string.h>
+
 #include <cutils/log.h>
+#include <cutils/atomic.h>
 #include "AudioRouter.h"
+#include "BluetoothBridge.h"
+#include "MatrixKernels.h"
 #include "utils.h"
 
 extern "C" {
@@ -29,65 +34,29 @@ extern "C" {
 namespace android {
 
 /*
- * Bluetooth PCM helpers
+ * Bluetooth SCO link helpers
  */
 
-static int bluetoothInRefCnt = 0;
-static struct pcm *bluetoothInPcm = NULL;
-
-static void bluetoothInOpen(void)
+static void bluetoothInOpen(AudioRouter *router)
 {
-	TRACE();
-	LOGV("%s: ref count = %d", __func__, bluetoothInRefCnt);
-
-	if (++bluetoothInRefCnt == 1) {
-		bluetoothInPcm = pcm_open(PCM_BT | PCM_IN);
-
-		if (pcm_ready(bluetoothInPcm))
-			pcm_start(bluetoothInPcm);
-
-		LOGV("%s: pcm error = %s", __func__, pcm_error(bluetoothInPcm));
-	}
+	router->bluetoothBridge()->startInput();
 }
 
-static void bluetoothInClose(void)
+static void bluetoothInClose(AudioRouter *router)
 {
-	TRACE();
-	LOGV("%s: ref count = %d", __func__, bluetoothInRefCnt);
-
-	if (--bluetoothInRefCnt == 0)
-		pcm_close(bluetoothInPcm);
+	router->bluetoothBridge()->stopInput();
 }
 
-static int bluetoothOutRefCnt = 0;
-static struct pcm *bluetoothOutPcm = NULL;
-
-static void bluetoothOutOpen(void)
+static void bluetoothOutOpen(AudioRouter *router)
 {
-	TRACE();
-	LOGV("%s: ref count = %d", __func__, bluetoothOutRefCnt);
-
-	if (++bluetoothOutRefCnt == 1) {
-		bluetoothOutPcm = pcm_open(PCM_BT | PCM_OUT);
-
-		if (pcm_ready(bluetoothOutPcm))
-			pcm_start(bluetoothOutPcm);
-
-		LOGV("%s: pcm error = %s",
-					__func__, pcm_error(bluetoothOutPcm));
-	}
+	router->bluetoothBridge()->startOutput();
 }
 
-static void bluetoothOutClose(void)
+static void bluetoothOutClose(AudioRouter *router)
 {
-	TRACE();
-	LOGV("%s: ref count = %d", __func__, bluetoothOutRefCnt);
-
-	if (--bluetoothOutRefCnt == 0)
-		pcm_close(bluetoothOutPcm);
+	router->bluetoothBridge()->stopOutput();
 }
 
-
 /*
  * Pin configurations
  */
@@ -320,13 +289,29 @@ const AudioRouter::VolumeControl AudioRouter::pathVolCtrls[] = {
 };
 
 AudioRouter::AudioRouter() :
-	mPlaybackVolume(1.0f),
+	mPlaybackGain(0),
 	mVoiceVol(0.0f),
 	mMasterVol(0.0f),
+	mVolumePending(false),
+	mControls(0),
+	mControlCount(0),
+	mPending(0),
+	mPendingCount(0),
+	mPins(0),
+	mPinCount(0),
+	mInitialPins(0),
+	mEndpointVols(0),
+	mPathVols(0),
 	mStatus(NO_INIT)
 {
 	TRACE();
 
+	for (int i = 0; i < ROUTE_COUNT; ++i) {
+		mRoute[i] = 0;
+		mDisabled[i] = false;
+		mRoutePins[i] = 0;
+	}
+
 	TRACE_DRIVER_IN(DRV_MIXER_OPEN)
 	mMixer = mixer_open();
 	TRACE_DRIVER_OUT
@@ -336,11 +321,22 @@ AudioRouter::AudioRouter() :
 		return;
 	}
 
-	enablePinConfig(initialPinConfig);
+	initControls();
 
-	for (int i = 0; i < ROUTE_COUNT; ++i) {
-		mRoute[i] = 0;
-		mDisabled[i] = false;
+	if (!mInitialPins || !mEndpointVols || !mPathVols) {
+		LOGE("%s: Failed to allocate control state", __func__);
+		return;
+	}
+
+	mBluetooth = new BluetoothBridge();
+
+	if (mBluetooth->initCheck() != NO_ERROR)
+		LOGW("%s: Bluetooth SCO downlink not available", __func__);
+
+	/* Written one by one, the table sets some controls twice on purpose */
+	for (const ResolvedPin *pin = mInitialPins; pin->state; ++pin) {
+		stageControl(pin, pin->value);
+		applyControls();
 	}
 
 	mStatus = NO_ERROR;
@@ -353,135 +349,299 @@ AudioRouter::~AudioRouter()
 	if (mMixer)
 		mixer_close(mMixer);
 
+	if (mControls)
+		delete[] mControls;
+
+	if (mPending)
+		delete[] mPending;
+
+	if (mPins)
+		delete[] mPins;
+
+	for (int i = 0; i < ROUTE_COUNT; ++i)
+		if (mRoutePins[i])
+			delete[] mRoutePins[i];
+
+	if (mEndpointVols)
+		delete[] mEndpointVols;
+
+	if (mPathVols)
+		delete[] mPathVols;
+
 	mStatus = NO_INIT;
 }
 
-void AudioRouter::disablePinConfig(const AudioPinConfig *pin)
-{
-	TRACE();
-	struct mixer_ctl *ctl;
-	const AudioPinConfig *p = pin;
+/*
+ * Control state tracking
+ */
 
-	while (p->type)
-		++p;
+AudioRouter::ControlState *AudioRouter::findControl(const char *ctl)
+{
+	for (unsigned i = 0; i < mControlCount; ++i)
+		if (!strcmp(mControls[i].ctl, ctl))
+			return &mControls[i];
 
-	if (p == pin)
-		return;
+	return NULL;
+}
 
-	--p;
+int32_t AudioRouter::resolveValue(ControlState *state,
+					const char *strValue, int32_t intValue)
+{
+	if (state->type != TYPE_MUX)
+		return intValue;
 
-	/* Disable requested route */
-	do {
-		TRACE_DRIVER_IN(DRV_MIXER_GET)
-		ctl = mixer_get_control(mMixer, p->ctl, 0);
-		TRACE_DRIVER_OUT
+	if (!strValue || !state->handle)
+		return -1;
 
-		if (!ctl) {
-			LOGE("failed to get control '%s'", p->ctl);
-			continue;
-		}
+	int32_t index = mixer_ctl_get_enum_index(state->handle, strValue);
 
-		if (p->type == TYPE_MUX) {
-			if (!p->resetStrValue)
-				continue;
+	if (index < 0)
+		LOGE("control '%s' has no value '%s'", state->ctl, strValue);
 
-			TRACE_DRIVER_IN(DRV_MIXER_SEL)
+	return index;
+}
 
-			if (mixer_ctl_select(ctl, p->resetStrValue))
-				LOGE("failed to set control '%s' to '%s'",
-						p->ctl, p->resetStrValue);
+AudioRouter::ResolvedPin *AudioRouter::resolvePins(const AudioPinConfig *pin)
+{
+	ResolvedPin *pins = &mPins[mPinCount];
 
+	for (; pin->type; ++pin) {
+		ControlState *state = findControl(pin->ctl);
+
+		if (!state) {
+			state = &mControls[mControlCount++];
+			state->ctl = pin->ctl;
+			state->type = pin->type;
+			state->valid = false;
+			state->value = 0;
+			state->newValue = 0;
+			state->pending = false;
+
+			TRACE_DRIVER_IN(DRV_MIXER_GET)
+			state->handle = mixer_get_control(mMixer, pin->ctl, 0);
 			TRACE_DRIVER_OUT
-			continue;
+
+			if (!state->handle)
+				LOGE("failed to get control '%s'", pin->ctl);
 		}
 
-		if (p->resetIntValue < 0)
-			continue;
+		ResolvedPin *resolved = &mPins[mPinCount++];
 
-		TRACE_DRIVER_IN(DRV_MIXER_SEL)
+		resolved->state = state;
+		resolved->value = resolveValue(state,
+						pin->strValue, pin->intValue);
+		resolved->resetValue = resolveValue(state,
+					pin->resetStrValue, pin->resetIntValue);
+	}
 
-		if (mixer_ctl_set(ctl, CTL_VALUE_RAW | p->resetIntValue))
-			LOGE("failed to set control '%s' to %d",
-						p->ctl, p->resetIntValue);
+	mPins[mPinCount++].state = NULL;
 
-		TRACE_DRIVER_OUT
-	} while (p-- != pin);
+	return pins;
+}
+
+AudioRouter::ResolvedVolume *AudioRouter::resolveVolumeControls(
+						const VolumeControl *volCtrl)
+{
+	unsigned count = 0;
+
+	while (volCtrl[count].endpoint)
+		++count;
+
+	ResolvedVolume *vols = new ResolvedVolume[count];
+
+	if (!vols)
+		return NULL;
+
+	for (unsigned i = 0; i < count; ++i) {
+		vols[i].ctl = mixer_get_control(mMixer, volCtrl[i].control, 0);
+		vols[i].value = -1;
+
+		if (!vols[i].ctl)
+			LOGE("failed to get control '%s'", volCtrl[i].control);
+	}
+
+	return vols;
 }
 
-void AudioRouter::enablePinConfig(const AudioPinConfig *pin)
+/*
+ * Resolves all pin and volume tables against the mixer, so route and
+ * volume changes do no name lookups.
+ */
+void AudioRouter::initControls(void)
 {
 	TRACE();
-	struct mixer_ctl *ctl;
+	const AudioRouteConfig *route;
+	const AudioPinConfig *pin;
+	unsigned count = 0;
+	unsigned tables = 1;
 
-	/* Configure requested route */
-	for (; pin->type; ++pin) {
-		TRACE_DRIVER_IN(DRV_MIXER_GET)
-		ctl = mixer_get_control(mMixer, pin->ctl, 0);
-		TRACE_DRIVER_OUT
+	/* Upper bound, shared controls are counted more than once */
+	for (pin = initialPinConfig; pin->type; ++pin)
+		++count;
 
-		if (!ctl) {
-			LOGE("failed to get control '%s'", pin->ctl);
-			continue;
+	for (int type = 0; type < ROUTE_COUNT; ++type) {
+		for (route = routeTables[type]; route->route; ++route) {
+			for (pin = route->config; pin->type; ++pin)
+				++count;
+
+			++tables;
 		}
+	}
 
-		if (pin->type == TYPE_MUX) {
-			TRACE_DRIVER_IN(DRV_MIXER_SEL)
+	mControls = new ControlState[count];
+	mPending = new unsigned[count];
+	mPins = new ResolvedPin[count + tables];
 
-			if (mixer_ctl_select(ctl, pin->strValue))
-				LOGE("failed to set control '%s' to '%s'",
-						pin->ctl, pin->strValue);
+	if (!mControls || !mPending || !mPins)
+		return;
 
-			TRACE_DRIVER_OUT
+	for (int type = 0; type < ROUTE_COUNT; ++type) {
+		unsigned entries = 0;
+
+		while (routeTables[type][entries].route)
+			++entries;
+
+		mRoutePins[type] = new ResolvedPin *[entries];
+
+		if (!mRoutePins[type])
+			return;
+
+		for (unsigned i = 0; i < entries; ++i)
+			mRoutePins[type][i] =
+				resolvePins(routeTables[type][i].config);
+	}
+
+	mEndpointVols = resolveVolumeControls(endpointVolCtrls);
+	mPathVols = resolveVolumeControls(pathVolCtrls);
+
+	mInitialPins = resolvePins(initialPinConfig);
+
+	LOGV("%s: tracking %u controls", __func__, mControlCount);
+}
+
+void AudioRouter::stageControl(const ResolvedPin *pin, int32_t value)
+{
+	ControlState *state = pin->state;
+
+	if (!state->pending) {
+		state->pending = true;
+		mPending[mPendingCount++] = state - mControls;
+	}
+
+	state->newValue = value;
+}
+
+/*
+ * Writes staged controls whose target value differs from the last value
+ * written, in the order they were first staged.
+ */
+void AudioRouter::applyControls(void)
+{
+	TRACE();
+	unsigned written = 0;
+
+	for (unsigned i = 0; i < mPendingCount; ++i) {
+		ControlState *state = &mControls[mPending[i]];
+		int ret;
+
+		state->pending = false;
+
+		if (state->valid && state->value == state->newValue)
+			continue;
+
+		if (!state->handle)
 			continue;
-		}
 
 		TRACE_DRIVER_IN(DRV_MIXER_SEL)
 
-		if (mixer_ctl_set(ctl, CTL_VALUE_RAW | pin->intValue))
-			LOGE("failed to set control '%s' to %d",
-						pin->ctl, pin->intValue);
+		if (state->type == TYPE_MUX)
+			ret = mixer_ctl_select_index(state->handle,
+							state->newValue);
+		else
+			ret = mixer_ctl_set(state->handle,
+					CTL_VALUE_RAW | state->newValue);
 
 		TRACE_DRIVER_OUT
+
+		if (ret)
+			LOGE("failed to set control '%s' to %d",
+						state->ctl, state->newValue);
+
+		/* Unknown state after a failure, rewrite it next time */
+		state->valid = !ret;
+		state->value = state->newValue;
+		++written;
 	}
+
+	LOGV("%s: %u of %u staged controls written",
+					__func__, written, mPendingCount);
+
+	mPendingCount = 0;
 }
 
-void AudioRouter::disableRoute(enum RouteType type)
+void AudioRouter::disablePinConfig(const ResolvedPin *pin)
 {
 	TRACE();
-	const AudioRouteConfig *route = routeTables[type];
+	const ResolvedPin *p = pin;
 
-	while (route->route)
-		++route;
+	while (p->state)
+		++p;
 
-	if (route == routeTables[type])
+	if (p == pin)
 		return;
 
-	--route;
+	--p;
 
+	/* Stage reset values of requested route */
 	do {
-		if (!(mRoute[type] & BIT(route->route)))
+		if (p->resetValue >= 0)
+			stageControl(p, p->resetValue);
+	} while (p-- != pin);
+}
+
+void AudioRouter::enablePinConfig(const ResolvedPin *pin)
+{
+	TRACE();
+
+	/* Stage values of requested route */
+	for (; pin->state; ++pin)
+		if (pin->value >= 0)
+			stageControl(pin, pin->value);
+}
+
+void AudioRouter::disableRoute(enum RouteType type)
+{
+	TRACE();
+	const AudioRouteConfig *route = routeTables[type];
+	int i = 0;
+
+	while (route[i].route)
+		++i;
+
+	while (i--) {
+		if (!(mRoute[type] & BIT(route[i].route)))
 			continue;
 
-		disablePinConfig(route->config);
+		disablePinConfig(mRoutePins[type][i]);
 
-		if (route->disable)
-			route->disable();
-	} while (route-- != routeTables[type]);
+		if (route[i].disable)
+			route[i].disable(this);
+	}
 }
 
 void AudioRouter::enableRoute(enum RouteType type)
 {
 	TRACE();
-	const AudioRouteConfig *route;
+	const AudioRouteConfig *route = routeTables[type];
 
-	for (route = routeTables[type]; route->route; ++route) {
-		if (!(mRoute[type] & BIT(route->route)))
+	for (int i = 0; route[i].route; ++i) {
+		if (!(mRoute[type] & BIT(route[i].route)))
 			continue;
 
-		if (route->enable)
-			route->enable();
+		if (route[i].enable)
+			route[i].enable(this);
 
-		enablePinConfig(route->config);
+		enablePinConfig(mRoutePins[type][i]);
 	}
 }
 
@@ -494,11 +654,13 @@ void AudioRouter::setRouteDisable(enum RouteType type, bool disabled)
 
 	if (disabled) {
 		disableRoute(type);
+		applyControls();
 	} else {
 		if (type == ROUTE_OUTPUT || type == ROUTE_VOICE_OUT)
 			muteOutputs();
 
 		enableRoute(type);
+		applyControls();
 
 		if (type == ROUTE_OUTPUT || type == ROUTE_VOICE_OUT)
 			updateVolume();
@@ -507,44 +669,64 @@ void AudioRouter::setRouteDisable(enum RouteType type, bool disabled)
 	mDisabled[type] = disabled;
 }
 
-void AudioRouter::setAudioRoute(enum RouteType type, uint32_t route)
+bool AudioRouter::setAudioRoute(enum RouteType type, uint32_t route)
 {
 	TRACE();
 	const AudioRouteConfig *cfg;
 
 	if (mDisabled[type]) {
 		mRoute[type] = route;
-		return;
+		return false;
 	}
 
+	/* Nothing to reprogram, avoid muting active outputs */
+	if (mRoute[type] == route)
+		return false;
+
 	if (type == ROUTE_OUTPUT || type == ROUTE_VOICE_OUT)
 		muteOutputs();
 
+	/* Pins shared by both routes are left untouched */
 	disableRoute(type);
 	mRoute[type] = route;
 	enableRoute(type);
+	applyControls();
 
 	if (type == ROUTE_OUTPUT || type == ROUTE_VOICE_OUT)
 		updateVolume();
+
+	return true;
 }
 
 void AudioRouter::setEndpointVolume(const VolumeControl *volCtrl,
-					uint32_t endpointMask, float volume)
+				ResolvedVolume *vols, uint32_t endpointMask,
+				float volume)
 {
 	TRACE();
-	struct mixer_ctl *ctl;
 
-	for (; volCtrl->endpoint; ++volCtrl) {
-		if (!(endpointMask & BIT(volCtrl->endpoint)))
+	if (!vols)
+		return;
+
+	for (; volCtrl->endpoint; ++volCtrl, ++vols) {
+		int32_t value = (int32_t)(volume * volCtrl->max);
+
+		if (!(endpointMask & BIT(volCtrl->endpoint)) || !vols->ctl)
+			continue;
+
+		if (vols->value == value)
 			continue;
 
-		ctl = mixer_get_control(mMixer, volCtrl->control, 0);
+		TRACE_DRIVER_IN(DRV_MIXER_SEL)
 
-		if (ctl)
-			mixer_ctl_set(ctl, CTL_VALUE_RAW |
-					(uint32_t)(volume * volCtrl->max));
-		else
-			LOGE("failed to get control '%s'", volCtrl->control);
+		if (mixer_ctl_set(vols->ctl, CTL_VALUE_RAW | value)) {
+			LOGE("failed to set control '%s' to %d",
+						volCtrl->control, value);
+			value = -1;
+		}
+
+		TRACE_DRIVER_OUT
+
+		vols->value = value;
 	}
 }
 
@@ -552,55 +734,86 @@ void AudioRouter::muteOutputs(void)
 {
 	TRACE();
 
-	setEndpointVolume(endpointVolCtrls, mRoute[ROUTE_OUTPUT], 0.0f);
-	setEndpointVolume(endpointVolCtrls, mRoute[ROUTE_VOICE_OUT], 0.0f);
+	setEndpointVolume(endpointVolCtrls, mEndpointVols,
+				mRoute[ROUTE_OUTPUT], 0.0f);
+	setEndpointVolume(endpointVolCtrls, mEndpointVols,
+				mRoute[ROUTE_VOICE_OUT], 0.0f);
 }
 
-void AudioRouter::updateVolume(void)
+/*
+ * Playback output endpoints run at full level and the master volume is
+ * applied in software, unless they are shared with the voice path. Then
+ * they follow the voice volume and playback is scaled down to the master
+ * volume, if it is the lower one.
+ */
+void AudioRouter::getVolumeLevels(float *playback, float *playbackOutput,
+							float *voiceOutput)
 {
-	TRACE();
-	float playbackVolume = 1.0f;
-	float playbackOutputVolume = mMasterVol;
-	float voiceOutputVolume = mVoiceVol;
+	*playback = mMasterVol;
+	*playbackOutput = 1.0f;
+	*voiceOutput = mVoiceVol;
 
-	/* Calculate volume factors */
 	if (mRoute[ROUTE_OUTPUT] & mRoute[ROUTE_VOICE_OUT]) {
-		if (mVoiceVol > mMasterVol) {
-			playbackOutputVolume = mVoiceVol;
-			voiceOutputVolume = mVoiceVol;
-			playbackVolume = mMasterVol / mVoiceVol;
-		} else {
-			playbackOutputVolume = mVoiceVol;
-			voiceOutputVolume = mVoiceVol;
-			playbackVolume = 1.0f;
-		}
+		*playbackOutput = mVoiceVol;
+		*playback = 1.0f;
+
+		if (mVoiceVol > mMasterVol)
+			*playback = mMasterVol / mVoiceVol;
 	}
+}
+
+void AudioRouter::setPlaybackGain(float gain)
+{
+	if (gain < 0.0f)
+		gain = 0.0f;
+
+	if (gain > 1.0f)
+		gain = 1.0f;
+
+	android_atomic_release_store((int32_t)(gain * MATRIX_COEFF_ONE + 0.5f),
+							&mPlaybackGain);
+}
+
+int16_t AudioRouter::playbackGain()
+{
+	return (int16_t)android_atomic_acquire_load(&mPlaybackGain);
+}
+
+void AudioRouter::updateVolume(void)
+{
+	TRACE();
+	float playbackVolume, playbackOutputVolume, voiceOutputVolume;
+
+	getVolumeLevels(&playbackVolume, &playbackOutputVolume,
+							&voiceOutputVolume);
+	setPlaybackGain(playbackVolume);
 
-	if (playbackVolume <= mPlaybackVolume)
-		/* Adjust playback volume */
-		setEndpointVolume(pathVolCtrls,
-					BIT(ROUTE_OUTPUT), playbackVolume);
+	/* Playback level is set in software, codec path stays at full */
+	setEndpointVolume(pathVolCtrls, mPathVols, BIT(ROUTE_OUTPUT), 1.0f);
 
 	/* Adjust playback output volume */
-	setEndpointVolume(endpointVolCtrls,
+	setEndpointVolume(endpointVolCtrls, mEndpointVols,
 				mRoute[ROUTE_OUTPUT], playbackOutputVolume);
 
 	/* Adjust voice output volume */
-	setEndpointVolume(endpointVolCtrls,
+	setEndpointVolume(endpointVolCtrls, mEndpointVols,
 				mRoute[ROUTE_VOICE_OUT], voiceOutputVolume);
 
-	if (playbackVolume > mPlaybackVolume)
-		/* Adjust playback volume */
-		setEndpointVolume(pathVolCtrls,
-					BIT(ROUTE_OUTPUT), playbackVolume);
+	mVolumePending = false;
+}
 
-	/* Remember new endpoint volume levels */
-	mPlaybackVolume = playbackVolume;
+void AudioRouter::applyVolume(void)
+{
+	TRACE();
+
+	if (mVolumePending)
+		updateVolume();
 }
 
 void AudioRouter::setVoiceVolume(float volume)
 {
 	TRACE();
+	float playback, playbackOutput, voiceOutput;
 
 	if (!mMixer) {
 		LOGW("setOutputVolume called, but mMixer is NULL");
@@ -609,12 +822,15 @@ void AudioRouter::setVoiceVolume(float volume)
 
 	mVoiceVol = volume;
 
-	updateVolume();
+	getVolumeLevels(&playback, &playbackOutput, &voiceOutput);
+	setPlaybackGain(playback);
+	mVolumePending = true;
 }
 
 void AudioRouter::setMasterVolume(float volume)
 {
 	TRACE();
+	float playback, playbackOutput, voiceOutput;
 
 	if (!mMixer) {
 		LOGW("setOutputVolume called, but mMixer is NULL");
@@ -623,7 +839,9 @@ void AudioRouter::setMasterVolume(float volume)
 
 	mMasterVol = volume;
 
-	updateVolume();
+	getVolumeLevels(&playback, &playbackOutput, &voiceOutput);
+	setPlaybackGain(playback);
+	mVolumePending = true;
 }
 
 }; /* namespace android */
@@ -25,10 +25,13 @@
 
 extern "C" {
 	struct mixer;
+	struct mixer_ctl;
 };
 
 namespace android {
 
+class BluetoothBridge;
+
 class AudioRouter : public RefBase {
 public:
 	enum PinType {
@@ -80,8 +83,8 @@ public:
 	struct AudioRouteConfig {
 		uint32_t route;
 		const AudioPinConfig *config;
-		void (*enable)(void);
-		void (*disable)(void);
+		void (*enable)(AudioRouter *router);
+		void (*disable)(AudioRouter *router);
 	};
 #define ROUTE_CONFIG(route, config) \
 		{ AudioRouter::route, config, NULL, NULL }
@@ -99,14 +102,65 @@ public:
 #define VOLUME_CONTROL_TERMINATOR { 0, NULL, 0 }
 
 private:
+	/*
+	 * Volume control resolved against the mixer, with the last value
+	 * written, so unchanged levels are not written again.
+	 */
+	struct ResolvedVolume {
+		struct mixer_ctl *ctl;
+		/* -1 if unknown */
+		int32_t value;
+	};
+
 	void setEndpointVolume(const VolumeControl *volCtrl,
-					uint32_t endpointMask, float volume);
+				ResolvedVolume *vols, uint32_t endpointMask,
+				float volume);
 	void muteOutputs(void);
+	void getVolumeLevels(float *playback, float *playbackOutput,
+							float *voiceOutput);
+	void setPlaybackGain(float gain);
 	void updateVolume(void);
 	void disableRoute(enum RouteType type);
 	void enableRoute(enum RouteType type);
-	void disablePinConfig(const AudioPinConfig *pin);
-	void enablePinConfig(const AudioPinConfig *pin);
+
+	/*
+	 * Shadow copy of codec controls used by pin configurations. Route
+	 * transitions only stage target values, which are then compared
+	 * against the last values written and applied in one pass.
+	 */
+	struct ControlState {
+		const char *ctl;
+		struct mixer_ctl *handle;
+		PinType type;
+		/* Last value written to the codec, if valid */
+		bool valid;
+		int32_t value;
+		/* Target value of the pending transition */
+		int32_t newValue;
+		bool pending;
+	};
+
+	/*
+	 * Pin configuration resolved against the mixer at construction,
+	 * enum values are item indices. Terminated by a NULL state.
+	 */
+	struct ResolvedPin {
+		ControlState *state;
+		/* -1 if there is nothing to write */
+		int32_t value;
+		int32_t resetValue;
+	};
+
+	void initControls(void);
+	ControlState *findControl(const char *ctl);
+	ResolvedPin *resolvePins(const AudioPinConfig *pin);
+	int32_t resolveValue(ControlState *state,
+					const char *strValue, int32_t intValue);
+	ResolvedVolume *resolveVolumeControls(const VolumeControl *volCtrl);
+	void stageControl(const ResolvedPin *pin, int32_t value);
+	void applyControls(void);
+	void disablePinConfig(const ResolvedPin *pin);
+	void enablePinConfig(const ResolvedPin *pin);
 
 	static const AudioPinConfig initialPinConfig[];
 	static const AudioRouteConfig *routeTables[ROUTE_COUNT];
@@ -116,12 +170,33 @@ private:
 	uint32_t mRoute[ROUTE_COUNT];
 	bool mDisabled[ROUTE_COUNT];
 
-	float mPlaybackVolume;
+	/* Software playback gain, 2.14 fixed-point */
+	volatile int32_t mPlaybackGain;
 
 	float mVoiceVol;
 	float mMasterVol;
+	/* Volume changed, codec levels not written yet */
+	bool mVolumePending;
 
 	struct mixer *mMixer;
+	/* SCO link, started by routes through ENDPOINT_BT or ENDPOINT_MIC_BT */
+	sp<BluetoothBridge> mBluetooth;
+
+	ControlState *mControls;
+	unsigned mControlCount;
+	/* Indices of staged controls, in staging order */
+	unsigned *mPending;
+	unsigned mPendingCount;
+
+	/* Storage for all resolved pin tables */
+	ResolvedPin *mPins;
+	unsigned mPinCount;
+	ResolvedPin *mInitialPins;
+	/* Resolved pins of each entry of routeTables */
+	ResolvedPin **mRoutePins[ROUTE_COUNT];
+	/* Parallel to endpointVolCtrls and pathVolCtrls */
+	ResolvedVolume *mEndpointVols;
+	ResolvedVolume *mPathVols;
 
 	status_t mStatus;
 
@@ -137,10 +212,25 @@ public:
 	}
 
 	void setRouteDisable(enum RouteType type, bool disabled);
-	void setAudioRoute(RouteType type, uint32_t route);
-
+	/* Returns true if the codec got reprogrammed */
+	bool setAudioRoute(RouteType type, uint32_t route);
+
+	/*
+	 * Playback follows the master volume at once, through the software
+	 * gain. Codec levels are only written by applyVolume() or the next
+	 * route change, so a burst of changes costs one write per control.
+	 */
 	void setVoiceVolume(float volume);
 	void setMasterVolume(float volume);
+	void applyVolume(void);
+
+	/* Gain OutputMixer applies to playback, 2.14 fixed-point */
+	int16_t playbackGain();
+
+	const sp<BluetoothBridge> &bluetoothBridge()
+	{
+		return mBluetooth;
+	}
 };
 
 }; /* namespace android */
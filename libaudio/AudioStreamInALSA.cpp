@@ -19,13 +19,12 @@
 #define LOG_TAG "AudioStreamInALSA"
 
 #include <cutils/log.h>
-#include <hardware_legacy/power.h>
 #include "AudioStreamInALSA.h"
 #include "AudioHardwareASoC.h"
 #include "AudioStreamOutALSA.h"
 #include "AudioRouter.h"
 #include "ChannelMixer.h"
-#include "DownSampler.h"
+#include "Resampler.h"
 
 extern "C" {
 #include "alsa_audio.h"
@@ -40,13 +39,20 @@ namespace android {
 AudioStreamInALSA::AudioStreamInALSA() :
 	mHardware(0),
 	mPcm(0),
+	mPcmMmap(false),
+	mAcquiredOffset(0),
 	mStandby(true),
+	mPaused(false),
+	mStandbyTime(0),
 	mDevices(0),
 	mChannels(AUDIO_HW_IN_CHANNELS),
 	mChannelCount(2),
 	mSampleRate(AUDIO_HW_IN_SAMPLERATE),
+	mPcmSampleRate(AUDIO_HW_IN_SAMPLERATE),
+	mNativeRate(true),
 	mBufferSize(AUDIO_HW_IN_PERIOD_BYTES),
-	mDownSampler(0),
+	mResampler(0),
+	mResamplerQuality(Resampler::QUALITY_DEFAULT),
 	mChannelMixer(0),
 	mReadStatus(NO_ERROR),
 	mInPcmInBuf(0),
@@ -55,7 +61,8 @@ AudioStreamInALSA::AudioStreamInALSA() :
 	mDriverOp(DRV_NONE),
 #endif
 	mStandbyCnt(0),
-	mSleepReq(false)
+	mStats(true),
+	mBlockedNs(0)
 {
 	TRACE();
 }
@@ -96,8 +103,6 @@ status_t AudioStreamInALSA::set(AudioHardware *hw,
 						*pFormat, *pChannels, *pRate);
 
 	mDevices = devices;
-	mInputChannels = AUDIO_HW_IN_CHANNELS;
-	mInputChannelCount = AudioSystem::popCount(mInputChannels);
 	mChannels = *pChannels;
 	mChannelCount = AudioSystem::popCount(mChannels);
 	mBufferSize = getBufferSize(rate, mChannelCount);
@@ -106,37 +111,72 @@ status_t AudioStreamInALSA::set(AudioHardware *hw,
 	delete mChannelMixer;
 	mChannelMixer = 0;
 
-	delete mDownSampler;
-	mDownSampler = 0;
+	delete mResampler;
+	mResampler = 0;
 
-	mInputProvider = this;
+	mNativeRate = hw->inputRateSupported(mSampleRate);
 
-	if (mChannels != AUDIO_HW_IN_CHANNELS) {
-		mChannelMixer = new ChannelMixer(mChannelCount,
-				mInputChannelCount, AUDIO_HW_IN_PERIOD_SZ,
-				mInputProvider);
+	return setPcmConfig_l(mNativeRate ? mSampleRate
+					: AUDIO_HW_IN_SAMPLERATE,
+					AUDIO_HW_IN_CHANNEL_COUNT);
+}
 
-		if (!mChannelMixer || mChannelMixer->initCheck() != NO_ERROR) {
-			LOGE("AudioStreamInALSA::set() channel mixer "
-								"init failed");
-			return NO_INIT;
+/*
+ * Sets up the conversion chain for the rate and channel count the pcm
+ * runs at. The channel mixer and the resampler are only put into the
+ * chain when these differ from the ones of the stream.
+ */
+status_t AudioStreamInALSA::setPcmConfig_l(uint32_t rate,
+						uint32_t channelCount)
+{
+	TRACE();
+
+	mPcmSampleRate = rate;
+	mInputChannelCount = channelCount;
+	mInputChannels = (channelCount == 1) ? AudioSystem::CHANNEL_IN_MONO
+					     : AudioSystem::CHANNEL_IN_STEREO;
+	mInputProvider = this;
+
+	if (channelCount != mChannelCount) {
+		if (!mChannelMixer) {
+			mChannelMixer = new ChannelMixer(mChannelCount,
+					channelCount, AUDIO_HW_IN_PERIOD_SZ,
+					this);
+
+			if (!mChannelMixer
+			    || mChannelMixer->initCheck() != NO_ERROR) {
+				LOGE("AudioStreamInALSA::setPcmConfig_l() "
+					"channel mixer init failed");
+				delete mChannelMixer;
+				mChannelMixer = 0;
+				return NO_INIT;
+			}
 		}
 
 		mInputProvider = mChannelMixer;
 	}
 
-	if (mSampleRate != AUDIO_HW_IN_SAMPLERATE) {
-		mDownSampler = new DownSampler(mSampleRate,
+	if (rate != mSampleRate) {
+		if (!mResampler) {
+			mResampler = new Resampler(rate, mSampleRate,
 					mChannelCount, AUDIO_HW_IN_PERIOD_SZ,
-					mInputProvider);
-
-		if (!mDownSampler || mDownSampler->initCheck() != NO_ERROR) {
-			LOGE("AudioStreamInALSA::set() downsampler "
-								"init failed");
-			return NO_INIT;
+					mInputProvider,
+					(Resampler::Quality)mResamplerQuality);
+
+			if (!mResampler
+			    || mResampler->initCheck() != NO_ERROR) {
+				LOGE("AudioStreamInALSA::setPcmConfig_l() "
+					"resampler init failed");
+				delete mResampler;
+				mResampler = 0;
+				return NO_INIT;
+			}
 		}
 
-		mInputProvider = mDownSampler;
+		mResampler->setProvider(mInputProvider);
+		mInPcmInBuf = 0;
+		mResampler->reset();
+		mInputProvider = mResampler;
 	}
 
 	return NO_ERROR;
@@ -145,10 +185,10 @@ status_t AudioStreamInALSA::set(AudioHardware *hw,
 AudioStreamInALSA::~AudioStreamInALSA()
 {
 	TRACE();
-	standby();
+	forceStandby();
 
-	if (mDownSampler)
-		delete mDownSampler;
+	if (mResampler)
+		delete mResampler;
 
 	if (mChannelMixer)
 		delete mChannelMixer;
@@ -161,7 +201,7 @@ uint32_t AudioStreamInALSA::getInputSampleRate(uint32_t sampleRate)
 {
 	/* Sampling rates supported by input device */
 	static const uint32_t inputSamplingRates[] = {
-		8000, 11025, 16000, 22050, 44100
+		8000, 11025, 12000, 16000, 22050, 24000, 32000, 44100, 48000
 	};
 	uint32_t i;
 	uint32_t prevDelta = 0xffffffff;
@@ -217,11 +257,16 @@ int AudioStreamInALSA::wakeUp_l(void)
 		return 0;
 
 	AutoMutex hwLock(mHardware->lock());
+	nsecs_t start = systemTime();
 
 	LOGD("AudioHardware pcm capture is exiting standby.");
 
-	acquire_wake_lock(PARTIAL_WAKE_LOCK, "AudioInLock");
+	mHardware->acquireWakeLock_l();
 
+#if AUDIO_HW_FULL_DUPLEX
+	// playback runs on its own pcm, leave it alone
+	open_l();
+#else
 	sp<AudioStreamOutALSA> spOut = mHardware->getOutput();
 
 	while (spOut != 0) {
@@ -263,12 +308,14 @@ int AudioStreamInALSA::wakeUp_l(void)
 	}
 
 	open_l();
+#endif
 
 	if (!mPcm) {
-		release_wake_lock("AudioInLock");
+		mHardware->releaseWakeLock_l();
 		return -1;
 	}
 
+	mStats.standbyExit(start);
 	mStandby = false;
 
 	return 0;
@@ -281,24 +328,23 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
 	int ret;
 	size_t frames = bytes / frameSize();
 	size_t framesIn = 0;
+	nsecs_t start = systemTime();
 	Buffer buf;
 
 	if (!mHardware) return NO_INIT;
 
-	if (mSleepReq) {
-		// 10ms are always shorter than the time to reconfigure
-		// the audio path which is the only condition when mSleepReq
-		// would be true.
-		usleep(10000);
-	}
-
+	// yields to standby or routing requests from other threads
 	mLock.lock();
 
 	if (wakeUp_l())
 		goto error;
 
+	if (mPaused)
+		resume_l();
+
 	buf.raw = buffer;
 	mReadStatus = 0;
+	mBlockedNs = 0;
 
 	do {
 		buf.frameCount = frames - framesIn;
@@ -308,8 +354,11 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
 	} while (framesIn < frames && !ret);
 
 	bytes = framesIn*frameSize();
+	TRACE_ARGS(bytes, mBlockedNs / 1000);
 
 	if (!ret) {
+		mStats.transfer(start, mBlockedNs, framesIn,
+						pcm_get_xruns(mPcm));
 		mLock.unlock();
 		return bytes;
 	}
@@ -317,10 +366,11 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
 	LOGE("read error: %d", ret);
 
 	status = ret;
+	mStats.error();
 
 error:
 	mLock.unlock();
-	standby();
+	forceStandby();
 
 	// Simulate audio output timing in case of error
 	usleep((((bytes * 1000) / frameSize()) * 1000) / sampleRate());
@@ -328,18 +378,46 @@ error:
 	return status;
 }
 
+/*
+ * Stops the pcm, keeping it open and routed for the standby delay, so
+ * capture restarting soon does not pay for the reopen.
+ */
 status_t AudioStreamInALSA::standby()
 {
 	TRACE();
+	uint32_t delay;
 
 	if (!mHardware) {
 		LOGW("Called standby() on input, but mHardware is NULL");
 		return NO_INIT;
 	}
 
-	mSleepReq = true;
-	mLock.lock();
-	mSleepReq = false;
+	delay = mHardware->standbyDelay();
+
+	if (!delay)
+		return forceStandby();
+
+	mLock.lockPriority();
+
+	if (!mStandby && !mPaused) {
+		pause_l();
+		mStandbyTime = systemTime() + milliseconds(delay);
+		mHardware->scheduleStandby(mStandbyTime);
+	}
+
+	mLock.unlock();
+
+	return NO_ERROR;
+}
+
+status_t AudioStreamInALSA::forceStandby()
+{
+	TRACE();
+
+	if (!mHardware)
+		return NO_INIT;
+
+	mLock.lockPriority();
 	mHardware->lock().lock();
 	doStandby_l();
 	mHardware->lock().unlock();
@@ -351,15 +429,75 @@ status_t AudioStreamInALSA::standby()
 void AudioStreamInALSA::doStandby_l()
 {
 	TRACE();
+	nsecs_t start = systemTime();
+	bool active = !mStandby;
+
 	++mStandbyCnt;
+	mPaused = false;
 
 	if (!mStandby) {
 		LOGD("AudioHardware pcm capture is going to standby.");
-		release_wake_lock("AudioInLock");
+		mHardware->releaseWakeLock_l();
 		mStandby = true;
 	}
 
 	close_l();
+
+	if (active)
+		mStats.standbyEnter(start);
+}
+
+void AudioStreamInALSA::pause_l()
+{
+	TRACE();
+
+	LOGD("AudioHardware pcm capture is pausing.");
+
+	if (mPcm) {
+		TRACE_DRIVER_IN(DRV_PCM_STOP)
+		pcm_stop(mPcm);
+		TRACE_DRIVER_OUT
+	}
+
+	mPaused = true;
+}
+
+/* The pcm restarts on next read, drop what was buffered before the pause */
+void AudioStreamInALSA::resume_l()
+{
+	TRACE();
+
+	if (mResampler) {
+		mInPcmInBuf = 0;
+		mResampler->reset();
+	}
+
+	mPaused = false;
+}
+
+/*
+ * Called by the standby timer, puts the stream to standby if it has been
+ * paused for the whole delay. Returns time of the next check, 0 if none.
+ */
+nsecs_t AudioStreamInALSA::checkStandbyDelay(nsecs_t now)
+{
+	TRACE();
+	nsecs_t next = 0;
+
+	mLock.lockPriority();
+
+	if (mPaused) {
+		if (now >= mStandbyTime) {
+			AutoMutex hwLock(mHardware->lock());
+			doStandby_l();
+		} else {
+			next = mStandbyTime;
+		}
+	}
+
+	mLock.unlock();
+
+	return next;
 }
 
 void AudioStreamInALSA::close_l()
@@ -374,43 +512,110 @@ void AudioStreamInALSA::close_l()
 	}
 }
 
-status_t AudioStreamInALSA::open_l()
+struct pcm *AudioStreamInALSA::openPcm_l(uint32_t rate,
+						uint32_t channelCount)
 {
 	TRACE();
+	struct pcm *pcm;
 	unsigned int flags;
-	flags = PCM_IN
-		| ((AUDIO_HW_IN_PERIOD_MULT - 1) << PCM_PERIOD_SZ_SHIFT)
+	unsigned int mult;
+
+	// keep the period length of the default rate
+	mult = (AUDIO_HW_IN_PERIOD_MULT * rate + AUDIO_HW_IN_SAMPLERATE / 2)
+						/ AUDIO_HW_IN_SAMPLERATE;
+	if (!mult)
+		mult = 1;
+
+	flags = PCM_IN | pcm_rate_flags(rate)
+		| ((channelCount == 1) ? PCM_MONO : PCM_STEREO)
+		| ((mult - 1) << PCM_PERIOD_SZ_SHIFT)
 		| ((AUDIO_HW_IN_PERIOD_CNT - PCM_PERIOD_CNT_MIN)
 						<< PCM_PERIOD_CNT_SHIFT);
 
-	LOGV("open pcm_in driver");
+#if AUDIO_HW_IN_MMAP
+	flags |= PCM_MMAP;
+#endif
+
+	LOGV("open pcm_in driver at %u Hz, %u channels", rate, channelCount);
 
 	TRACE_DRIVER_IN(DRV_PCM_OPEN)
-	mPcm = pcm_open(flags);
+	pcm = pcm_open(flags);
 	TRACE_DRIVER_OUT
 
-	if (!mPcm) {
+	if (pcm && !pcm_ready(pcm) && (flags & PCM_MMAP)) {
+		LOGW("pcm_in mmap failed (%s), using read/write",
+							pcm_error(pcm));
+		TRACE_DRIVER_IN(DRV_PCM_CLOSE)
+		pcm_close(pcm);
+		TRACE_DRIVER_OUT
+
+		flags &= ~PCM_MMAP;
+
+		TRACE_DRIVER_IN(DRV_PCM_OPEN)
+		pcm = pcm_open(flags);
+		TRACE_DRIVER_OUT
+	}
+
+	if (!pcm) {
 		LOGE("cannot open pcm_in driver: %s\n", strerror(errno));
-		return NO_INIT;
+		return 0;
 	}
 
-	if (!pcm_ready(mPcm)) {
-		LOGE("PCM in not ready: %s\n", pcm_error(mPcm));
+	if (!pcm_ready(pcm)) {
+		LOGE("PCM in not ready: %s\n", pcm_error(pcm));
 		TRACE_DRIVER_IN(DRV_PCM_CLOSE)
-		pcm_close(mPcm);
+		pcm_close(pcm);
 		TRACE_DRIVER_OUT
-		mPcm = 0;
-		return NO_INIT;
+		return 0;
 	}
 
-	if (mDownSampler) {
-		mInPcmInBuf = 0;
-		mDownSampler->reset();
-	}
+	mPcmMmap = (flags & PCM_MMAP) != 0;
 
+	return pcm;
+}
+
+status_t AudioStreamInALSA::open_l()
+{
+	TRACE();
 	uint32_t route = getInputRouteFromDevice(mDevices);
+	uint32_t channels = AUDIO_HW_IN_CHANNEL_COUNT;
+	uint32_t rate = mNativeRate ? mSampleRate : AUDIO_HW_IN_SAMPLERATE;
+
+#if AUDIO_HW_IN_MONO
+	// a single microphone has nothing to downmix
+	if (mChannelCount == 1 && route && !(route & (route - 1)))
+		channels = 1;
+#endif
+
+	for (;;) {
+		mPcm = openPcm_l(rate, channels);
+
+		if (mPcm)
+			break;
+
+		if (channels != AUDIO_HW_IN_CHANNEL_COUNT) {
+			LOGW("pcm_in cannot capture mono, downmixing");
+			channels = AUDIO_HW_IN_CHANNEL_COUNT;
+		} else if (rate != AUDIO_HW_IN_SAMPLERATE) {
+			// codec may be locked to the rate of running playback
+			LOGW("pcm_in cannot run at %u Hz, resampling",
+								rate);
+			rate = AUDIO_HW_IN_SAMPLERATE;
+		} else {
+			return NO_INIT;
+		}
+	}
+
+	if (setPcmConfig_l(rate, channels) != NO_ERROR) {
+		close_l();
+		return NO_INIT;
+	}
+
+	nsecs_t start = systemTime();
+
 	LOGV("read() wakeup setting route %d", route);
-	mHardware->setAudioRoute(AudioRouter::ROUTE_INPUT, route);
+	if (mHardware->setAudioRoute(AudioRouter::ROUTE_INPUT, route))
+		mStats.routeSwitch(start);
 
 	return NO_ERROR;
 }
@@ -435,7 +640,8 @@ status_t AudioStreamInALSA::dump(int fd, const Vector<String16> &args)
 	result.append(buffer);
 	snprintf(buffer, SIZE, "\t\tmPcm: %p\n", mPcm);
 	result.append(buffer);
-	snprintf(buffer, SIZE, "\t\tStandby %s\n", (mStandby) ? "ON" : "OFF");
+	snprintf(buffer, SIZE, "\t\tStandby %s\n", (mStandby) ? "ON"
+					: (mPaused) ? "PENDING" : "OFF");
 	result.append(buffer);
 	snprintf(buffer, SIZE, "\t\tmDevices: 0x%08x\n", mDevices);
 	result.append(buffer);
@@ -443,8 +649,17 @@ status_t AudioStreamInALSA::dump(int fd, const Vector<String16> &args)
 	result.append(buffer);
 	snprintf(buffer, SIZE, "\t\tmSampleRate: %d\n", mSampleRate);
 	result.append(buffer);
+	snprintf(buffer, SIZE, "\t\tmPcmSampleRate: %d\n", mPcmSampleRate);
+	result.append(buffer);
+	snprintf(buffer, SIZE, "\t\tResampler: %s\n", mResampler
+		 ? Resampler::qualityName(mResampler->quality()) : "none");
+	result.append(buffer);
+	snprintf(buffer, SIZE, "\t\tmInputChannelCount: %d\n",
+							mInputChannelCount);
+	result.append(buffer);
 	snprintf(buffer, SIZE, "\t\tmBufferSize: %d\n", mBufferSize);
 	result.append(buffer);
+	mStats.dump(result, mSampleRate);
 #ifdef DRIVER_TRACE
 	snprintf(buffer, SIZE, "\t\tmDriverOp: %d\n", mDriverOp);
 	result.append(buffer);
@@ -473,9 +688,7 @@ status_t AudioStreamInALSA::setParameters(const String8 &keyValuePairs)
 	if (!mHardware)
 		return NO_INIT;
 
-	mSleepReq = true;
-	mLock.lock();
-	mSleepReq = false;
+	mLock.lockPriority();
 
 	ret = param.getInt(String8(AudioParameter::keyRouting), value);
 
@@ -492,6 +705,31 @@ status_t AudioStreamInALSA::setParameters(const String8 &keyValuePairs)
 		param.remove(String8(AudioParameter::keyRouting));
 	}
 
+	String8 key = String8(AUDIO_PARAMETER_RESAMPLER_QUALITY);
+	String8 name;
+
+	if (param.get(key, name) == NO_ERROR) {
+		Resampler::Quality quality;
+
+		if (!Resampler::qualityFromName(name.string(), &quality)) {
+			status = BAD_VALUE;
+		} else if (quality != mResamplerQuality) {
+			LOGD("AudioStreamInALSA::setParameters() resampler "
+						"quality %s", name.string());
+			mResamplerQuality = quality;
+
+			// rebuilt with the new filter, if resampling at all
+			delete mResampler;
+			mResampler = 0;
+
+			if (setPcmConfig_l(mPcmSampleRate,
+						mInputChannelCount) != NO_ERROR)
+				status = NO_INIT;
+		}
+
+		param.remove(key);
+	}
+
 	mLock.unlock();
 
 	if (param.size())
@@ -510,6 +748,12 @@ String8 AudioStreamInALSA::getParameters(const String8 &keys)
 	if (param.get(key, value) == NO_ERROR)
 		param.addInt(key, (int)mDevices);
 
+	key = String8(AUDIO_PARAMETER_RESAMPLER_QUALITY);
+
+	if (param.get(key, value) == NO_ERROR)
+		param.add(key, String8(Resampler::qualityName(
+				(Resampler::Quality)mResamplerQuality)));
+
 	LOGV("AudioStreamInALSA::getParameters() %s",
 						param.toString().string());
 
@@ -531,11 +775,15 @@ status_t AudioStreamInALSA::getNextBuffer(BufferProvider::Buffer *buffer)
 		return BAD_VALUE;
 	}
 
+	nsecs_t start = systemTime();
+
 	TRACE_DRIVER_IN(DRV_PCM_READ)
 	mReadStatus = pcm_read(mPcm, buffer->raw,
 			buffer->frameCount*mInputChannelCount*sizeof(int16_t));
 	TRACE_DRIVER_OUT
 
+	mBlockedNs += systemTime() - start;
+
 	if (mReadStatus) {
 		buffer->frameCount = 0;
 		return mReadStatus;
@@ -544,45 +792,83 @@ status_t AudioStreamInALSA::getNextBuffer(BufferProvider::Buffer *buffer)
 	return 0;
 }
 
-size_t AudioStreamInALSA::getBufferSize(uint32_t sampleRate, int channelCount)
+/*
+ * Hands out the frames in the DMA ring, so the first conversion stage
+ * reads them directly instead of from a copy.
+ */
+status_t AudioStreamInALSA::acquireBuffer(BufferProvider::Buffer *buffer)
 {
-	TRACE();
-	size_t ratio;
+	TRACE_VERBOSE();
+	void *area;
+	unsigned frames = buffer->frameCount;
+	int ret;
+
+	if (!mPcm) {
+		buffer->frameCount = 0;
+		mReadStatus = NO_INIT;
+		return NO_INIT;
+	}
 
-	switch (sampleRate) {
-	case 8000:
-	case 11025:
-		ratio = 4;
-		break;
+	if (!mPcmMmap)
+		return INVALID_OPERATION;
 
-	case 16000:
-	case 22050:
-		ratio = 2;
-		break;
+	nsecs_t start = systemTime();
 
-	case 44100:
-	default:
-		ratio = 1;
-		break;
+	TRACE_DRIVER_IN(DRV_PCM_READ)
+	ret = pcm_mmap_acquire(mPcm, &area, &mAcquiredOffset, &frames);
+	TRACE_DRIVER_OUT
+
+	mBlockedNs += systemTime() - start;
+
+	if (ret) {
+		buffer->frameCount = 0;
+		mReadStatus = ret;
+		return ret;
 	}
 
-	return (AUDIO_HW_IN_PERIOD_SZ*channelCount*sizeof(int16_t)) / ratio ;
+	buffer->i16 = (int16_t *)area + mAcquiredOffset*mInputChannelCount;
+	buffer->frameCount = frames;
+
+	return 0;
+}
+
+void AudioStreamInALSA::releaseBuffer(BufferProvider::Buffer *buffer)
+{
+	TRACE_VERBOSE();
+
+	TRACE_DRIVER_IN(DRV_PCM_READ)
+	mReadStatus = pcm_mmap_commit(mPcm, mAcquiredOffset,
+							buffer->frameCount);
+	TRACE_DRIVER_OUT
+}
+
+size_t AudioStreamInALSA::getBufferSize(uint32_t sampleRate, int channelCount)
+{
+	TRACE();
+	size_t frames;
+
+	/*
+	 * One period of the codec, converted to the requested rate and
+	 * rounded down to a multiple of 16 frames.
+	 */
+	frames = (AUDIO_HW_IN_PERIOD_SZ*sampleRate) / AUDIO_HW_IN_SAMPLERATE;
+	frames &= ~15;
+
+	return frames*channelCount*sizeof(int16_t);
 }
 
 int AudioStreamInALSA::prepareLock()
 {
 	TRACE();
-	// request sleep next time read() is called so that caller can acquire
-	// mLock
-	mSleepReq = true;
+	// make read() wait for the caller to acquire mLock
+	mLock.request();
 	return mStandbyCnt;
 }
 
 void AudioStreamInALSA::lock()
 {
 	TRACE();
-	mLock.lock();
-	mSleepReq = false;
+	mLock.lockRequested();
 }
 
 void AudioStreamInALSA::unlock()
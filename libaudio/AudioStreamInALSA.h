@@ -20,6 +20,8 @@
 
 #include "config.h"
 #include <hardware_legacy/AudioHardwareBase.h>
+#include "StreamLock.h"
+#include "StreamStats.h"
 #include "BufferProvider.h"
 #include "AudioHardwareASoC.h"
 
@@ -30,39 +32,58 @@ extern "C" {
 namespace android {
 
 class BufferProvider;
-class DownSampler;
+class Resampler;
 class ChannelMixer;
 
 class AudioStreamInALSA : public AudioStreamIn,
 					public BufferProvider, public RefBase
 {
-	Mutex mLock;
+	StreamLock mLock;
 
 	AudioHardware *mHardware;
 	struct pcm *mPcm;
+	// pcm opened with PCM_MMAP, its DMA ring can be acquired
+	bool mPcmMmap;
+	unsigned mAcquiredOffset;
 
 	bool mStandby;
+	// pcm stopped, but kept open until mStandbyTime
+	bool mPaused;
+	nsecs_t mStandbyTime;
 	uint32_t mDevices;
+	// channels the pcm runs with, mono for single microphone routes
 	uint32_t mInputChannels;
 	uint32_t mChannels;
 	uint32_t mInputChannelCount;
 	uint32_t mChannelCount;
 	uint32_t mSampleRate;
+	// rate the pcm runs at, mSampleRate unless resampling
+	uint32_t mPcmSampleRate;
+	// codec supports mSampleRate
+	bool mNativeRate;
 	size_t mBufferSize;
 	BufferProvider *mInputProvider;
-	DownSampler *mDownSampler;
+	Resampler *mResampler;
+	int mResamplerQuality;
 	ChannelMixer *mChannelMixer;
 	status_t mReadStatus;
 	size_t mInPcmInBuf;
 	int16_t *mPcmIn;
 	int mStandbyCnt;
-	bool mSleepReq;
+
+	StreamStats mStats;
+	// time spent in pcm_read() during current read()
+	nsecs_t mBlockedNs;
 
 	// trace driver operations for dump
 	int mDriverOp;
 
 	uint32_t getInputSampleRate(uint32_t sampleRate);
 	uint32_t getInputRouteFromDevice(uint32_t device);
+	void pause_l();
+	void resume_l();
+	struct pcm *openPcm_l(uint32_t rate, uint32_t channelCount);
+	status_t setPcmConfig_l(uint32_t rate, uint32_t channelCount);
 
 	inline uint32_t frameSize(void)
 	{
@@ -111,8 +132,12 @@ public:
 
 	// BufferProvider
 	virtual status_t getNextBuffer(BufferProvider::Buffer *buffer);
+	virtual status_t acquireBuffer(BufferProvider::Buffer *buffer);
+	virtual void releaseBuffer(BufferProvider::Buffer *buffer);
 
 	bool checkStandby();
+	status_t forceStandby();
+	nsecs_t checkStandbyDelay(nsecs_t now);
 	status_t set(AudioHardware *hw, uint32_t devices, int *pFormat,
 				uint32_t *pChannels, uint32_t *pRate,
 				AudioSystem::audio_in_acoustics acoustics);
@@ -130,6 +155,11 @@ public:
 		return mStandbyCnt;
 	}
 
+	void getStats(struct audio_stream_stats *stats)
+	{
+		mStats.get(stats, mSampleRate);
+	}
+
 	uint32_t device()
 	{
 		return mDevices;
@@ -18,8 +18,9 @@
 #define LOG_NDEBUG 0
 #define LOG_TAG "AudioStreamOutALSA"
 
+#include <time.h>
+
 #include <cutils/log.h>
-#include <hardware_legacy/power.h>
 #include "AudioStreamOutALSA.h"
 #include "AudioHardwareASoC.h"
 #include "AudioStreamInALSA.h"
@@ -32,6 +33,31 @@ extern "C" {
 
 namespace android {
 
+static const struct {
+	const char *name;
+	uint32_t periodMult;
+	uint32_t periodCnt;
+} outputProfiles[AudioStreamOutALSA::PROFILE_COUNT] = {
+	/* PROFILE_LOW_LATENCY */
+	{
+		"low_latency",
+		AUDIO_HW_OUT_LL_PERIOD_MULT,
+		AUDIO_HW_OUT_LL_PERIOD_CNT
+	},
+	/* PROFILE_NORMAL */
+	{
+		"normal",
+		AUDIO_HW_OUT_PERIOD_MULT,
+		AUDIO_HW_OUT_PERIOD_CNT
+	},
+	/* PROFILE_DEEP_BUFFER */
+	{
+		"deep_buffer",
+		AUDIO_HW_OUT_DEEP_PERIOD_MULT,
+		AUDIO_HW_OUT_DEEP_PERIOD_CNT
+	},
+};
+
 /*
  * AudioStreamOutALSA
  */
@@ -40,6 +66,10 @@ AudioStreamOutALSA::AudioStreamOutALSA() :
 	mHardware(0),
 	mPcm(0),
 	mStandby(true),
+	mPaused(false),
+	mStandbyTime(0),
+	mDraining(false),
+	mDrainTime(0),
 	mDevices(0),
 	mChannels(AUDIO_HW_OUT_CHANNELS),
 	mSampleRate(AUDIO_HW_OUT_SAMPLERATE),
@@ -48,9 +78,16 @@ AudioStreamOutALSA::AudioStreamOutALSA() :
 	mDriverOp(DRV_NONE),
 #endif
 	mStandbyCnt(0),
-	mSleepReq(false)
+	mLatency(AUDIO_HW_OUT_LATENCY(AUDIO_HW_OUT_PERIOD_SZ,
+				AUDIO_HW_OUT_PERIOD_CNT, AUDIO_HW_OUT_SAMPLERATE)),
+	mProfile(PROFILE_NORMAL),
+	mFramesWritten(0),
+	mFramesPresented(0),
+	mPresenting(false),
+	mStats(false)
 {
 	TRACE();
+	memset(&mPresentedTime, 0, sizeof(mPresentedTime));
 }
 
 status_t AudioStreamOutALSA::set(AudioHardware *hw,
@@ -91,7 +128,8 @@ status_t AudioStreamOutALSA::set(AudioHardware *hw,
 
 	mChannels = lChannels;
 	mSampleRate = lRate;
-	mBufferSize = AUDIO_HW_OUT_PERIOD_BYTES;
+	mBufferSize = PCM_PERIOD_SZ_MIN
+			* outputProfiles[mProfile].periodMult * frameSize();
 
 	return NO_ERROR;
 }
@@ -99,7 +137,7 @@ status_t AudioStreamOutALSA::set(AudioHardware *hw,
 AudioStreamOutALSA::~AudioStreamOutALSA()
 {
 	TRACE();
-	standby();
+	forceStandby();
 }
 
 uint32_t AudioStreamOutALSA::getOutputRouteFromDevice(uint32_t device)
@@ -145,10 +183,15 @@ int AudioStreamOutALSA::wakeUp_l(void)
 		return 0;
 
 	AutoMutex hwLock(mHardware->lock());
+	nsecs_t start = systemTime();
 
 	LOGD("AudioHardware pcm playback is exiting standby.");
-	acquire_wake_lock (PARTIAL_WAKE_LOCK, "AudioOutLock");
+	mHardware->acquireWakeLock_l();
 
+#if AUDIO_HW_FULL_DUPLEX
+	// capture runs on its own pcm, leave it alone
+	open_l();
+#else
 	sp<AudioStreamInALSA> spIn = mHardware->getInput();
 
 	while (spIn != 0) {
@@ -184,12 +227,14 @@ int AudioStreamOutALSA::wakeUp_l(void)
 
 		spIn->unlock();
 	}
+#endif
 
 	if (!mPcm) {
-		release_wake_lock("AudioOutLock");
+		mHardware->releaseWakeLock_l();
 		return -1;
 	}
 
+	mStats.standbyExit(start);
 	mStandby = false;
 
 	return 0;
@@ -202,28 +247,34 @@ ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
 
 	status_t status = NO_INIT;
 	const uint8_t *p = static_cast<const uint8_t *>(buffer);
+	nsecs_t start = systemTime();
+	nsecs_t blocked;
 	int ret;
 
 	if (!mHardware)
 		return NO_INIT;
 
-	if (mSleepReq) {
-		// 10ms are always shorter than the time to reconfigure
-		// the audio path which is the only condition when mSleepReq
-		// would be true.
-		usleep(10000);
-	}
-
+	// yields to standby or routing requests from other threads
 	mLock.lock();
 
 	if (wakeUp_l())
 		goto error;
 
+	// the pcm restarts on its own, or just goes on if still draining
+	mPaused = false;
+	mDraining = false;
+
+	blocked = systemTime();
 	TRACE_DRIVER_IN(DRV_PCM_WRITE)
 	ret = pcm_write(mPcm,(void *) p, bytes);
 	TRACE_DRIVER_OUT
+	blocked = systemTime() - blocked;
+	TRACE_ARGS(bytes, blocked / 1000);
 
 	if (ret == 0) {
+		updatePosition_l(bytes / frameSize());
+		mStats.transfer(start, blocked, bytes / frameSize(),
+							pcm_get_xruns(mPcm));
 		mLock.unlock();
 		return bytes;
 	}
@@ -231,10 +282,11 @@ ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
 	LOGE("write error: %d", errno);
 
 	status = -errno;
+	mStats.error();
 
 error:
 	mLock.unlock();
-	standby();
+	forceStandby();
 
 	// Simulate audio output timing in case of error
 	usleep((((bytes * 1000) / frameSize()) * 1000) / sampleRate());
@@ -242,16 +294,49 @@ error:
 	return status;
 }
 
+/*
+ * Stops the pcm, keeping it open and routed for the standby delay, so
+ * streams restarting soon, like notification sounds, do not pay for
+ * the reopen.
+ */
 status_t AudioStreamOutALSA::standby()
 {
 	TRACE();
+	uint32_t delay;
 
 	if (!mHardware)
 		return NO_INIT;
 
-	mSleepReq = true;
-	mLock.lock();
-	mSleepReq = false;
+	delay = mHardware->standbyDelay();
+
+	if (!delay)
+		return forceStandby();
+
+	mLock.lockPriority();
+
+	if (!mStandby && !mPaused) {
+		pause_l();
+		mStandbyTime = systemTime() + milliseconds(delay);
+
+		if (mDraining && mStandbyTime < mDrainTime)
+			mStandbyTime = mDrainTime;
+
+		mHardware->scheduleStandby(mStandbyTime);
+	}
+
+	mLock.unlock();
+
+	return NO_ERROR;
+}
+
+status_t AudioStreamOutALSA::forceStandby()
+{
+	TRACE();
+
+	if (!mHardware)
+		return NO_INIT;
+
+	mLock.lockPriority();
 	mHardware->lock().lock();
 	doStandby_l();
 	mHardware->lock().unlock();
@@ -263,22 +348,124 @@ status_t AudioStreamOutALSA::standby()
 void AudioStreamOutALSA::doStandby_l()
 {
 	TRACE();
+	nsecs_t start = systemTime();
+	bool active = !mStandby;
+
 	++mStandbyCnt;
+	mPaused = false;
+	mDraining = false;
 
 	if (!mStandby) {
 		LOGD("AudioHardware pcm playback is going to standby.");
-		release_wake_lock("AudioOutLock");
+		mHardware->releaseWakeLock_l();
 		mStandby = true;
 	}
 
 	close_l();
+
+	if (active)
+		mStats.standbyEnter(start);
+}
+
+/*
+ * Stopping the pcm drops what is queued, so a running pcm is left to play
+ * it out and the standby timer stops it afterwards. Nothing sleeps here,
+ * this runs with the stream lock held. A pcm which never started has
+ * nothing playing, it is stopped at once.
+ */
+void AudioStreamOutALSA::pause_l()
+{
+	TRACE();
+	unsigned avail = 0;
+	int running = 0;
+
+	LOGD("AudioHardware pcm playback is pausing.");
+
+	if (mPcm) {
+		TRACE_DRIVER_IN(DRV_PCM_STATUS)
+		running = pcm_get_htimestamp(mPcm, &avail, NULL);
+		TRACE_DRIVER_OUT
+	}
+
+	mPaused = true;
+
+	if (running <= 0) {
+		stopPcm_l();
+		return;
+	}
+
+	uint32_t queued = pcm_buffer_size(mPcm) - avail;
+
+	mDraining = true;
+	mDrainTime = systemTime()
+			+ (1000000000LL * queued) / mSampleRate;
+	mHardware->scheduleStandby(mDrainTime);
+}
+
+/*
+ * Queued frames left are dropped, they count as presented so the render
+ * position does not stall.
+ */
+void AudioStreamOutALSA::stopPcm_l()
+{
+	TRACE();
+
+	mDraining = false;
+
+	if (mPcm) {
+		TRACE_DRIVER_IN(DRV_PCM_STOP)
+		pcm_stop(mPcm);
+		TRACE_DRIVER_OUT
+	}
+
+	mPositionLock.lock();
+	mFramesPresented = mFramesWritten;
+	mPresenting = false;
+	mPositionLock.unlock();
+}
+
+/*
+ * Called by the standby timer, stops a paused pcm once its queue played
+ * out and puts the stream to standby if it has been paused for the whole
+ * delay. Returns time of the next check, 0 if none.
+ */
+nsecs_t AudioStreamOutALSA::checkStandbyDelay(nsecs_t now)
+{
+	TRACE();
+	nsecs_t next = 0;
+
+	mLock.lockPriority();
+
+	if (mPaused && mDraining && now >= mDrainTime)
+		stopPcm_l();
+
+	if (mPaused) {
+		if (now >= mStandbyTime) {
+			AutoMutex hwLock(mHardware->lock());
+			doStandby_l();
+		} else {
+			next = mDraining ? mDrainTime : mStandbyTime;
+		}
+	}
+
+	mLock.unlock();
+
+	return next;
 }
 
 void AudioStreamOutALSA::close_l()
 {
 	TRACE();
 
-	mHardware->setAudioRoute(AudioRouter::ROUTE_OUTPUT, 0);
+	// torn down later, unless the output is reopened before
+	if (mPcm)
+		mHardware->releaseAudioRoute_l(AudioRouter::ROUTE_OUTPUT);
+
+	/* Whatever was still queued is dropped, count it as presented */
+	mPositionLock.lock();
+	mFramesPresented = mFramesWritten;
+	mPresenting = false;
+	mPositionLock.unlock();
 
 	if (mPcm) {
 		TRACE_DRIVER_IN(DRV_PCM_CLOSE)
@@ -293,9 +480,14 @@ status_t AudioStreamOutALSA::open_l()
 	TRACE();
 	unsigned int flags;
 	flags = PCM_OUT
-		| (AUDIO_HW_OUT_PERIOD_MULT - 1) << PCM_PERIOD_SZ_SHIFT
-		|(AUDIO_HW_OUT_PERIOD_CNT - PCM_PERIOD_CNT_MIN)
-		<< PCM_PERIOD_CNT_SHIFT;
+		| ((outputProfiles[mProfile].periodMult - 1)
+						<< PCM_PERIOD_SZ_SHIFT)
+		| ((outputProfiles[mProfile].periodCnt - PCM_PERIOD_CNT_MIN)
+						<< PCM_PERIOD_CNT_SHIFT);
+
+#if AUDIO_HW_OUT_MMAP
+	flags |= PCM_MMAP;
+#endif
 
 	LOGV("open pcm_out driver");
 
@@ -303,6 +495,20 @@ status_t AudioStreamOutALSA::open_l()
 	mPcm = pcm_open(flags);
 	TRACE_DRIVER_OUT
 
+	if (mPcm && !pcm_ready(mPcm) && (flags & PCM_MMAP)) {
+		LOGW("pcm_out mmap failed (%s), using read/write",
+							pcm_error(mPcm));
+		TRACE_DRIVER_IN(DRV_PCM_CLOSE)
+		pcm_close(mPcm);
+		TRACE_DRIVER_OUT
+
+		flags &= ~PCM_MMAP;
+
+		TRACE_DRIVER_IN(DRV_PCM_OPEN)
+		mPcm = pcm_open(flags);
+		TRACE_DRIVER_OUT
+	}
+
 	if (!mPcm) {
 		LOGE("cannot open pcm_in driver: %s\n", strerror(errno));
 		return NO_INIT;
@@ -317,10 +523,21 @@ status_t AudioStreamOutALSA::open_l()
 		return NO_INIT;
 	}
 
+	/* The driver might have adjusted the requested period geometry */
+	mLatency = AUDIO_HW_OUT_LATENCY(pcm_period_size(mPcm),
+				pcm_period_count(mPcm), mSampleRate);
+	LOGV("open_l() %u x %u frames, latency %u ms",
+			pcm_period_count(mPcm), pcm_period_size(mPcm), mLatency);
+
+	resetPosition_l();
+
 	if (mHardware->mode() != AudioSystem::MODE_IN_CALL) {
 		uint32_t route = getOutputRouteFromDevice(mDevices);
+		nsecs_t start = systemTime();
+
 		LOGV("write() wakeup setting route %d", route);
-		mHardware->setAudioRoute(AudioRouter::ROUTE_OUTPUT, route);
+		if (mHardware->setAudioRoute(AudioRouter::ROUTE_OUTPUT, route))
+			mStats.routeSwitch(start);
 	}
 
 	return NO_ERROR;
@@ -346,7 +563,8 @@ status_t AudioStreamOutALSA::dump(int fd, const Vector<String16> &args)
 	result.append(buffer);
 	snprintf(buffer, SIZE, "\t\tmPcm: %p\n", mPcm);
 	result.append(buffer);
-	snprintf(buffer, SIZE, "\t\tStandby %s\n", (mStandby) ? "ON" : "OFF");
+	snprintf(buffer, SIZE, "\t\tStandby %s\n", (mStandby) ? "ON"
+					: (mPaused) ? "PENDING" : "OFF");
 	result.append(buffer);
 	snprintf(buffer, SIZE, "\t\tmDevices: 0x%08x\n", mDevices);
 	result.append(buffer);
@@ -356,6 +574,18 @@ status_t AudioStreamOutALSA::dump(int fd, const Vector<String16> &args)
 	result.append(buffer);
 	snprintf(buffer, SIZE, "\t\tmBufferSize: %d\n", mBufferSize);
 	result.append(buffer);
+	snprintf(buffer, SIZE, "\t\tmLatency: %u ms\n", mLatency);
+	result.append(buffer);
+	snprintf(buffer, SIZE, "\t\tProfile: %s\n",
+					outputProfiles[mProfile].name);
+	result.append(buffer);
+	mPositionLock.lock();
+	snprintf(buffer, SIZE, "\t\tFrames written: %llu presented: %llu\n",
+		 (unsigned long long)mFramesWritten,
+		 (unsigned long long)mFramesPresented);
+	mPositionLock.unlock();
+	result.append(buffer);
+	mStats.dump(result, mSampleRate);
 #ifdef DRIVER_TRACE
 	snprintf(buffer, SIZE, "\t\tmDriverOp: %d\n", mDriverOp);
 	result.append(buffer);
@@ -385,9 +615,7 @@ status_t AudioStreamOutALSA::setParameters(const String8 &keyValuePairs)
 	if (!mHardware)
 		return NO_INIT;
 
-	mSleepReq = true;
-	mLock.lock();
-	mSleepReq = false;
+	mLock.lockPriority();
 
 	ret = param.getInt(String8(AudioParameter::keyRouting), device);
 
@@ -408,6 +636,31 @@ status_t AudioStreamOutALSA::setParameters(const String8 &keyValuePairs)
 		param.remove(String8(AudioParameter::keyRouting));
 	}
 
+	String8 key = String8(AUDIO_PARAMETER_OUTPUT_PROFILE);
+	String8 value;
+	int profile = -1;
+	int frames;
+
+	if (param.get(key, value) == NO_ERROR) {
+		profile = getProfileByName(value.string());
+
+		if (profile >= 0)
+			param.remove(key);
+	}
+
+	/* AudioFlinger rereads buffer size only when frame count changes */
+	key = String8(AudioParameter::keyFrameCount);
+
+	if (param.getInt(key, frames) == NO_ERROR) {
+		profile = getProfileByFrameCount(frames);
+		param.remove(key);
+	}
+
+	if (profile >= 0) {
+		AutoMutex hwLock(mHardware->lock());
+		setProfile_l(profile);
+	}
+
 	mLock.unlock();
 
 	if (param.size())
@@ -427,34 +680,258 @@ String8 AudioStreamOutALSA::getParameters(const String8 &keys)
 	if (param.get(key, value) == NO_ERROR)
 		param.addInt(key, (int)mDevices);
 
+	key = String8(AUDIO_PARAMETER_OUTPUT_PROFILE);
+
+	if (param.get(key, value) == NO_ERROR)
+		param.add(key, String8(outputProfiles[mProfile].name));
+
 	LOGV("AudioStreamOutALSA::getParameters() %s",
 		param.toString().string());
 
 	return param.toString();
 }
 
+int AudioStreamOutALSA::getProfileByName(const char *name)
+{
+	TRACE();
+
+	for (int i = 0; i < PROFILE_COUNT; ++i)
+		if (!strcmp(name, outputProfiles[i].name))
+			return i;
+
+	LOGW("unknown output profile %s", name);
+	return -1;
+}
+
+const char *AudioStreamOutALSA::getProfileName(int profile)
+{
+	return outputProfiles[profile].name;
+}
+
+uint32_t AudioStreamOutALSA::getProfilePeriodSize(int profile)
+{
+	return PCM_PERIOD_SZ_MIN * outputProfiles[profile].periodMult;
+}
+
+uint32_t AudioStreamOutALSA::getProfilePeriodCount(int profile)
+{
+	return outputProfiles[profile].periodCnt;
+}
+
+/*
+ * Picks the profile with the longest period not exceeding frameCount,
+ * the one with the shortest period if there is no such.
+ */
+int AudioStreamOutALSA::getProfileByFrameCount(int frameCount)
+{
+	TRACE();
+	int profile = PROFILE_LOW_LATENCY;
+	uint32_t best = 0;
+
+	for (int i = 0; i < PROFILE_COUNT; ++i) {
+		uint32_t frames = PCM_PERIOD_SZ_MIN * outputProfiles[i].periodMult;
+
+		if (frames <= (uint32_t)frameCount && frames > best) {
+			best = frames;
+			profile = i;
+		}
+	}
+
+	return profile;
+}
+
+/*
+ * Switches kernel pcm buffer geometry. The pcm gets reopened on next
+ * write, only if the profile actually changes.
+ */
+void AudioStreamOutALSA::setProfile_l(int profile)
+{
+	TRACE();
+
+	if (profile == mProfile)
+		return;
+
+	LOGD("output profile %s -> %s", outputProfiles[mProfile].name,
+						outputProfiles[profile].name);
+
+	if (!mStandby)
+		doStandby_l();
+
+	mProfile = profile;
+	mBufferSize = PCM_PERIOD_SZ_MIN
+			* outputProfiles[mProfile].periodMult * frameSize();
+	mLatency = AUDIO_HW_OUT_LATENCY(
+			PCM_PERIOD_SZ_MIN * outputProfiles[mProfile].periodMult,
+			outputProfiles[mProfile].periodCnt, mSampleRate);
+}
+
+/*
+ * Switches the profile without going through setParameters(), the pcm
+ * is closed at once, queued frames are dropped.
+ */
+status_t AudioStreamOutALSA::setProfile(int profile)
+{
+	TRACE();
+
+	if (!mHardware)
+		return NO_INIT;
+
+	mLock.lock();
+	mHardware->lock().lock();
+	setProfile_l(profile);
+	mHardware->lock().unlock();
+	mLock.unlock();
+
+	return NO_ERROR;
+}
+
+/*
+ * Starts a pcm still waiting for its start threshold, so what is queued
+ * plays out even if nothing else gets written.
+ */
+status_t AudioStreamOutALSA::startQueued()
+{
+	TRACE();
+	status_t status = NO_ERROR;
+
+	mLock.lock();
+
+	if (mPcm) {
+		TRACE_DRIVER_IN(DRV_PCM_START)
+		if (pcm_start_queued(mPcm))
+			status = UNKNOWN_ERROR;
+		TRACE_DRIVER_OUT
+
+		if (status == NO_ERROR)
+			updatePosition_l(0);
+	}
+
+	mLock.unlock();
+
+	return status;
+}
+
+void AudioStreamOutALSA::resetPosition_l()
+{
+	TRACE();
+	AutoMutex lock(mPositionLock);
+
+	mFramesWritten = 0;
+	mFramesPresented = 0;
+	mPresenting = false;
+	memset(&mPresentedTime, 0, sizeof(mPresentedTime));
+}
+
+/*
+ * Accounts frames just written to the driver and takes a snapshot of
+ * the hardware pointer. Everything written, but not queued in the DMA
+ * buffer anymore, has been presented at the time of the snapshot.
+ */
+void AudioStreamOutALSA::updatePosition_l(size_t frames)
+{
+	TRACE_VERBOSE();
+	struct timespec tstamp;
+	unsigned avail;
+	int ret;
+
+	TRACE_DRIVER_IN(DRV_PCM_STATUS)
+	ret = pcm_get_htimestamp(mPcm, &avail, &tstamp);
+	TRACE_DRIVER_OUT
+
+	AutoMutex lock(mPositionLock);
+
+	mFramesWritten += frames;
+
+	if (ret < 0) {
+		mPresenting = false;
+		return;
+	}
+
+	uint32_t queued = pcm_buffer_size(mPcm) - avail;
+
+	mFramesPresented = 0;
+
+	if (mFramesWritten > queued)
+		mFramesPresented = mFramesWritten - queued;
+
+	mPresentedTime = tstamp;
+	mPresenting = (ret > 0);
+}
+
+/*
+ * Returns the number of frames presented since exit from standby. Does
+ * not touch the driver, the last snapshot is extrapolated using the
+ * time passed since it was taken, so it can be called while a write
+ * is blocked.
+ */
+uint64_t AudioStreamOutALSA::presentedFrames_l()
+{
+	TRACE_VERBOSE();
+	uint64_t frames = mFramesPresented;
+
+	if (mPresenting) {
+		struct timespec now;
+		int64_t ns;
+
+		/* ALSA timestamps come from gettimeofday() by default */
+		clock_gettime(CLOCK_REALTIME, &now);
+		ns = (now.tv_sec - mPresentedTime.tv_sec) * 1000000000LL
+				+ now.tv_nsec - mPresentedTime.tv_nsec;
+
+		if (ns > 0)
+			frames += (ns * mSampleRate) / 1000000000LL;
+
+		if (frames > mFramesWritten)
+			frames = mFramesWritten;
+	}
+
+	return frames;
+}
+
 status_t AudioStreamOutALSA::getRenderPosition(
 	uint32_t *dspFrames)
 {
-	TRACE();
-	//TODO
-	return INVALID_OPERATION;
+	TRACE_VERBOSE();
+
+	if (!dspFrames)
+		return BAD_VALUE;
+
+	AutoMutex lock(mPositionLock);
+
+	*dspFrames = (uint32_t)presentedFrames_l();
+
+	return NO_ERROR;
+}
+
+/*
+ * Returns the number of frames written, but not presented yet.
+ */
+status_t AudioStreamOutALSA::getPendingFrames(uint32_t *frames)
+{
+	TRACE_VERBOSE();
+
+	if (!frames)
+		return BAD_VALUE;
+
+	AutoMutex lock(mPositionLock);
+
+	*frames = (uint32_t)(mFramesWritten - presentedFrames_l());
+
+	return NO_ERROR;
 }
 
 int AudioStreamOutALSA::prepareLock()
 {
 	TRACE();
-	// request sleep next time write() is called so that caller can acquire
-	// mLock
-	mSleepReq = true;
+	// make write() wait for the caller to acquire mLock
+	mLock.request();
 	return mStandbyCnt;
 }
 
 void AudioStreamOutALSA::lock()
 {
 	TRACE();
-	mLock.lock();
-	mSleepReq = false;
+	mLock.lockRequested();
 }
 
 void AudioStreamOutALSA::unlock()
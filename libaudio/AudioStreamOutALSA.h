@@ -21,11 +21,15 @@
 #include "config.h"
 
 #include <stdint.h>
+#include <time.h>
 #include <sys/types.h>
 #include <utils/threads.h>
 #include <utils/RefBase.h>
 #include <hardware_legacy/AudioHardwareBase.h>
 
+#include "StreamLock.h"
+#include "StreamStats.h"
+
 extern "C" {
 	struct pcm;
 };
@@ -35,25 +39,56 @@ namespace android {
 class AudioHardware;
 
 class AudioStreamOutALSA : public AudioStreamOut, public RefBase {
-	Mutex mLock;
+	StreamLock mLock;
 
 	AudioHardware *mHardware;
 	struct pcm *mPcm;
 
 	bool mStandby;
+	// pcm stopped, but kept open until mStandbyTime
+	bool mPaused;
+	nsecs_t mStandbyTime;
+	// paused pcm still playing out its queue, stopped at mDrainTime
+	bool mDraining;
+	nsecs_t mDrainTime;
 	uint32_t mDevices;
 	uint32_t mChannels;
 	uint32_t mSampleRate;
 	size_t mBufferSize;
 	int mStandbyCnt;
-	bool mSleepReq;
+	uint32_t mLatency;
+	int mProfile;
+
+	// render position accounting, since last exit from standby
+	Mutex mPositionLock;
+	uint64_t mFramesWritten;
+	uint64_t mFramesPresented;
+	struct timespec mPresentedTime;
+	bool mPresenting;
+
+	StreamStats mStats;
 
 	// trace driver operations for dump
 	int mDriverOp;
 
 	uint32_t getOutputRouteFromDevice(uint32_t device);
+	void setProfile_l(int profile);
+	void pause_l();
+	void stopPcm_l();
+	void resetPosition_l();
+	uint64_t presentedFrames_l();
+	void updatePosition_l(size_t frames);
 
 public:
+	// kernel pcm buffer geometry, selected with output_profile parameter
+	enum Profile {
+		PROFILE_LOW_LATENCY,
+		PROFILE_NORMAL,
+		PROFILE_DEEP_BUFFER,
+
+		PROFILE_COUNT
+	};
+
 	AudioStreamOutALSA();
 	virtual ~AudioStreamOutALSA();
 
@@ -82,16 +117,43 @@ public:
 	}
 
 	virtual uint32_t latency() const {
-		return (1000 * AUDIO_HW_OUT_PERIOD_CNT *
-				(bufferSize()/frameSize()))/sampleRate() +
-				AUDIO_HW_OUT_LATENCY_MS;
+		return mLatency;
 	}
 
 	virtual status_t setVolume(float left, float right) {
 		return INVALID_OPERATION;
 	}
 
+	static int getProfileByName(const char *name);
+	static int getProfileByFrameCount(int frameCount);
+	static const char *getProfileName(int profile);
+	static uint32_t getProfilePeriodSize(int profile);
+	static uint32_t getProfilePeriodCount(int profile);
+
+	int profile() {
+		return mProfile;
+	}
+
+	status_t getPendingFrames(uint32_t *frames);
+
+	// called by the OutputMixer thread
+	status_t startQueued();
+	status_t setProfile(int profile);
+
+	void getStats(struct audio_stream_stats *stats)
+	{
+		mStats.get(stats, mSampleRate);
+	}
+
+	/* Route teardown deferred by AudioHardware, done on its behalf */
+	void routeSwitched(nsecs_t start)
+	{
+		mStats.routeSwitch(start);
+	}
+
 	bool checkStandby();
+	status_t forceStandby();
+	nsecs_t checkStandbyDelay(nsecs_t now);
 	status_t set(AudioHardware *mHardware, uint32_t devices,
 			int *pFormat, uint32_t *pChannels, uint32_t *pRate);
 	int wakeUp_l(void);
@@ -0,0 +1,535 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "AudioStreamOutClient"
+
+#include <errno.h>
+#include <time.h>
+
+#include <cutils/log.h>
+#include <cutils/atomic.h>
+#include "AudioStreamOutClient.h"
+#include "AudioStreamOutALSA.h"
+#include "OutputMixer.h"
+#include "RingBuffer.h"
+#include "MixKernels.h"
+#include "utils.h"
+
+namespace android {
+
+/* Give up waiting for the mixer after this time */
+static const nsecs_t kWriteTimeout = 1000000000LL;
+
+static inline int32_t packVolume(int16_t left, int16_t right)
+{
+	return (uint16_t)left | ((uint32_t)(uint16_t)right << 16);
+}
+
+static inline int16_t unpackVolume(int32_t packed, int channel)
+{
+	return (int16_t)(packed >> (16 * channel));
+}
+
+/*
+ * AudioStreamOutClient
+ */
+
+AudioStreamOutClient::AudioStreamOutClient() :
+	mRing(0),
+	mActive(false),
+	mProfile(AudioStreamOutALSA::PROFILE_NORMAL),
+	mLimit(0),
+	mDevices(0),
+	mChannels(AUDIO_HW_OUT_CHANNELS),
+	mChannelCount(AudioSystem::popCount(AUDIO_HW_OUT_CHANNELS)),
+	mSampleRate(AUDIO_HW_OUT_SAMPLERATE),
+	mFramesWritten(0),
+	mFramesMixed(0),
+	mUnderruns(0),
+	mUnderrunBase(0),
+	mStats(false, true),
+	mVolume(packVolume(MATRIX_COEFF_ONE, MATRIX_COEFF_ONE)),
+	mMixVolume(mVolume),
+	mMasterGain(MATRIX_COEFF_ONE),
+	mRamp(AUDIO_HW_OUT_SAMPLERATE)
+{
+	TRACE();
+
+	sem_init(&mSpaceSem, 0, 0);
+}
+
+status_t AudioStreamOutClient::set(const sp<OutputMixer> &mixer,
+			uint32_t devices, int *pFormat, uint32_t *pChannels,
+			uint32_t *pRate)
+{
+	TRACE();
+	int lFormat = format();
+	uint32_t lChannels = channels();
+	uint32_t lRate = sampleRate();
+
+	mDevices = devices;
+
+	if ((pFormat && *pFormat && *pFormat != lFormat)
+	    || (pChannels && *pChannels && *pChannels != lChannels)
+	    || (pRate && *pRate && *pRate != lRate)) {
+		if (pFormat)
+			*pFormat = lFormat;
+
+		if (pChannels)
+			*pChannels = lChannels;
+
+		if (pRate)
+			*pRate = lRate;
+
+		return BAD_VALUE;
+	}
+
+	if (pFormat)
+		*pFormat = lFormat;
+
+	if (pChannels)
+		*pChannels = lChannels;
+
+	if (pRate)
+		*pRate = lRate;
+
+	/* Large enough for any profile, the limit is set separately */
+	size_t frames = 0;
+
+	for (int i = 0; i < AudioStreamOutALSA::PROFILE_COUNT; ++i) {
+		size_t size = AudioStreamOutALSA::getProfilePeriodSize(i)
+			* AudioStreamOutALSA::getProfilePeriodCount(i);
+
+		if (size > frames)
+			frames = size;
+	}
+
+	mRing = new RingBuffer(frames, frameSize());
+
+	if (!mRing || mRing->initCheck() != NO_ERROR) {
+		LOGE("Failed to allocate ring buffer");
+		return NO_MEMORY;
+	}
+
+	mMixer = mixer;
+	mLimit = AudioStreamOutALSA::getProfilePeriodSize(mProfile)
+			* AudioStreamOutALSA::getProfilePeriodCount(mProfile);
+
+	return NO_ERROR;
+}
+
+AudioStreamOutClient::~AudioStreamOutClient()
+{
+	TRACE();
+
+	if (mRing)
+		delete mRing;
+
+	sem_destroy(&mSpaceSem);
+}
+
+size_t AudioStreamOutClient::bufferSize() const
+{
+	return AudioStreamOutALSA::getProfilePeriodSize(mProfile)
+							* frameSize();
+}
+
+uint32_t AudioStreamOutClient::latency() const
+{
+	uint32_t latency = (1000 * mLimit) / mSampleRate;
+
+	if (mMixer != 0)
+		latency += mMixer->output()->latency();
+
+	return latency;
+}
+
+ssize_t AudioStreamOutClient::write(const void *buffer, size_t bytes)
+{
+	TRACE_VERBOSE();
+	const uint8_t *p = static_cast<const uint8_t *>(buffer);
+	size_t frames = bytes / frameSize();
+	nsecs_t start = systemTime();
+	nsecs_t blocked = 0;
+
+	if (mMixer == 0)
+		return NO_INIT;
+
+	if (!mActive) {
+		LOGD("AudioStreamOutClient %p is exiting standby.", this);
+		mUnderrunBase = android_atomic_acquire_load(&mUnderruns);
+		mStats.standbyExit(start);
+		mActive = true;
+		mMixer->wakeUp();
+	}
+
+	while (frames) {
+		size_t queued = mRing->capacity() - mRing->framesFree();
+		size_t limit = mLimit;
+		size_t space = (queued < limit) ? limit - queued : 0;
+
+		if (space) {
+			size_t done;
+
+			if (space > frames)
+				space = frames;
+
+			done = mRing->write(p, space);
+			p += done*frameSize();
+			frames -= done;
+			mFramesWritten += done;
+			continue;
+		}
+
+		nsecs_t wait = systemTime();
+		bool ready = waitSpace();
+
+		blocked += systemTime() - wait;
+
+		if (!ready) {
+			LOGW("write() mixer stalled, %u frames not queued",
+								frames);
+			break;
+		}
+	}
+
+	/* Underruns of the mixer count as xruns of the stream */
+	mStats.transfer(start, blocked, bytes / frameSize() - frames,
+		android_atomic_acquire_load(&mUnderruns) - mUnderrunBase);
+
+	/* Only what got queued counts, the caller keeps the rest */
+	if (frames && frames == bytes / frameSize()) {
+		mStats.error();
+		return TIMED_OUT;
+	}
+
+	return bytes - frames*frameSize();
+}
+
+status_t AudioStreamOutClient::standby()
+{
+	TRACE();
+
+	/* Queued frames still get played, the mixer stops after them */
+	if (mActive) {
+		LOGD("AudioStreamOutClient %p is going to standby.", this);
+		mStats.standbyEnter(systemTime());
+	}
+
+	mActive = false;
+
+	return NO_ERROR;
+}
+
+/*
+ * Waits for the mixer to drain some frames. Returns false on timeout.
+ */
+bool AudioStreamOutClient::waitSpace()
+{
+	struct timespec ts;
+	nsecs_t ns;
+
+	/* sem_timedwait() only takes CLOCK_REALTIME deadlines */
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ns = ts.tv_nsec + kWriteTimeout;
+	ts.tv_sec += ns / 1000000000LL;
+	ts.tv_nsec = ns % 1000000000LL;
+
+	while (sem_timedwait(&mSpaceSem, &ts))
+		if (errno != EINTR)
+			return false;
+
+	return true;
+}
+
+bool AudioStreamOutClient::isActive()
+{
+	return mActive || mRing->framesReady();
+}
+
+/*
+ * Adds up to frameCount queued frames to out. Returns the number of
+ * frames actually mixed.
+ */
+size_t AudioStreamOutClient::mix(int16_t *out, size_t frameCount)
+{
+	TRACE_VERBOSE();
+	int32_t volume = android_atomic_acquire_load(&mVolume);
+	size_t total = 0;
+	int value;
+
+	if (volume != mMixVolume) {
+		mMixVolume = volume;
+		updateGain();
+	}
+
+	/* At most two regions, before and after the wrap */
+	for (int i = 0; i < 2 && total < frameCount; ++i) {
+		void *region;
+		size_t frames;
+
+		frames = mRing->getReadRegion(&region, frameCount - total);
+
+		if (!frames)
+			break;
+
+		mRamp.mix(out + total*mChannelCount, (const int16_t *)region,
+								frames);
+		mRing->commitRead(frames);
+		total += frames;
+	}
+
+	mMixedSeq.writeBegin();
+	mFramesMixed += total;
+	mMixedSeq.writeEnd();
+
+	if (mActive && total < frameCount)
+		android_atomic_inc(&mUnderruns);
+
+	/*
+	 * The writer rechecks the ring after every wakeup, a single pending
+	 * post is enough for it not to miss this one.
+	 */
+	if (total && !sem_getvalue(&mSpaceSem, &value) && value <= 0)
+		sem_post(&mSpaceSem);
+
+	return total;
+}
+
+/* Called by the OutputMixer thread only, which owns the ramp target */
+void AudioStreamOutClient::updateGain()
+{
+	int16_t gain[2];
+
+	for (int c = 0; c < 2; ++c)
+		gain[c] = matrix_round((int32_t)unpackVolume(mMixVolume, c)
+							* mMasterGain);
+
+	mRamp.setTarget(gain[0], gain[1]);
+}
+
+/*
+ * Picked up by the mixer on its next period and ramped, changes during
+ * playback do not click.
+ */
+status_t AudioStreamOutClient::setVolume(float left, float right)
+{
+	TRACE();
+
+	if (left < 0.0f || left > 1.0f || right < 0.0f || right > 1.0f)
+		return BAD_VALUE;
+
+	android_atomic_release_store(packVolume(
+			(int16_t)(left * MATRIX_COEFF_ONE + 0.5f),
+			(int16_t)(right * MATRIX_COEFF_ONE + 0.5f)), &mVolume);
+
+	return NO_ERROR;
+}
+
+/*
+ * Called by the OutputMixer thread, with the master gain of the mixer,
+ * or before the stream gets added to it.
+ */
+void AudioStreamOutClient::setMasterGain(int16_t gain)
+{
+	TRACE();
+
+	mMasterGain = gain;
+	updateGain();
+}
+
+void AudioStreamOutClient::setProfile_l(int profile)
+{
+	TRACE();
+
+	if (profile == mProfile)
+		return;
+
+	LOGD("client profile %s -> %s",
+			AudioStreamOutALSA::getProfileName(mProfile),
+			AudioStreamOutALSA::getProfileName(profile));
+
+	mProfile = profile;
+	mLimit = AudioStreamOutALSA::getProfilePeriodSize(mProfile)
+			* AudioStreamOutALSA::getProfilePeriodCount(mProfile);
+}
+
+status_t AudioStreamOutClient::setParameters(const String8 &keyValuePairs)
+{
+	TRACE();
+	AudioParameter param = AudioParameter(keyValuePairs);
+	status_t status = NO_ERROR;
+	String8 key;
+	String8 value;
+	int profile = -1;
+	int device;
+	int frames;
+
+	LOGD("AudioStreamOutClient::setParameters() %s",
+						keyValuePairs.string());
+
+	if (mMixer == 0)
+		return NO_INIT;
+
+	key = String8(AudioParameter::keyRouting);
+
+	if (param.getInt(key, device) == NO_ERROR) {
+		/* Routing is shared by all streams */
+		AudioParameter routing;
+
+		if (device)
+			mDevices = (uint32_t)device;
+
+		routing.addInt(key, device);
+		mMixer->output()->setParameters(routing.toString());
+		param.remove(key);
+	}
+
+	key = String8(AUDIO_PARAMETER_OUTPUT_PROFILE);
+
+	if (param.get(key, value) == NO_ERROR) {
+		profile = AudioStreamOutALSA::getProfileByName(value.string());
+
+		if (profile >= 0)
+			param.remove(key);
+	}
+
+	/* AudioFlinger rereads buffer size only when frame count changes */
+	key = String8(AudioParameter::keyFrameCount);
+
+	if (param.getInt(key, frames) == NO_ERROR) {
+		profile = AudioStreamOutALSA::getProfileByFrameCount(frames);
+		param.remove(key);
+	}
+
+	if (profile >= 0) {
+		mLock.lock();
+		setProfile_l(profile);
+		mLock.unlock();
+
+		/* Let the mixer pick new hardware profile */
+		mMixer->wakeUp();
+	}
+
+	if (param.size())
+		status = BAD_VALUE;
+
+	return status;
+}
+
+String8 AudioStreamOutClient::getParameters(const String8 &keys)
+{
+	TRACE();
+	AudioParameter param = AudioParameter(keys);
+	String8 value;
+	String8 key = String8(AudioParameter::keyRouting);
+
+	if (param.get(key, value) == NO_ERROR)
+		param.addInt(key, (int)mDevices);
+
+	key = String8(AUDIO_PARAMETER_OUTPUT_PROFILE);
+
+	if (param.get(key, value) == NO_ERROR)
+		param.add(key, String8(
+			AudioStreamOutALSA::getProfileName(mProfile)));
+
+	LOGV("AudioStreamOutClient::getParameters() %s",
+		param.toString().string());
+
+	return param.toString();
+}
+
+/*
+ * Frames mixed so far, less the ones still waiting in the hardware
+ * output. Everything mixed at the same time is presented at the same
+ * time, so this holds for all streams.
+ */
+status_t AudioStreamOutClient::getRenderPosition(uint32_t *dspFrames)
+{
+	TRACE_VERBOSE();
+	uint32_t pending = 0;
+	uint64_t mixed;
+	int32_t seq;
+
+	if (!dspFrames)
+		return BAD_VALUE;
+
+	if (mMixer == 0)
+		return NO_INIT;
+
+	mMixer->output()->getPendingFrames(&pending);
+
+	do {
+		seq = mMixedSeq.readBegin();
+		mixed = mFramesMixed;
+	} while (mMixedSeq.readRetry(seq));
+
+	*dspFrames = 0;
+
+	if (mixed > pending)
+		*dspFrames = (uint32_t)(mixed - pending);
+
+	return NO_ERROR;
+}
+
+status_t AudioStreamOutClient::dump(int fd, const Vector<String16> &args)
+{
+	TRACE();
+	const size_t SIZE = 256;
+	char buffer[SIZE];
+	String8 result;
+	int32_t volume = android_atomic_acquire_load(&mVolume);
+	uint64_t mixed;
+	int32_t seq;
+
+	do {
+		seq = mMixedSeq.readBegin();
+		mixed = mFramesMixed;
+	} while (mMixedSeq.readRetry(seq));
+
+	snprintf(buffer, SIZE, "\t\tActive %s\n", (mActive) ? "ON" : "OFF");
+	result.append(buffer);
+	snprintf(buffer, SIZE, "\t\tmDevices: 0x%08x\n", mDevices);
+	result.append(buffer);
+	snprintf(buffer, SIZE, "\t\tProfile: %s\n",
+			AudioStreamOutALSA::getProfileName(mProfile));
+	result.append(buffer);
+	snprintf(buffer, SIZE, "\t\tQueued: %u/%u frames\n",
+			mRing->capacity() - mRing->framesFree(), mLimit);
+	result.append(buffer);
+
+	snprintf(buffer, SIZE, "\t\tFrames written: %llu mixed: %llu\n",
+		 (unsigned long long)mFramesWritten,
+		 (unsigned long long)mixed);
+	result.append(buffer);
+	snprintf(buffer, SIZE, "\t\tUnderruns: %d\n",
+			android_atomic_acquire_load(&mUnderruns));
+	result.append(buffer);
+	snprintf(buffer, SIZE, "\t\tVolume: %.3f/%.3f, master gain %.3f\n",
+			(float)unpackVolume(volume, 0) / MATRIX_COEFF_ONE,
+			(float)unpackVolume(volume, 1) / MATRIX_COEFF_ONE,
+			(float)mMasterGain / MATRIX_COEFF_ONE);
+	result.append(buffer);
+	mStats.dump(result, mSampleRate);
+
+	::write(fd, result.string(), result.size());
+
+	return NO_ERROR;
+}
+
+}; /* namespace android */
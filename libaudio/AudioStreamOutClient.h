@@ -0,0 +1,137 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUDIOSTREAMOUTCLIENT_H_
+#define _AUDIOSTREAMOUTCLIENT_H_
+
+#include "config.h"
+
+#include <stdint.h>
+#include <semaphore.h>
+#include <sys/types.h>
+#include <utils/threads.h>
+#include <utils/RefBase.h>
+#include <hardware_legacy/AudioHardwareBase.h>
+
+#include "SeqLock.h"
+#include "StreamStats.h"
+#include "VolumeRamp.h"
+
+namespace android {
+
+class OutputMixer;
+class RingBuffer;
+
+/*
+ * Output stream mixed in software with other streams into the hardware
+ * output. Written frames are queued in a lock-free ring, which is drained
+ * by the OutputMixer thread, scaled by the stream volume and the master
+ * gain of the mixer. The mixer thread never takes a lock of the stream.
+ */
+class AudioStreamOutClient : public AudioStreamOut, public RefBase {
+	// protects the profile against concurrent setParameters() calls
+	Mutex mLock;
+	// posted by the mixer after draining frames, never blocks it
+	sem_t mSpaceSem;
+
+	sp<OutputMixer> mMixer;
+	RingBuffer *mRing;
+
+	volatile bool mActive;
+	int mProfile;
+	// number of frames the ring may hold for current profile
+	volatile size_t mLimit;
+
+	uint32_t mDevices;
+	uint32_t mChannels;
+	uint32_t mChannelCount;
+	uint32_t mSampleRate;
+
+	uint64_t mFramesWritten;
+	// written by the mixer thread only
+	SeqLock mMixedSeq;
+	uint64_t mFramesMixed;
+	volatile int32_t mUnderruns;
+	// underruns before the last exit from standby
+	int32_t mUnderrunBase;
+
+	StreamStats mStats;
+
+	// 2.14 fixed-point stream volume, both channels packed like in
+	// VolumeRamp, applied by the mixer thread with its master gain
+	volatile int32_t mVolume;
+	int32_t mMixVolume;
+	int16_t mMasterGain;
+	VolumeRamp mRamp;
+
+	void setProfile_l(int profile);
+	void updateGain();
+	bool waitSpace();
+
+public:
+	AudioStreamOutClient();
+	virtual ~AudioStreamOutClient();
+
+	virtual ssize_t write(const void *buffer, size_t bytes);
+	virtual status_t standby();
+	virtual status_t dump(int fd, const Vector<String16> &args);
+	virtual status_t setParameters(const String8 &keyValuePairs);
+	virtual String8 getParameters(const String8 &keys);
+	virtual status_t getRenderPosition(uint32_t *dspFrames);
+	virtual uint32_t latency() const;
+
+	virtual uint32_t sampleRate() const {
+		return mSampleRate;
+	}
+
+	virtual size_t bufferSize() const;
+
+	virtual uint32_t channels() const {
+		return mChannels;
+	}
+
+	virtual int format() const {
+		return AUDIO_HW_OUT_FORMAT;
+	}
+
+	virtual status_t setVolume(float left, float right);
+
+	status_t set(const sp<OutputMixer> &mixer, uint32_t devices,
+			int *pFormat, uint32_t *pChannels, uint32_t *pRate);
+
+	void getStats(struct audio_stream_stats *stats)
+	{
+		mStats.get(stats, mSampleRate);
+	}
+
+	// called by OutputMixer thread
+	bool isActive();
+	size_t mix(int16_t *out, size_t frameCount);
+	void setMasterGain(int16_t gain);
+
+	int profile() {
+		return mProfile;
+	}
+
+	uint32_t device() {
+		return mDevices;
+	}
+};
+
+}; /* namespace android */
+
+#endif /* _AUDIOSTREAMOUTCLIENT_H_ */
@@ -0,0 +1,289 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "BluetoothBridge"
+
+#include <string.h>
+
+#include <cutils/log.h>
+#include <cutils/atomic.h>
+#include "BluetoothBridge.h"
+#include "ChannelMixer.h"
+#include "Resampler.h"
+#include "RingBuffer.h"
+#include "config.h"
+#include "utils.h"
+
+extern "C" {
+#include "alsa_audio.h"
+};
+
+namespace android {
+
+/*
+ * BluetoothBridge
+ */
+
+BluetoothBridge::BluetoothBridge() :
+	Thread(false),
+	mStatus(NO_INIT),
+	mOutputRefs(0),
+	mInputRefs(0),
+	mOutPcm(0),
+	mInPcm(0),
+	mActive(0),
+	mQueue(0),
+	mDownmix(0),
+	mResampler(0),
+	mBuffer(0),
+	mPeriodFrames(PCM_PERIOD_SZ_MIN * AUDIO_HW_BT_PERIOD_MULT),
+	mSilentFrames(0),
+	mDroppedFrames(0)
+{
+	TRACE();
+
+	mQueue = new RingBuffer(AUDIO_HW_BT_QUEUE_SZ, 2 * sizeof(int16_t));
+
+	if (!mQueue || mQueue->initCheck() != NO_ERROR) {
+		LOGE("Failed to allocate downlink queue");
+		return;
+	}
+
+	/* mixer output -> mono -> link rate */
+	mDownmix = new ChannelMixer(1, 2, AUDIO_HW_OUT_PERIOD_SZ, this);
+
+	if (!mDownmix || mDownmix->initCheck() != NO_ERROR) {
+		LOGE("Failed to create downlink channel mixer");
+		return;
+	}
+
+	mResampler = new Resampler(AUDIO_HW_OUT_SAMPLERATE,
+				AUDIO_HW_BT_SAMPLERATE, 1,
+				AUDIO_HW_OUT_PERIOD_SZ, mDownmix,
+				AUDIO_HW_BT_RESAMPLER_QUALITY);
+
+	if (!mResampler || mResampler->initCheck() != NO_ERROR) {
+		LOGE("Failed to create downlink resampler");
+		return;
+	}
+
+	mBuffer = new int16_t[mPeriodFrames];
+
+	if (!mBuffer) {
+		LOGE("Failed to allocate downlink buffer");
+		return;
+	}
+
+	mStatus = NO_ERROR;
+}
+
+BluetoothBridge::~BluetoothBridge()
+{
+	TRACE();
+
+	if (mOutPcm) {
+		android_atomic_release_store(0, &mActive);
+		requestExitAndWait();
+		pcm_close(mOutPcm);
+	}
+
+	if (mInPcm)
+		pcm_close(mInPcm);
+
+	delete mResampler;
+	delete mDownmix;
+	delete mQueue;
+	delete[] mBuffer;
+}
+
+struct pcm *BluetoothBridge::openPcm(unsigned direction)
+{
+	TRACE();
+	struct pcm *pcm;
+	unsigned flags;
+
+	flags = PCM_BT | direction | PCM_MONO
+		| pcm_rate_flags(AUDIO_HW_BT_SAMPLERATE)
+		| ((AUDIO_HW_BT_PERIOD_MULT - 1) << PCM_PERIOD_SZ_SHIFT)
+		| ((AUDIO_HW_BT_PERIOD_CNT - PCM_PERIOD_CNT_MIN)
+						<< PCM_PERIOD_CNT_SHIFT);
+
+	pcm = pcm_open(flags);
+
+	if (!pcm_ready(pcm)) {
+		LOGE("cannot open BT pcm %s: %s",
+			(direction == PCM_IN) ? "in" : "out", pcm_error(pcm));
+		pcm_close(pcm);
+		return 0;
+	}
+
+	LOGV("BT pcm %s: %u Hz, %u x %u frames",
+			(direction == PCM_IN) ? "in" : "out", pcm_rate(pcm),
+			pcm_period_count(pcm), pcm_period_size(pcm));
+
+	return pcm;
+}
+
+void BluetoothBridge::startOutput()
+{
+	TRACE();
+	LOGV("%s: ref count = %d", __func__, mOutputRefs);
+
+	if (++mOutputRefs != 1 || mStatus != NO_ERROR)
+		return;
+
+	mOutPcm = openPcm(PCM_OUT);
+
+	if (!mOutPcm)
+		return;
+
+	/* The downlink thread is the consumer and it is not running yet */
+	mQueue->commitRead(mQueue->framesReady());
+	android_atomic_release_store(1, &mActive);
+
+	if (run("BluetoothBridge", ANDROID_PRIORITY_URGENT_AUDIO)
+								!= NO_ERROR) {
+		LOGE("Failed to start downlink thread");
+		android_atomic_release_store(0, &mActive);
+		pcm_close(mOutPcm);
+		mOutPcm = 0;
+	}
+}
+
+void BluetoothBridge::stopOutput()
+{
+	TRACE();
+	LOGV("%s: ref count = %d", __func__, mOutputRefs);
+
+	if (--mOutputRefs != 0 || !mOutPcm)
+		return;
+
+	android_atomic_release_store(0, &mActive);
+	requestExitAndWait();
+
+	pcm_close(mOutPcm);
+	mOutPcm = 0;
+}
+
+void BluetoothBridge::startInput()
+{
+	TRACE();
+	LOGV("%s: ref count = %d", __func__, mInputRefs);
+
+	if (++mInputRefs != 1)
+		return;
+
+	mInPcm = openPcm(PCM_IN);
+
+	/* Runs on its own, overruns do not stop it */
+	if (mInPcm)
+		pcm_start(mInPcm);
+}
+
+void BluetoothBridge::stopInput()
+{
+	TRACE();
+	LOGV("%s: ref count = %d", __func__, mInputRefs);
+
+	if (--mInputRefs != 0 || !mInPcm)
+		return;
+
+	pcm_close(mInPcm);
+	mInPcm = 0;
+}
+
+void BluetoothBridge::queue(const int16_t *frames, size_t frameCount)
+{
+	TRACE_VERBOSE();
+	size_t written;
+
+	if (!android_atomic_acquire_load(&mActive))
+		return;
+
+	written = mQueue->write(frames, frameCount);
+
+	if (written < frameCount)
+		mDroppedFrames += frameCount - written;
+}
+
+/*
+ * Never fails, the link has to be fed at its own pace whether the mixer
+ * keeps up or not.
+ */
+status_t BluetoothBridge::getNextBuffer(BufferProvider::Buffer *buffer)
+{
+	TRACE_VERBOSE();
+	size_t frames;
+
+	if (!buffer || !buffer->raw || !buffer->frameCount)
+		return BAD_VALUE;
+
+	frames = mQueue->read(buffer->raw, buffer->frameCount);
+
+	if (frames < buffer->frameCount) {
+		memset(buffer->i16 + 2 * frames, 0,
+			(buffer->frameCount - frames) * 2 * sizeof(int16_t));
+		mSilentFrames += buffer->frameCount - frames;
+	}
+
+	return NO_ERROR;
+}
+
+bool BluetoothBridge::threadLoop()
+{
+	TRACE_VERBOSE();
+	BufferProvider::Buffer buf;
+
+	buf.i16 = mBuffer;
+	buf.frameCount = mPeriodFrames;
+
+	if (mResampler->getNextBuffer(&buf) != NO_ERROR)
+		return false;
+
+	/* Blocks until the link has room, this is what paces the thread */
+	if (pcm_write(mOutPcm, mBuffer, buf.frameCount * sizeof(int16_t))) {
+		LOGE("BT pcm out write failed: %s", pcm_error(mOutPcm));
+		return false;
+	}
+
+	return true;
+}
+
+status_t BluetoothBridge::dump(int fd, const Vector<String16> &args)
+{
+	TRACE();
+	const size_t SIZE = 256;
+	char buffer[SIZE];
+
+	snprintf(buffer, SIZE, "\n\tBluetoothBridge out %s (%d refs), "
+				"in %s (%d refs)\n",
+				mOutPcm ? "running" : "off", mOutputRefs,
+				mInPcm ? "running" : "off", mInputRefs);
+	::write(fd, buffer, strlen(buffer));
+
+	snprintf(buffer, SIZE, "\t\tdownlink: %u queued, %u silent, "
+				"%u dropped frames, %u xruns\n",
+				mQueue ? mQueue->framesReady() : 0,
+				mSilentFrames, mDroppedFrames,
+				mOutPcm ? pcm_get_xruns(mOutPcm) : 0);
+	::write(fd, buffer, strlen(buffer));
+
+	return NO_ERROR;
+}
+
+}; /* namespace android */
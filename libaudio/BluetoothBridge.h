@@ -0,0 +1,107 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _BLUETOOTH_BRIDGE_H_
+#define _BLUETOOTH_BRIDGE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/threads.h>
+#include <utils/String16.h>
+#include <utils/Vector.h>
+
+#include "BufferProvider.h"
+
+extern "C" {
+	struct pcm;
+};
+
+namespace android {
+
+class ChannelMixer;
+class Resampler;
+class RingBuffer;
+
+/*
+ * Bluetooth SCO link of the codec.
+ *
+ * Both directions run at AUDIO_HW_BT_SAMPLERATE, mono, with the shortest
+ * periods the link allows. The downlink is fed by a thread converting the
+ * output mixer periods queued with queue(), down to one channel and the
+ * link rate, and padding with silence when the mixer falls behind. The
+ * uplink only has to be kept running, the codec takes it through its own
+ * sample rate converter into the capture path.
+ *
+ * Both directions are reference counted, as several routes may use them.
+ */
+class BluetoothBridge : public Thread, public BufferProvider {
+public:
+	BluetoothBridge();
+	virtual ~BluetoothBridge();
+
+	status_t initCheck()
+	{
+		return mStatus;
+	}
+
+	void startOutput();
+	void stopOutput();
+	void startInput();
+	void stopInput();
+
+	/*
+	 * Called by the output mixer with every period it plays, stereo
+	 * frames at AUDIO_HW_OUT_SAMPLERATE. Never blocks, frames which do
+	 * not fit are dropped.
+	 */
+	void queue(const int16_t *frames, size_t frameCount);
+
+	status_t dump(int fd, const Vector<String16> &args);
+
+	/* Queued mixer frames, for the downlink conversion chain */
+	virtual status_t getNextBuffer(Buffer *buffer);
+
+private:
+	virtual bool threadLoop();
+
+	struct pcm *openPcm(unsigned direction);
+
+	status_t mStatus;
+
+	int mOutputRefs;
+	int mInputRefs;
+	struct pcm *mOutPcm;
+	struct pcm *mInPcm;
+
+	/* Set while the downlink runs, queue() drops everything otherwise */
+	volatile int32_t mActive;
+
+	RingBuffer *mQueue;
+	ChannelMixer *mDownmix;
+	Resampler *mResampler;
+	/* One period of the link */
+	int16_t *mBuffer;
+	size_t mPeriodFrames;
+
+	/* Downlink statistics, silence padded and mixer frames dropped */
+	uint32_t mSilentFrames;
+	uint32_t mDroppedFrames;
+};
+
+}; /* namespace android */
+
+#endif /* _BLUETOOTH_BRIDGE_H_ */
@@ -36,7 +36,21 @@ public:
 
 	virtual ~BufferProvider() {}
 
+	/* Fills buffer with up to buffer->frameCount frames */
 	virtual status_t getNextBuffer(Buffer *buffer) = 0;
+
+	/*
+	 * Zero-copy access, for providers owning the memory of their frames.
+	 * Points buffer to up to buffer->frameCount frames, valid until they
+	 * are handed back with releaseBuffer(). Providers which cannot do it
+	 * return INVALID_OPERATION, they are read with getNextBuffer().
+	 */
+	virtual status_t acquireBuffer(Buffer *buffer)
+	{
+		return INVALID_OPERATION;
+	}
+
+	virtual void releaseBuffer(Buffer *buffer) {}
 };
 
 }; /* namespace android */
@@ -35,18 +35,29 @@ ChannelMixer::ChannelMixer(uint32_t outChannelCount, uint32_t channelCount,
 	mBuffer(0),
 	mProvider(provider),
 	mOutChannelCount(outChannelCount),
-	mChannelCount(channelCount)
+	mChannelCount(channelCount),
+	mFrameCount(frameCount),
+	mKernel(0),
+	mBypass(false)
 {
 	TRACE();
-	LOGV("ChannelMixer() cstor %p channels %d frames %d",
-					this, mChannelCount, frameCount);
+	LOGV("ChannelMixer() cstor %p channels %d => %d frames %d",
+			this, mChannelCount, mOutChannelCount, frameCount);
 
-	if (outChannelCount != 1 || channelCount != 2) {
+	if (!outChannelCount || outChannelCount > MATRIX_CHANNELS_MAX
+	    || !channelCount || channelCount > MATRIX_CHANNELS_MAX) {
 		LOGE("ChannelMixer cstor: bad conversion: %d => %d",
 					mChannelCount, outChannelCount);
 		return;
 	}
 
+	if (channelCount == 2 && outChannelCount == 1)
+		mKernel = MatrixKernel<2, 1>::mix;
+	else if (channelCount == 1 && outChannelCount == 2)
+		mKernel = MatrixKernel<1, 2>::mix;
+	else if (channelCount == 2 && outChannelCount == 2)
+		mKernel = MatrixKernel<2, 2>::mix;
+
 	mBuffer = new int16_t[frameCount*channelCount];
 
 	if (!mBuffer) {
@@ -54,6 +65,11 @@ ChannelMixer::ChannelMixer(uint32_t outChannelCount, uint32_t channelCount,
 		return;
 	}
 
+	for (uint32_t o = 0; o < MATRIX_CHANNELS_MAX; ++o)
+		mGain[o] = 1.0f;
+
+	setDefaultMatrix();
+
 	mStatus = NO_ERROR;
 }
 
@@ -63,20 +79,124 @@ ChannelMixer::~ChannelMixer()
 		delete[] mBuffer;
 }
 
+void ChannelMixer::setDefaultMatrix()
+{
+	float *m = mMatrix;
+
+	for (uint32_t o = 0; o < mOutChannelCount; ++o) {
+		uint32_t folded = 0;
+
+		for (uint32_t i = 0; i < mChannelCount; ++i) {
+			if (mChannelCount >= mOutChannelCount)
+				m[i] = (i % mOutChannelCount == o);
+			else
+				m[i] = (o % mChannelCount == i);
+
+			if (m[i] != 0.0f)
+				++folded;
+		}
+
+		for (uint32_t i = 0; i < mChannelCount; ++i)
+			m[i] /= folded;
+
+		m += mChannelCount;
+	}
+
+	updateCoeffs();
+}
+
+/* Converts the weights to fixed-point and checks for the identity */
+void ChannelMixer::updateCoeffs()
+{
+	uint32_t n = mOutChannelCount * mChannelCount;
+
+	mBypass = (mOutChannelCount == mChannelCount);
+
+	for (uint32_t k = 0; k < n; ++k) {
+		uint32_t o = k / mChannelCount;
+		float c = mMatrix[k] * mGain[o] * MATRIX_COEFF_ONE;
+
+		if (c > 32767.0f)
+			c = 32767.0f;
+
+		if (c < -32768.0f)
+			c = -32768.0f;
+
+		mCoeffs[k] = (int16_t)((c < 0) ? c - 0.5f : c + 0.5f);
+
+		if (mCoeffs[k] != ((o == k % mChannelCount)
+						? MATRIX_COEFF_ONE : 0))
+			mBypass = false;
+	}
+}
+
+status_t ChannelMixer::setMatrix(const float *matrix)
+{
+	TRACE();
+	uint32_t n = mOutChannelCount * mChannelCount;
+
+	if (mStatus != NO_ERROR)
+		return mStatus;
+
+	for (uint32_t k = 0; k < n; ++k) {
+		if (matrix[k] < -2.0f || matrix[k] > 2.0f) {
+			LOGE("ChannelMixer: weight %f out of range", matrix[k]);
+			return BAD_VALUE;
+		}
+	}
+
+	for (uint32_t k = 0; k < n; ++k)
+		mMatrix[k] = matrix[k];
+
+	updateCoeffs();
+
+	return NO_ERROR;
+}
+
+status_t ChannelMixer::setGain(uint32_t outChannel, float gain)
+{
+	TRACE();
+
+	if (mStatus != NO_ERROR)
+		return mStatus;
+
+	if (outChannel >= mOutChannelCount || gain < 0.0f || gain > 2.0f)
+		return BAD_VALUE;
+
+	mGain[outChannel] = gain;
+	updateCoeffs();
+
+	return NO_ERROR;
+}
+
 status_t ChannelMixer::getNextBuffer(
 	BufferProvider::Buffer *buffer)
 {
 	TRACE_VERBOSE();
 	status_t ret;
 	BufferProvider::Buffer buf;
+	bool acquired = true;
 
 	if (!mProvider)
 		return NO_INIT;
 
-	buf.i16 = mBuffer;
+	if (mBypass)
+		return mProvider->getNextBuffer(buffer);
+
+	/* Mix straight from the memory of the provider if it allows */
 	buf.frameCount = buffer->frameCount;
+	ret = mProvider->acquireBuffer(&buf);
+
+	if (ret == INVALID_OPERATION) {
+		acquired = false;
+		buf.i16 = mBuffer;
+		buf.frameCount = buffer->frameCount;
 
-	ret = mProvider->getNextBuffer(&buf);
+		if (buf.frameCount > mFrameCount)
+			buf.frameCount = mFrameCount;
+
+		ret = mProvider->getNextBuffer(&buf);
+	}
 
 	if (ret != 0) {
 		LOGE("%s: mProvider->getNextBuffer() failed (%d)",
@@ -84,15 +204,35 @@ status_t ChannelMixer::getNextBuffer(
 		return ret;
 	}
 
-	short *in = buf.i16;
-	short *out = buffer->i16;
-
-	for (unsigned int i = 0; i < buf.frameCount; ++i, ++out, in += 2)
-		out[0] = (in[0] + in[1]) / 2;
+	if (mKernel)
+		mKernel(buffer->i16, buf.i16, buf.frameCount, mCoeffs);
+	else
+		matrix_mix(buffer->i16, buf.i16, buf.frameCount, mCoeffs,
+					mChannelCount, mOutChannelCount);
 
 	buffer->frameCount = buf.frameCount;
 
+	if (acquired)
+		mProvider->releaseBuffer(&buf);
+
 	return NO_ERROR;
 }
 
+/* Identity matrix only, frames of the provider are passed on as they are */
+status_t ChannelMixer::acquireBuffer(BufferProvider::Buffer *buffer)
+{
+	if (!mProvider)
+		return NO_INIT;
+
+	if (!mBypass)
+		return INVALID_OPERATION;
+
+	return mProvider->acquireBuffer(buffer);
+}
+
+void ChannelMixer::releaseBuffer(BufferProvider::Buffer *buffer)
+{
+	mProvider->releaseBuffer(buffer);
+}
+
 }; /* namespace android */
@@ -19,9 +19,17 @@
 #define _CHANNELMIXER_H_
 
 #include "BufferProvider.h"
+#include "MatrixKernels.h"
 
 namespace android {
 
+/*
+ * Channel matrix stage. Every output channel is a weighted sum of the
+ * input channels, which covers up- and downmixing, per channel gain,
+ * balance and channel swap in a single pass. The default matrix copies
+ * channels present on both sides, averages folded input channels on
+ * downmix and duplicates them on upmix.
+ */
 class ChannelMixer : public BufferProvider {
 public:
 	ChannelMixer(uint32_t outChannelCount, uint32_t channelCount,
@@ -33,14 +41,40 @@ public:
 		return mStatus;
 	}
 
+	// outChannelCount rows of channelCount weights, in -2.0 .. 2.0
+	status_t setMatrix(const float *matrix);
+	// per output channel gain, applied on top of the matrix
+	status_t setGain(uint32_t outChannel, float gain);
+
+	void setProvider(BufferProvider *provider)
+	{
+		mProvider = provider;
+	}
+
 	virtual status_t getNextBuffer(Buffer *buffer);
+	virtual status_t acquireBuffer(Buffer *buffer);
+	virtual void releaseBuffer(Buffer *buffer);
 
 private:
+	typedef void (*Kernel)(int16_t *out, const int16_t *in,
+				size_t frames, const int16_t *coeff);
+
+	void setDefaultMatrix();
+	void updateCoeffs();
+
 	status_t mStatus;
+	// input frames, for providers without zero-copy access
 	int16_t *mBuffer;
 	BufferProvider *mProvider;
 	uint32_t mOutChannelCount;
 	uint32_t mChannelCount;
+	uint32_t mFrameCount;
+	float mMatrix[MATRIX_CHANNELS_MAX * MATRIX_CHANNELS_MAX];
+	float mGain[MATRIX_CHANNELS_MAX];
+	int16_t mCoeffs[MATRIX_CHANNELS_MAX * MATRIX_CHANNELS_MAX];
+	Kernel mKernel;
+	// identity matrix, frames are passed through untouched
+	bool mBypass;
 };
 
 }; /* namespace android */
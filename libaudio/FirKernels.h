@@ -0,0 +1,296 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FIR_KERNELS_H_
+#define _FIR_KERNELS_H_
+
+#include <stdint.h>
+
+/*
+ * Channel interleaved FIR kernels.
+ *
+ * Each kernel computes one output frame, i.e. the dot product of taps
+ * consecutive interleaved input frames with one row of coefficients, for
+ * all channels at once. Every coefficient is loaded once per frame and
+ * shared by all channels, and the input is walked linearly exactly once.
+ *
+ * Input and output are 0.16 fixed-point, coefficients are 2.14 fixed-point.
+ * Specialized kernels require the number of taps to be a multiple of 8 and
+ * the coefficient row to be 32-bit aligned, stereo input must be 32-bit
+ * aligned as well.
+ */
+
+#if defined(__ARM_ARCH_6__) || defined(__ARM_ARCH_6J__) \
+	|| defined(__ARM_ARCH_6K__) || defined(__ARM_ARCH_6Z__) \
+	|| defined(__ARM_ARCH_6ZK__) || defined(__ARM_ARCH_7A__)
+#if !defined(__thumb__) || defined(__thumb2__)
+#define FIR_KERNELS_ARMV6
+#endif
+#elif defined(__AVX2__)
+#define FIR_KERNELS_AVX2
+#define FIR_KERNELS_SSE2
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#define FIR_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+#define FIR_COEFF_SHIFT		14
+#define FIR_COEFF_ONE		(1 << FIR_COEFF_SHIFT)
+#define FIR_TAPS_ALIGN		8
+
+namespace android {
+
+/* Clip from 16.16 fixed-point to 0.16 fixed-point. */
+static inline int16_t fir_clip(int32_t x)
+{
+	if (x < -32768)
+		x = -32768;
+
+	if (x > 32767)
+		x = 32767;
+
+	return x;
+}
+
+static inline int16_t fir_round(int32_t sum)
+{
+	return fir_clip((sum + (1 << (FIR_COEFF_SHIFT - 1)))
+							>> FIR_COEFF_SHIFT);
+}
+
+#ifdef FIR_KERNELS_ARMV6
+/*
+ * ARMv5TE/ARMv6 DSP multiply-accumulate primitives. The b/t suffixes
+ * select bottom or top halfword of respective operand.
+ */
+static inline int32_t smlabb(int32_t a, int32_t b, int32_t acc)
+{
+	asm ("smlabb %0, %1, %2, %3" : "=r" (acc)
+					: "r" (a), "r" (b), "r" (acc));
+	return acc;
+}
+
+static inline int32_t smlabt(int32_t a, int32_t b, int32_t acc)
+{
+	asm ("smlabt %0, %1, %2, %3" : "=r" (acc)
+					: "r" (a), "r" (b), "r" (acc));
+	return acc;
+}
+
+static inline int32_t smlatb(int32_t a, int32_t b, int32_t acc)
+{
+	asm ("smlatb %0, %1, %2, %3" : "=r" (acc)
+					: "r" (a), "r" (b), "r" (acc));
+	return acc;
+}
+
+static inline int32_t smlatt(int32_t a, int32_t b, int32_t acc)
+{
+	asm ("smlatt %0, %1, %2, %3" : "=r" (acc)
+					: "r" (a), "r" (b), "r" (acc));
+	return acc;
+}
+
+/* acc + a.bottom * b.bottom + a.top * b.top */
+static inline int32_t smlad(int32_t a, int32_t b, int32_t acc)
+{
+	asm ("smlad %0, %1, %2, %3" : "=r" (acc)
+					: "r" (a), "r" (b), "r" (acc));
+	return acc;
+}
+#endif
+
+#ifdef FIR_KERNELS_SSE2
+static inline int32_t fir_hsum_epi32(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(v);
+}
+#endif
+
+/*
+ * Generic kernel, used for channel counts without a specialization and
+ * on architectures without SIMD support.
+ */
+template <int CHANNELS>
+struct FirKernel {
+	static inline void convolve(int16_t *out, const int16_t *in,
+					const int16_t *coeff, int taps)
+	{
+		int32_t sum[CHANNELS];
+
+		for (int ch = 0; ch < CHANNELS; ++ch)
+			sum[ch] = 0;
+
+		for (int i = 0; i < taps; ++i, in += CHANNELS) {
+			int32_t c = coeff[i];
+
+			for (int ch = 0; ch < CHANNELS; ++ch)
+				sum[ch] += in[ch] * c;
+		}
+
+		for (int ch = 0; ch < CHANNELS; ++ch)
+			out[ch] = fir_round(sum[ch]);
+	}
+};
+
+#if defined(FIR_KERNELS_ARMV6)
+
+template <>
+struct FirKernel<1> {
+	static inline void convolve(int16_t *out, const int16_t *in,
+					const int16_t *coeff, int taps)
+	{
+		const int32_t *c = (const int32_t *)coeff;
+		int32_t sum = 0;
+
+		if (!((uintptr_t)in & 3)) {
+			/* Aligned input, two taps per instruction */
+			const int32_t *x = (const int32_t *)in;
+
+			for (int i = 0; i < taps / 2; i += 4) {
+				sum = smlad(x[i], c[i], sum);
+				sum = smlad(x[i + 1], c[i + 1], sum);
+				sum = smlad(x[i + 2], c[i + 2], sum);
+				sum = smlad(x[i + 3], c[i + 3], sum);
+			}
+		} else {
+			/* Misaligned input, only coefficients in pairs */
+			for (int i = 0; i < taps; i += 2) {
+				int32_t cw = *c++;
+
+				sum = smlabb(in[i], cw, sum);
+				sum = smlabt(in[i + 1], cw, sum);
+			}
+		}
+
+		out[0] = fir_round(sum);
+	}
+};
+
+template <>
+struct FirKernel<2> {
+	static inline void convolve(int16_t *out, const int16_t *in,
+					const int16_t *coeff, int taps)
+	{
+		/* One frame per word, left in bottom halfword */
+		const int32_t *x = (const int32_t *)in;
+		const int32_t *c = (const int32_t *)coeff;
+		int32_t left = 0;
+		int32_t right = 0;
+
+		for (int i = 0; i < taps; i += 2) {
+			int32_t cw = *c++;
+			int32_t f0 = x[i];
+			int32_t f1 = x[i + 1];
+
+			left = smlabb(f0, cw, left);
+			right = smlatb(f0, cw, right);
+			left = smlabt(f1, cw, left);
+			right = smlatt(f1, cw, right);
+		}
+
+		out[0] = fir_round(left);
+		out[1] = fir_round(right);
+	}
+};
+
+#elif defined(FIR_KERNELS_SSE2)
+
+template <>
+struct FirKernel<1> {
+	static inline void convolve(int16_t *out, const int16_t *in,
+					const int16_t *coeff, int taps)
+	{
+		__m128i acc = _mm_setzero_si128();
+		int i = 0;
+
+#ifdef FIR_KERNELS_AVX2
+		__m256i acc256 = _mm256_setzero_si256();
+
+		for (; i + 16 <= taps; i += 16) {
+			__m256i x = _mm256_loadu_si256(
+					(const __m256i *)(in + i));
+			__m256i c = _mm256_loadu_si256(
+					(const __m256i *)(coeff + i));
+
+			acc256 = _mm256_add_epi32(acc256,
+						_mm256_madd_epi16(x, c));
+		}
+
+		acc = _mm_add_epi32(_mm256_castsi256_si128(acc256),
+				_mm256_extracti128_si256(acc256, 1));
+#endif
+		for (; i < taps; i += 8) {
+			__m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+			__m128i c = _mm_loadu_si128(
+					(const __m128i *)(coeff + i));
+
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(x, c));
+		}
+
+		out[0] = fir_round(fir_hsum_epi32(acc));
+	}
+};
+
+template <>
+struct FirKernel<2> {
+	/* L0 R0 L1 R1 L2 R2 L3 R3 -> L0 L1 R0 R1 L2 L3 R2 R3 */
+	static inline __m128i deinterleavePairs(__m128i x)
+	{
+		x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 1, 2, 0));
+		return _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 1, 2, 0));
+	}
+
+	static inline void convolve(int16_t *out, const int16_t *in,
+					const int16_t *coeff, int taps)
+	{
+		/* Lanes hold partial sums of L, R, L, R */
+		__m128i acc = _mm_setzero_si128();
+
+		for (int i = 0; i < taps; i += 8, in += 16) {
+			__m128i c = _mm_loadu_si128(
+					(const __m128i *)(coeff + i));
+			/* c0 c1 c0 c1 c2 c3 c2 c3 and c4 c5 c4 c5 c6 c7 c6 c7 */
+			__m128i c0 = _mm_shuffle_epi32(c,
+						_MM_SHUFFLE(1, 1, 0, 0));
+			__m128i c1 = _mm_shuffle_epi32(c,
+						_MM_SHUFFLE(3, 3, 2, 2));
+			__m128i x0 = deinterleavePairs(_mm_loadu_si128(
+					(const __m128i *)in));
+			__m128i x1 = deinterleavePairs(_mm_loadu_si128(
+					(const __m128i *)(in + 8)));
+
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(x0, c0));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(x1, c1));
+		}
+
+		acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc,
+						_MM_SHUFFLE(1, 0, 3, 2)));
+		out[0] = fir_round(_mm_cvtsi128_si32(acc));
+		out[1] = fir_round(_mm_cvtsi128_si32(
+				_mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 1, 1, 1))));
+	}
+};
+
+#endif
+
+}; /* namespace android */
+
+#endif /* _FIR_KERNELS_H_ */
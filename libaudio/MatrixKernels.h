@@ -0,0 +1,263 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MATRIX_KERNELS_H_
+#define _MATRIX_KERNELS_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "FirKernels.h"
+
+/*
+ * Channel matrix kernels.
+ *
+ * Every output sample is the dot product of the input frame with one row
+ * of the matrix, out[o] = sum(in[i] * coeff[o * IN + i]). Samples are 0.16
+ * fixed-point, coefficients 2.14 fixed-point, so gains up to +6 dB can be
+ * applied on the way.
+ *
+ * The 2->1, 1->2 and 2->2 shapes have kernels working on two samples per
+ * instruction on ARMv6 and on eight on SSE2. The ARMv6 kernels need 32-bit
+ * aligned buffers to take the fast path, which stereo buffers always are.
+ */
+
+#define MATRIX_COEFF_SHIFT	FIR_COEFF_SHIFT
+#define MATRIX_COEFF_ONE	FIR_COEFF_ONE
+#define MATRIX_CHANNELS_MAX	8
+
+namespace android {
+
+static inline int16_t matrix_round(int32_t sum)
+{
+	return fir_round(sum);
+}
+
+#ifdef FIR_KERNELS_ARMV6
+/* Rounds and saturates a 16.16 sum to the bottom halfword */
+static inline int32_t matrix_ssat(int32_t sum)
+{
+	int32_t res;
+
+	asm ("ssat %0, #16, %1, asr #14" : "=r" (res)
+			: "r" (sum + (1 << (MATRIX_COEFF_SHIFT - 1))));
+	return res;
+}
+
+/* Bottom halfword of a, top halfword from bottom of b */
+static inline int32_t matrix_pack(int32_t a, int32_t b)
+{
+	int32_t res;
+
+	asm ("pkhbt %0, %1, %2, lsl #16" : "=r" (res) : "r" (a), "r" (b));
+	return res;
+}
+
+/* Two 2.14 coefficients in one word, the first one in bottom halfword */
+static inline int32_t matrix_coeff_pair(int16_t c0, int16_t c1)
+{
+	return (uint16_t)c0 | ((uint32_t)(uint16_t)c1 << 16);
+}
+#endif
+
+#ifdef FIR_KERNELS_SSE2
+static inline __m128i matrix_coeff_pairs(int16_t c0, int16_t c1)
+{
+	return _mm_set1_epi32((uint16_t)c0 | ((uint32_t)(uint16_t)c1 << 16));
+}
+
+/* Rounds and saturates two vectors of 16.16 sums to eight samples */
+static inline __m128i matrix_pack_epi32(__m128i a, __m128i b)
+{
+	const __m128i rnd = _mm_set1_epi32(1 << (MATRIX_COEFF_SHIFT - 1));
+
+	a = _mm_srai_epi32(_mm_add_epi32(a, rnd), MATRIX_COEFF_SHIFT);
+	b = _mm_srai_epi32(_mm_add_epi32(b, rnd), MATRIX_COEFF_SHIFT);
+	return _mm_packs_epi32(a, b);
+}
+#endif
+
+/*
+ * Generic kernel, used for shapes without a specialization and for
+ * the frames left over by the specialized ones.
+ */
+static inline void matrix_mix(int16_t *out, const int16_t *in,
+				size_t frames, const int16_t *coeff,
+				uint32_t inChannels, uint32_t outChannels)
+{
+	for (size_t f = 0; f < frames; ++f, in += inChannels) {
+		const int16_t *c = coeff;
+
+		for (uint32_t o = 0; o < outChannels; ++o) {
+			int32_t sum = 0;
+
+			for (uint32_t i = 0; i < inChannels; ++i)
+				sum += in[i] * *c++;
+
+			*out++ = matrix_round(sum);
+		}
+	}
+}
+
+template <int IN, int OUT>
+struct MatrixKernel {
+	static void mix(int16_t *out, const int16_t *in, size_t frames,
+						const int16_t *coeff)
+	{
+		matrix_mix(out, in, frames, coeff, IN, OUT);
+	}
+};
+
+/* Downmix, out = in.l * c[0] + in.r * c[1] */
+template <>
+struct MatrixKernel<2, 1> {
+	static void mix(int16_t *out, const int16_t *in, size_t frames,
+						const int16_t *coeff)
+	{
+		size_t f = 0;
+
+#if defined(FIR_KERNELS_ARMV6)
+		if (!((uintptr_t)in & 3)) {
+			const int32_t *x = (const int32_t *)in;
+			int32_t c = matrix_coeff_pair(coeff[0], coeff[1]);
+
+			for (; f + 4 <= frames; f += 4, x += 4) {
+				out[f] = matrix_ssat(smlad(x[0], c, 0));
+				out[f + 1] = matrix_ssat(smlad(x[1], c, 0));
+				out[f + 2] = matrix_ssat(smlad(x[2], c, 0));
+				out[f + 3] = matrix_ssat(smlad(x[3], c, 0));
+			}
+		}
+#elif defined(FIR_KERNELS_SSE2)
+		__m128i c = matrix_coeff_pairs(coeff[0], coeff[1]);
+
+		for (; f + 8 <= frames; f += 8) {
+			__m128i a = _mm_loadu_si128(
+					(const __m128i *)(in + 2 * f));
+			__m128i b = _mm_loadu_si128(
+					(const __m128i *)(in + 2 * f + 8));
+
+			_mm_storeu_si128((__m128i *)(out + f),
+					matrix_pack_epi32(_mm_madd_epi16(a, c),
+							_mm_madd_epi16(b, c)));
+		}
+#endif
+		matrix_mix(out + f, in + 2 * f, frames - f, coeff, 2, 1);
+	}
+};
+
+/* Upmix, out.l = in * c[0], out.r = in * c[1] */
+template <>
+struct MatrixKernel<1, 2> {
+	static void mix(int16_t *out, const int16_t *in, size_t frames,
+						const int16_t *coeff)
+	{
+		size_t f = 0;
+
+#if defined(FIR_KERNELS_ARMV6)
+		if (!(((uintptr_t)in | (uintptr_t)out) & 3)) {
+			const int32_t *x = (const int32_t *)in;
+			int32_t *o = (int32_t *)out;
+			int32_t c = matrix_coeff_pair(coeff[0], coeff[1]);
+
+			/* Two mono samples per word, one stereo frame out */
+			for (; f + 2 <= frames; f += 2, ++x, o += 2) {
+				int32_t s = *x;
+				int32_t l0 = matrix_ssat(smlabb(s, c, 0));
+				int32_t r0 = matrix_ssat(smlabt(s, c, 0));
+				int32_t l1 = matrix_ssat(smlatb(s, c, 0));
+				int32_t r1 = matrix_ssat(smlatt(s, c, 0));
+
+				o[0] = matrix_pack(l0, r0);
+				o[1] = matrix_pack(l1, r1);
+			}
+		}
+#elif defined(FIR_KERNELS_SSE2)
+		/* c0 c1 c0 c1 ..., matching duplicated input samples */
+		__m128i c = matrix_coeff_pairs(coeff[0], coeff[1]);
+
+		for (; f + 8 <= frames; f += 8) {
+			__m128i x = _mm_loadu_si128((const __m128i *)(in + f));
+			__m128i d, lo, hi;
+
+			/* 32-bit products of x0 x0 x1 x1 x2 x2 x3 x3 */
+			d = _mm_unpacklo_epi16(x, x);
+			lo = _mm_mullo_epi16(d, c);
+			hi = _mm_mulhi_epi16(d, c);
+			_mm_storeu_si128((__m128i *)(out + 2 * f),
+				matrix_pack_epi32(_mm_unpacklo_epi16(lo, hi),
+						_mm_unpackhi_epi16(lo, hi)));
+
+			d = _mm_unpackhi_epi16(x, x);
+			lo = _mm_mullo_epi16(d, c);
+			hi = _mm_mulhi_epi16(d, c);
+			_mm_storeu_si128((__m128i *)(out + 2 * f + 8),
+				matrix_pack_epi32(_mm_unpacklo_epi16(lo, hi),
+						_mm_unpackhi_epi16(lo, hi)));
+		}
+#endif
+		matrix_mix(out + 2 * f, in + f, frames - f, coeff, 1, 2);
+	}
+};
+
+/* Stereo gain, balance and swap, each output a mix of both inputs */
+template <>
+struct MatrixKernel<2, 2> {
+	static void mix(int16_t *out, const int16_t *in, size_t frames,
+						const int16_t *coeff)
+	{
+		size_t f = 0;
+
+#if defined(FIR_KERNELS_ARMV6)
+		if (!(((uintptr_t)in | (uintptr_t)out) & 3)) {
+			const int32_t *x = (const int32_t *)in;
+			int32_t *o = (int32_t *)out;
+			int32_t cl = matrix_coeff_pair(coeff[0], coeff[1]);
+			int32_t cr = matrix_coeff_pair(coeff[2], coeff[3]);
+
+			for (; f + 2 <= frames; f += 2, x += 2, o += 2) {
+				int32_t l0 = matrix_ssat(smlad(x[0], cl, 0));
+				int32_t r0 = matrix_ssat(smlad(x[0], cr, 0));
+				int32_t l1 = matrix_ssat(smlad(x[1], cl, 0));
+				int32_t r1 = matrix_ssat(smlad(x[1], cr, 0));
+
+				o[0] = matrix_pack(l0, r0);
+				o[1] = matrix_pack(l1, r1);
+			}
+		}
+#elif defined(FIR_KERNELS_SSE2)
+		__m128i cl = matrix_coeff_pairs(coeff[0], coeff[1]);
+		__m128i cr = matrix_coeff_pairs(coeff[2], coeff[3]);
+
+		for (; f + 4 <= frames; f += 4) {
+			__m128i x = _mm_loadu_si128(
+					(const __m128i *)(in + 2 * f));
+			__m128i l = _mm_madd_epi16(x, cl);
+			__m128i r = _mm_madd_epi16(x, cr);
+
+			_mm_storeu_si128((__m128i *)(out + 2 * f),
+				matrix_pack_epi32(_mm_unpacklo_epi32(l, r),
+						_mm_unpackhi_epi32(l, r)));
+		}
+#endif
+		matrix_mix(out + 2 * f, in + 2 * f, frames - f, coeff, 2, 2);
+	}
+};
+
+}; /* namespace android */
+
+#endif /* _MATRIX_KERNELS_H_ */
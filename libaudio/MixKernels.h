@@ -0,0 +1,148 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MIX_KERNELS_H_
+#define _MIX_KERNELS_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "MatrixKernels.h"
+
+/*
+ * Saturating accumulation of 16-bit samples, out[i] = sat(out[i] + in[i]),
+ * optionally scaled by a 2.14 fixed-point gain per stereo channel.
+ *
+ * Specialized kernels handle two samples per instruction on ARMv6 and
+ * eight on SSE2. Buffers of stereo frames are always 32-bit aligned, which
+ * is what the ARMv6 kernels need to take the fast path.
+ */
+
+#if defined(__ARM_ARCH_6__) || defined(__ARM_ARCH_6J__) \
+	|| defined(__ARM_ARCH_6K__) || defined(__ARM_ARCH_6Z__) \
+	|| defined(__ARM_ARCH_6ZK__) || defined(__ARM_ARCH_7A__)
+#if !defined(__thumb__) || defined(__thumb2__)
+#define MIX_KERNELS_ARMV6
+#endif
+#elif defined(__SSE2__)
+#define MIX_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace android {
+
+static inline int16_t mix_clip(int32_t x)
+{
+	if (x < -32768)
+		x = -32768;
+
+	if (x > 32767)
+		x = 32767;
+
+	return x;
+}
+
+#ifdef MIX_KERNELS_ARMV6
+/* Two halfword saturating additions at once */
+static inline int32_t qadd16(int32_t a, int32_t b)
+{
+	int32_t res;
+
+	asm ("qadd16 %0, %1, %2" : "=r" (res) : "r" (a), "r" (b));
+	return res;
+}
+#endif
+
+static inline void mix_s16(int16_t *out, const int16_t *in, size_t count)
+{
+	size_t i = 0;
+
+#if defined(MIX_KERNELS_ARMV6)
+	if (!(((uintptr_t)out | (uintptr_t)in) & 3)) {
+		int32_t *o = (int32_t *)out;
+		const int32_t *x = (const int32_t *)in;
+
+		for (; i + 8 <= count; i += 8, o += 4, x += 4) {
+			o[0] = qadd16(o[0], x[0]);
+			o[1] = qadd16(o[1], x[1]);
+			o[2] = qadd16(o[2], x[2]);
+			o[3] = qadd16(o[3], x[3]);
+		}
+	}
+#elif defined(MIX_KERNELS_SSE2)
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(out + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(in + i));
+
+		_mm_storeu_si128((__m128i *)(out + i), _mm_adds_epi16(a, b));
+	}
+#endif
+
+	for (; i < count; ++i)
+		out[i] = mix_clip((int32_t)out[i] + in[i]);
+}
+
+/* Stereo frames, out.l = sat(out.l + in.l * gl), out.r likewise */
+static inline void mix_gain_s16(int16_t *out, const int16_t *in,
+				size_t frames, int16_t gl, int16_t gr)
+{
+	size_t f = 0;
+
+#if defined(MIX_KERNELS_ARMV6)
+	if (!(((uintptr_t)out | (uintptr_t)in) & 3)) {
+		int32_t *o = (int32_t *)out;
+		const int32_t *x = (const int32_t *)in;
+		int32_t g = matrix_coeff_pair(gl, gr);
+
+		for (; f + 2 <= frames; f += 2, o += 2, x += 2) {
+			int32_t l0 = matrix_ssat(smlabb(x[0], g, 0));
+			int32_t r0 = matrix_ssat(smlatt(x[0], g, 0));
+			int32_t l1 = matrix_ssat(smlabb(x[1], g, 0));
+			int32_t r1 = matrix_ssat(smlatt(x[1], g, 0));
+
+			o[0] = qadd16(o[0], matrix_pack(l0, r0));
+			o[1] = qadd16(o[1], matrix_pack(l1, r1));
+		}
+	}
+#elif defined(MIX_KERNELS_SSE2)
+	__m128i g = matrix_coeff_pairs(gl, gr);
+
+	for (; f + 4 <= frames; f += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(out + 2 * f));
+		__m128i x = _mm_loadu_si128((const __m128i *)(in + 2 * f));
+		__m128i lo = _mm_mullo_epi16(x, g);
+		__m128i hi = _mm_mulhi_epi16(x, g);
+
+		x = matrix_pack_epi32(_mm_unpacklo_epi16(lo, hi),
+					_mm_unpackhi_epi16(lo, hi));
+		_mm_storeu_si128((__m128i *)(out + 2 * f),
+					_mm_adds_epi16(a, x));
+	}
+#endif
+
+	for (; f < frames; ++f) {
+		int16_t *o = out + 2 * f;
+		const int16_t *x = in + 2 * f;
+
+		o[0] = mix_clip((int32_t)o[0] + matrix_round(x[0] * gl));
+		o[1] = mix_clip((int32_t)o[1] + matrix_round(x[1] * gr));
+	}
+}
+
+}; /* namespace android */
+
+#endif /* _MIX_KERNELS_H_ */
@@ -0,0 +1,305 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "OutputMixer"
+
+#include <string.h>
+
+#include <cutils/log.h>
+#include "OutputMixer.h"
+#include "AudioRouter.h"
+#include "AudioStreamOutALSA.h"
+#include "AudioStreamOutClient.h"
+#include "BluetoothBridge.h"
+#include "utils.h"
+
+namespace android {
+
+/*
+ * OutputMixer
+ */
+
+OutputMixer::OutputMixer(const sp<AudioStreamOutALSA> &output,
+				const sp<AudioRouter> &router) :
+	Thread(false),
+	mStatus(NO_INIT),
+	mOutput(output),
+	mRouter(router),
+	mBluetooth(router->bluetoothBridge()),
+	mMasterGain(router->playbackGain()),
+	mMixBuffer(0),
+	mMixFrames(0),
+	mStandby(true),
+	mMixing(false),
+	mSwitching(false),
+	mSwitchDeadline(0)
+{
+	TRACE();
+
+	/* One period of the profile with largest periods */
+	for (int i = 0; i < AudioStreamOutALSA::PROFILE_COUNT; ++i) {
+		size_t frames = AudioStreamOutALSA::getProfilePeriodSize(i);
+
+		if (frames > mMixFrames)
+			mMixFrames = frames;
+	}
+
+	mMixBuffer = new int16_t[mMixFrames*mOutput->frameSize()/2];
+
+	if (!mMixBuffer) {
+		LOGE("Failed to allocate mix buffer");
+		return;
+	}
+
+	mStatus = NO_ERROR;
+}
+
+OutputMixer::~OutputMixer()
+{
+	TRACE();
+
+	if (mMixBuffer)
+		delete[] mMixBuffer;
+}
+
+void OutputMixer::addStream(AudioStreamOutClient *stream)
+{
+	TRACE();
+	AutoMutex lock(mLock);
+
+	/* mMasterGain belongs to the mixing pass, which may be running */
+	stream->setMasterGain(mRouter->playbackGain());
+	mStreams.add(stream);
+	mWorkCond.signal();
+}
+
+void OutputMixer::removeStream(AudioStreamOutClient *stream)
+{
+	TRACE();
+	AutoMutex lock(mLock);
+
+	for (size_t i = 0; i < mStreams.size(); ++i) {
+		if (mStreams[i] == stream) {
+			mStreams.removeAt(i);
+			break;
+		}
+	}
+
+	/* The pass in progress may still use the stream */
+	while (mMixing)
+		mIdleCond.wait(mLock);
+
+	mWorkCond.signal();
+}
+
+void OutputMixer::wakeUp()
+{
+	TRACE_VERBOSE();
+	AutoMutex lock(mLock);
+
+	mWorkCond.signal();
+}
+
+void OutputMixer::stop()
+{
+	TRACE();
+
+	requestExit();
+	wakeUp();
+	requestExitAndWait();
+}
+
+bool OutputMixer::isActive_l()
+{
+	for (size_t i = 0; i < mStreams.size(); ++i)
+		if (mStreams[i]->isActive())
+			return true;
+
+	return false;
+}
+
+/*
+ * Profiles are ordered by latency, the lowest index wins.
+ */
+int OutputMixer::selectProfile_l()
+{
+	int profile = AudioStreamOutALSA::PROFILE_COUNT;
+
+	for (size_t i = 0; i < mStreams.size(); ++i)
+		if (mStreams[i]->isActive() && mStreams[i]->profile() < profile)
+			profile = mStreams[i]->profile();
+
+	if (profile == AudioStreamOutALSA::PROFILE_COUNT)
+		profile = mOutput->profile();
+
+	return profile;
+}
+
+/*
+ * Reopening the pcm drops what is still queued, so nothing new is mixed
+ * until the queue played out. A pcm still below its start threshold is
+ * started to get there. Should the queue not drain in twice the output
+ * latency, the pcm is reopened anyway.
+ */
+void OutputMixer::switchProfile(int profile)
+{
+	TRACE();
+	nsecs_t now = systemTime();
+	uint32_t pending = 0;
+
+	if (!mSwitching) {
+		LOGV("profile switch to %s, draining output",
+				AudioStreamOutALSA::getProfileName(profile));
+		mSwitching = true;
+		mSwitchDeadline = now + milliseconds(2 * mOutput->latency());
+	}
+
+	mOutput->startQueued();
+	mOutput->getPendingFrames(&pending);
+
+	if (pending && now < mSwitchDeadline) {
+		AutoMutex lock(mLock);
+
+		if (!exitPending())
+			mWorkCond.waitRelative(mLock,
+				(1000000000LL * pending) / mOutput->sampleRate());
+
+		return;
+	}
+
+	if (pending)
+		LOGW("output not draining, profile switch drops %u frames",
+								pending);
+
+	mSwitching = false;
+	mOutput->setProfile(profile);
+}
+
+bool OutputMixer::threadLoop()
+{
+	TRACE_VERBOSE();
+	size_t frameSize = mOutput->frameSize();
+	size_t frames;
+	int profile;
+	int16_t gain;
+
+	mLock.lock();
+
+	while (!exitPending() && !isActive_l()) {
+		if (!mStandby) {
+			mLock.unlock();
+			LOGV("all streams idle, output standby");
+			mOutput->standby();
+			mLock.lock();
+			mStandby = true;
+			mSwitching = false;
+			continue;
+		}
+
+		mWorkCond.wait(mLock);
+	}
+
+	if (exitPending()) {
+		mLock.unlock();
+		return false;
+	}
+
+	mStandby = false;
+	profile = selectProfile_l();
+
+	if (profile != mOutput->profile()) {
+		mLock.unlock();
+		switchProfile(profile);
+		return true;
+	}
+
+	mSwitching = false;
+
+	/*
+	 * Mixed without the lock, so wakeUp() and addStream() never wait
+	 * for a pass. Shares the storage of mStreams, which only gets
+	 * copied when a stream is added or removed.
+	 */
+	mMixStreams = mStreams;
+	mMixing = true;
+	mLock.unlock();
+
+	frames = mOutput->bufferSize() / frameSize;
+
+	if (frames > mMixFrames)
+		frames = mMixFrames;
+
+	/* Ramped by the streams, a change once per period is fine */
+	gain = mRouter->playbackGain();
+
+	if (gain != mMasterGain) {
+		mMasterGain = gain;
+
+		for (size_t i = 0; i < mMixStreams.size(); ++i)
+			mMixStreams[i]->setMasterGain(mMasterGain);
+	}
+
+	memset(mMixBuffer, 0, frames*frameSize);
+
+	for (size_t i = 0; i < mMixStreams.size(); ++i)
+		if (mMixStreams[i]->isActive())
+			mMixStreams[i]->mix(mMixBuffer, frames);
+
+	mLock.lock();
+	mMixing = false;
+	mIdleCond.broadcast();
+	mLock.unlock();
+
+	if (mBluetooth != 0)
+		mBluetooth->queue(mMixBuffer, frames);
+
+	/* Blocks until there is room, this is what paces the mixer */
+	mOutput->write(mMixBuffer, frames*frameSize);
+
+	return true;
+}
+
+status_t OutputMixer::dump(int fd, const Vector<String16> &args)
+{
+	TRACE();
+	const size_t SIZE = 256;
+	char buffer[SIZE];
+
+	snprintf(buffer, SIZE, "\n\tOutputMixer standby %s, %d streams\n",
+			(mStandby) ? "ON" : "OFF", mStreams.size());
+	::write(fd, buffer, strlen(buffer));
+
+	snprintf(buffer, SIZE, "\n\tHardware output %p dump:\n", mOutput.get());
+	::write(fd, buffer, strlen(buffer));
+	mOutput->dump(fd, args);
+
+	if (!mLock.tryLock()) {
+		for (size_t i = 0; i < mStreams.size(); ++i) {
+			snprintf(buffer, SIZE, "\t- stream %d %p dump:\n",
+							i, mStreams[i]);
+			::write(fd, buffer, strlen(buffer));
+			mStreams[i]->dump(fd, args);
+		}
+
+		mLock.unlock();
+	}
+
+	return NO_ERROR;
+}
+
+}; /* namespace android */
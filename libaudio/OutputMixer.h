@@ -0,0 +1,104 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OUTPUTMIXER_H_
+#define _OUTPUTMIXER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/threads.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+class AudioRouter;
+class AudioStreamOutALSA;
+class AudioStreamOutClient;
+class BluetoothBridge;
+
+/*
+ * Real-time thread summing all active client streams into the hardware
+ * output, one hardware period at a time.
+ *
+ * The hardware runs with the lowest latency profile requested by active
+ * streams, so streams with deep buffers wake the CPU rarely, unless
+ * a low latency stream is playing at the same time. Mixing pauses while
+ * the hardware queue plays out before a switch, so nothing is dropped.
+ *
+ * Streams are scaled on the way by the playback gain of the router, which
+ * carries the master volume, and by their own volume.
+ *
+ * Every mixed period is also queued for the Bluetooth SCO link, which
+ * drops it unless a route through the link is active.
+ */
+class OutputMixer : public Thread {
+public:
+	OutputMixer(const sp<AudioStreamOutALSA> &output,
+				const sp<AudioRouter> &router);
+	virtual ~OutputMixer();
+
+	status_t initCheck()
+	{
+		return mStatus;
+	}
+
+	void addStream(AudioStreamOutClient *stream);
+	void removeStream(AudioStreamOutClient *stream);
+	void wakeUp();
+	void stop();
+
+	const sp<AudioStreamOutALSA> &output()
+	{
+		return mOutput;
+	}
+
+	status_t dump(int fd, const Vector<String16> &args);
+
+private:
+	virtual bool threadLoop();
+	bool isActive_l();
+	int selectProfile_l();
+	void switchProfile(int profile);
+
+	Mutex mLock;
+	Condition mWorkCond;
+	// signalled when a mixing pass ends
+	Condition mIdleCond;
+
+	status_t mStatus;
+	sp<AudioStreamOutALSA> mOutput;
+	sp<AudioRouter> mRouter;
+	sp<BluetoothBridge> mBluetooth;
+	Vector<AudioStreamOutClient *> mStreams;
+	// streams of the pass in progress, used without mLock
+	Vector<AudioStreamOutClient *> mMixStreams;
+	// last playback gain of the router passed to the streams
+	int16_t mMasterGain;
+
+	int16_t *mMixBuffer;
+	size_t mMixFrames;
+	bool mStandby;
+	bool mMixing;
+	// profile switch waiting for the output queue to play out
+	bool mSwitching;
+	nsecs_t mSwitchDeadline;
+};
+
+}; /* namespace android */
+
+#endif /* _OUTPUTMIXER_H_ */
@@ -0,0 +1,396 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "Resampler"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+#include <utils/Errors.h>
+#include "Resampler.h"
+#include "FirKernels.h"
+#include "utils.h"
+
+/*
+ * Filter design parameters
+ */
+
+/* Upper limit of taps per phase, bounds the cost of extreme ratios. */
+#define RESAMPLER_MAX_TAPS	192
+/* Upper limit of phases, bounds the size of the coefficient table. */
+#define RESAMPLER_MAX_PHASES	512
+
+struct ResamplerTier {
+	const char *name;
+	/*
+	 * Number of filter taps per phase when no decimation is involved.
+	 * When decimating by M/L > 1, the filter gets proportionally longer
+	 * to keep the transition band at the same fraction of the output
+	 * bandwidth. Must be a multiple of FIR_TAPS_ALIGN.
+	 */
+	uint32_t baseTaps;
+	/*
+	 * Cutoff frequency relative to Nyquist frequency of the lower of
+	 * both rates. Below 1.0, so the -6 dB point lands before Nyquist.
+	 */
+	double cutoff;
+	/* Kaiser window beta, sets the stopband attenuation */
+	double beta;
+};
+
+/*
+ * For 44100 -> 16000 the default tier gives 48 taps, which is about the
+ * cost of the old 44100 -> 22050 -> 16000 chain, but in a single pass.
+ */
+static const ResamplerTier tiers[] = {
+	/* about -45 dB stopband, wide transition band */
+	{ "fast", 8, 0.85, 4.0 },
+	/* about -60 dB stopband */
+	{ "default", 16, 0.90, 6.0 },
+	/* about -80 dB stopband, the limit of 2.14 coefficients */
+	{ "high", 32, 0.94, 8.5 },
+};
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/* Zeroth order modified Bessel function of the first kind. */
+static double bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	double y = x * x / 4.0;
+
+	for (int k = 1; k < 64; ++k) {
+		term *= y / ((double)k * k);
+		sum += term;
+
+		if (term < sum * 1e-12)
+			break;
+	}
+
+	return sum;
+}
+
+namespace android {
+
+/*
+ * Resampler
+ */
+
+Resampler::Resampler(uint32_t inSampleRate, uint32_t outSampleRate,
+				uint32_t channelCount, uint32_t frameCount,
+				BufferProvider *provider, Quality quality) :
+	mStatus(NO_INIT),
+	mProvider(provider),
+	mQuality(quality),
+	mInSampleRate(inSampleRate),
+	mOutSampleRate(outSampleRate),
+	mChannelCount(channelCount),
+	mFrameCount(frameCount),
+	mUpFactor(0),
+	mDownFactor(0),
+	mPosStep(0),
+	mPhaseStep(0),
+	mTaps(0),
+	mCoeffs(0),
+	mInBuf(0),
+	mRing(0),
+	mRingFrames(0),
+	mReadPos(0),
+	mWritePos(0),
+	mPhase(0)
+{
+	TRACE();
+	LOGD("Resampler() cstor %p SR %d -> %d channels %d frames %d %s",
+			this, mInSampleRate, mOutSampleRate,
+			mChannelCount, mFrameCount, qualityName(quality));
+
+	if (!mInSampleRate || !mOutSampleRate || !mFrameCount
+	    || mChannelCount < 1 || mChannelCount > 2
+	    || (unsigned)quality >= NELEM(tiers)) {
+		LOGE("Resampler cstor: bad configuration");
+		return;
+	}
+
+	if (initFilter() != NO_ERROR)
+		return;
+
+	mRingFrames = 1;
+
+	while (mRingFrames < 2*(mFrameCount + mTaps))
+		mRingFrames <<= 1;
+
+	mInBuf = new int16_t[(mTaps - 1 + mRingFrames)*mChannelCount];
+
+	if (!mInBuf) {
+		LOGE("Resampler: Failed to allocate input buffer");
+		return;
+	}
+
+	mRing = mInBuf + (mTaps - 1)*mChannelCount;
+
+	reset();
+
+	mStatus = NO_ERROR;
+}
+
+Resampler::~Resampler()
+{
+	TRACE();
+
+	if (mCoeffs)
+		delete[] mCoeffs;
+
+	if (mInBuf)
+		delete[] mInBuf;
+}
+
+const char *Resampler::qualityName(Quality quality)
+{
+	if ((unsigned)quality >= NELEM(tiers))
+		return "invalid";
+
+	return tiers[quality].name;
+}
+
+bool Resampler::qualityFromName(const char *name, Quality *quality)
+{
+	for (unsigned i = 0; i < NELEM(tiers); ++i) {
+		if (!strcmp(name, tiers[i].name)) {
+			*quality = (Quality)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Designs a Kaiser windowed sinc low-pass filter of mUpFactor*mTaps
+ * taps and splits it into mUpFactor phases of mTaps taps each. Every
+ * phase is stored in reversed order, so filtering becomes a plain dot
+ * product with consecutive input frames.
+ */
+status_t Resampler::initFilter()
+{
+	TRACE();
+	uint32_t div = gcd(mInSampleRate, mOutSampleRate);
+
+	mUpFactor = mOutSampleRate / div;
+	mDownFactor = mInSampleRate / div;
+
+	if (mUpFactor > RESAMPLER_MAX_PHASES) {
+		LOGE("Resampler: unsupported ratio %d/%d",
+					mOutSampleRate, mInSampleRate);
+		return BAD_VALUE;
+	}
+
+	mPosStep = mDownFactor / mUpFactor;
+	mPhaseStep = mDownFactor % mUpFactor;
+
+	uint32_t decimation = (mDownFactor + mUpFactor - 1) / mUpFactor;
+
+	const ResamplerTier *tier = &tiers[mQuality];
+
+	mTaps = tier->baseTaps * decimation;
+
+	if (mTaps > RESAMPLER_MAX_TAPS)
+		mTaps = RESAMPLER_MAX_TAPS;
+
+	mCoeffs = new int16_t[mUpFactor*mTaps];
+
+	if (!mCoeffs) {
+		LOGE("Resampler: Failed to allocate filter coefficients");
+		return NO_MEMORY;
+	}
+
+	/* Cutoff in cycles per sample of the virtual upsampled signal */
+	double ratio = (mUpFactor < mDownFactor) ?
+			(double)mUpFactor / mDownFactor : 1.0;
+	double fc = 0.5 * tier->cutoff * ratio / mUpFactor;
+	int length = mUpFactor*mTaps;
+	double center = (length - 1) / 2.0;
+	double norm = bessel_i0(tier->beta);
+
+	for (uint32_t phase = 0; phase < mUpFactor; ++phase) {
+		int16_t *row = mCoeffs + phase*mTaps;
+		double coeff[RESAMPLER_MAX_TAPS];
+		double sum = 0.0;
+
+		for (uint32_t i = 0; i < mTaps; ++i) {
+			int k = phase + (mTaps - 1 - i)*mUpFactor;
+			double t = k - center;
+			double w = t / (length / 2.0);
+			double h = 2.0 * fc;
+
+			if (t != 0.0)
+				h = sin(2.0 * M_PI * fc * t) / (M_PI * t);
+
+			if (w > 1.0 || w < -1.0)
+				w = 0.0;
+			else
+				w = bessel_i0(tier->beta
+						* sqrt(1.0 - w * w)) / norm;
+
+			coeff[i] = h * w;
+			sum += coeff[i];
+		}
+
+		/*
+		 * Normalize every phase to unity DC gain separately, so the
+		 * quantized filter does not modulate the signal level with
+		 * the phase.
+		 */
+		int32_t total = 0;
+		uint32_t peak = 0;
+
+		for (uint32_t i = 0; i < mTaps; ++i) {
+			row[i] = (int16_t)lrint(coeff[i] / sum * FIR_COEFF_ONE);
+			total += row[i];
+
+			if (abs(row[i]) > abs(row[peak]))
+				peak = i;
+		}
+
+		row[peak] += FIR_COEFF_ONE - total;
+	}
+
+	LOGV("Resampler: L = %d, M = %d, %d taps per phase",
+					mUpFactor, mDownFactor, mTaps);
+
+	return NO_ERROR;
+}
+
+void Resampler::reset()
+{
+	TRACE();
+
+	/*
+	 * Prime the history with silence, so the first output frame is
+	 * computed as soon as the first input frame arrives.
+	 */
+	memset(mRing, 0, (mTaps - 1)*mChannelCount*sizeof(*mRing));
+	mReadPos = 0;
+	mWritePos = mTaps - 1;
+	mPhase = 0;
+}
+
+/*
+ * Produces up to frameCount output frames from the buffered input.
+ * Returns the number of frames produced.
+ */
+template <int CHANNELS>
+size_t Resampler::filter(int16_t *out, size_t frameCount)
+{
+	TRACE_VERBOSE();
+	size_t frames = 0;
+
+	while (frames < frameCount
+	       && (int32_t)(mWritePos - mReadPos) >= (int32_t)mTaps) {
+		int32_t pos = mReadPos & (mRingFrames - 1);
+
+		/* Windows crossing the end start in the guard */
+		if (pos + mTaps > mRingFrames)
+			pos -= mRingFrames;
+
+		FirKernel<CHANNELS>::convolve(out, mRing + pos*CHANNELS,
+					mCoeffs + mPhase*mTaps, mTaps);
+		out += CHANNELS;
+		++frames;
+
+		mReadPos += mPosStep;
+		mPhase += mPhaseStep;
+
+		if (mPhase >= mUpFactor) {
+			mPhase -= mUpFactor;
+			++mReadPos;
+		}
+	}
+
+	return frames;
+}
+
+status_t Resampler::getNextBuffer(BufferProvider::Buffer *buffer)
+{
+	TRACE_VERBOSE();
+
+	if (mStatus != NO_ERROR)
+		return mStatus;
+
+	if (!buffer || !buffer->raw || !buffer->frameCount)
+		return BAD_VALUE;
+
+	size_t outFrames = 0;
+	int16_t *out = buffer->i16;
+
+	while (outFrames < buffer->frameCount) {
+		if (mChannelCount == 1)
+			outFrames += filter<1>(out + outFrames,
+					buffer->frameCount - outFrames);
+		else
+			outFrames += filter<2>(out + 2*outFrames,
+					buffer->frameCount - outFrames);
+
+		if (outFrames == buffer->frameCount)
+			break;
+
+		BufferProvider::Buffer buf;
+		status_t ret;
+		int32_t used = mWritePos - mReadPos;
+		uint32_t pos = mWritePos & (mRingFrames - 1);
+
+		/* Fill up to the end of the ring, never over unread frames */
+		buf.i16 = mRing + pos*mChannelCount;
+		buf.frameCount = mRingFrames - pos;
+
+		if (used > 0 && buf.frameCount > mRingFrames - used)
+			buf.frameCount = mRingFrames - used;
+
+		if (buf.frameCount > mFrameCount)
+			buf.frameCount = mFrameCount;
+
+		ret = mProvider->getNextBuffer(&buf);
+
+		if (ret || !buf.frameCount) {
+			buffer->frameCount = outFrames;
+			return ret;
+		}
+
+		mWritePos += buf.frameCount;
+
+		if (!(mWritePos & (mRingFrames - 1)))
+			memcpy(mInBuf, mRing + (mRingFrames - mTaps + 1)
+							*mChannelCount,
+				(mTaps - 1)*mChannelCount*sizeof(*mRing));
+	}
+
+	return NO_ERROR;
+}
+
+}; /* namespace android */
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RESAMPLER_H_
+#define _RESAMPLER_H_
+
+#include "BufferProvider.h"
+
+namespace android {
+
+/*
+ * Polyphase filter bank sample rate converter.
+ *
+ * Converts between any two sample rates whose ratio reduces to L/M
+ * (output/input) with a reasonably small L, in a single filtering pass.
+ * The prototype low-pass filter is split into L phases, each of them
+ * being applied directly to the input samples, so no intermediate
+ * upsampled or decimated signal is ever computed.
+ */
+class Resampler : public BufferProvider {
+public:
+	/* Filter length and stopband attenuation tiers */
+	enum Quality {
+		QUALITY_FAST,
+		QUALITY_DEFAULT,
+		QUALITY_HIGH,
+	};
+
+	Resampler(uint32_t inSampleRate, uint32_t outSampleRate,
+			uint32_t channelCount, uint32_t frameCount,
+			BufferProvider *provider,
+			Quality quality = QUALITY_DEFAULT);
+	virtual ~Resampler();
+
+	status_t initCheck()
+	{
+		return mStatus;
+	}
+
+	void reset();
+
+	Quality quality() const
+	{
+		return mQuality;
+	}
+
+	static const char *qualityName(Quality quality);
+	static bool qualityFromName(const char *name, Quality *quality);
+
+	void setProvider(BufferProvider *provider)
+	{
+		mProvider = provider;
+	}
+
+	virtual status_t getNextBuffer(Buffer *buffer);
+
+private:
+	status_t initFilter();
+	template <int CHANNELS>
+	size_t filter(int16_t *out, size_t frameCount);
+
+	status_t mStatus;
+	BufferProvider *mProvider;
+	Quality mQuality;
+	uint32_t mInSampleRate;
+	uint32_t mOutSampleRate;
+	uint32_t mChannelCount;
+	uint32_t mFrameCount;
+
+	/* Interpolation (L) and decimation (M) factors */
+	uint32_t mUpFactor;
+	uint32_t mDownFactor;
+	/* Input frames and phases to advance per output frame */
+	uint32_t mPosStep;
+	uint32_t mPhaseStep;
+	/* mUpFactor rows of mTaps coefficients in 2.14 fixed point */
+	uint32_t mTaps;
+	int16_t *mCoeffs;
+
+	/*
+	 * Input ring of mRingFrames frames, a power of two, preceded by a
+	 * guard of mTaps - 1 frames. The last frames of the ring are copied
+	 * to the guard on every wrap, so a filter window crossing the end
+	 * of the ring is still contiguous and nothing needs to be moved.
+	 */
+	int16_t *mInBuf;
+	int16_t *mRing;
+	uint32_t mRingFrames;
+	/* Free running frame cursors, start of next window and end of input */
+	uint32_t mReadPos;
+	uint32_t mWritePos;
+	uint32_t mPhase;
+};
+
+}; /* namespace android */
+
+#endif /* _RESAMPLER_H_ */
@@ -0,0 +1,192 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RingBuffer"
+
+#include <string.h>
+
+#include <cutils/log.h>
+#include <cutils/atomic.h>
+#include <utils/Errors.h>
+#include "RingBuffer.h"
+#include "utils.h"
+
+namespace android {
+
+/*
+ * RingBuffer
+ */
+
+RingBuffer::RingBuffer(size_t frameCount, size_t frameSize) :
+	mStatus(NO_INIT),
+	mData(0),
+	mFrameCount(1),
+	mFrameSize(frameSize),
+	mFront(0),
+	mRear(0)
+{
+	TRACE();
+
+	if (!frameCount || !frameSize || frameCount > (1U << 30)) {
+		LOGE("RingBuffer: bad configuration");
+		return;
+	}
+
+	/* Power of two, so free running indices wrap correctly */
+	while (mFrameCount < frameCount)
+		mFrameCount <<= 1;
+
+	mData = new uint8_t[mFrameCount*mFrameSize];
+
+	if (!mData) {
+		LOGE("RingBuffer: Failed to allocate buffer");
+		return;
+	}
+
+	mStatus = NO_ERROR;
+}
+
+RingBuffer::~RingBuffer()
+{
+	TRACE();
+
+	if (mData)
+		delete[] mData;
+}
+
+size_t RingBuffer::framesReady() const
+{
+	int32_t rear = android_atomic_acquire_load(&mRear);
+
+	return (uint32_t)(rear - mFront);
+}
+
+/*
+ * Returns the number of frames, at most frameCount, that can be read
+ * contiguously at data.
+ */
+size_t RingBuffer::getReadRegion(void **data, size_t frameCount)
+{
+	size_t offset = mFront & (mFrameCount - 1);
+	size_t ready = framesReady();
+
+	if (frameCount > ready)
+		frameCount = ready;
+
+	if (frameCount > mFrameCount - offset)
+		frameCount = mFrameCount - offset;
+
+	*data = mData + offset*mFrameSize;
+
+	return frameCount;
+}
+
+void RingBuffer::commitRead(size_t frameCount)
+{
+	android_atomic_release_store(mFront + frameCount, &mFront);
+}
+
+size_t RingBuffer::read(void *data, size_t frameCount)
+{
+	uint8_t *out = (uint8_t *)data;
+	size_t total = 0;
+
+	/* At most two regions, before and after the wrap */
+	for (int i = 0; i < 2 && total < frameCount; ++i) {
+		void *region;
+		size_t frames;
+
+		frames = getReadRegion(&region, frameCount - total);
+
+		if (!frames)
+			break;
+
+		memcpy(out, region, frames*mFrameSize);
+		commitRead(frames);
+
+		out += frames*mFrameSize;
+		total += frames;
+	}
+
+	return total;
+}
+
+size_t RingBuffer::framesFree() const
+{
+	int32_t front = android_atomic_acquire_load(&mFront);
+
+	return mFrameCount - (uint32_t)(mRear - front);
+}
+
+/*
+ * Returns the number of frames, at most frameCount, that can be written
+ * contiguously at data.
+ */
+size_t RingBuffer::getWriteRegion(void **data, size_t frameCount)
+{
+	size_t offset = mRear & (mFrameCount - 1);
+	size_t space = framesFree();
+
+	if (frameCount > space)
+		frameCount = space;
+
+	if (frameCount > mFrameCount - offset)
+		frameCount = mFrameCount - offset;
+
+	*data = mData + offset*mFrameSize;
+
+	return frameCount;
+}
+
+void RingBuffer::commitWrite(size_t frameCount)
+{
+	android_atomic_release_store(mRear + frameCount, &mRear);
+}
+
+size_t RingBuffer::write(const void *data, size_t frameCount)
+{
+	const uint8_t *in = (const uint8_t *)data;
+	size_t total = 0;
+
+	for (int i = 0; i < 2 && total < frameCount; ++i) {
+		void *region;
+		size_t frames;
+
+		frames = getWriteRegion(&region, frameCount - total);
+
+		if (!frames)
+			break;
+
+		memcpy(region, in, frames*mFrameSize);
+		commitWrite(frames);
+
+		in += frames*mFrameSize;
+		total += frames;
+	}
+
+	return total;
+}
+
+void RingBuffer::reset()
+{
+	TRACE();
+
+	android_atomic_release_store(0, &mFront);
+	android_atomic_release_store(0, &mRear);
+}
+
+}; /* namespace android */
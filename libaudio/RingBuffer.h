@@ -0,0 +1,79 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RINGBUFFER_H_
+#define _RINGBUFFER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/Errors.h>
+
+namespace android {
+
+/*
+ * Lock-free single producer, single consumer ring of audio frames.
+ *
+ * One thread may call the producer methods and another one the consumer
+ * methods concurrently, without any locking. Both indices run freely and
+ * are only written by their owner, with release semantics, so the other
+ * side never sees an index before the frames it covers.
+ */
+class RingBuffer {
+public:
+	RingBuffer(size_t frameCount, size_t frameSize);
+	~RingBuffer();
+
+	status_t initCheck()
+	{
+		return mStatus;
+	}
+
+	size_t capacity() const
+	{
+		return mFrameCount;
+	}
+
+	/* Consumer side */
+	size_t framesReady() const;
+	size_t getReadRegion(void **data, size_t frameCount);
+	void commitRead(size_t frameCount);
+	size_t read(void *data, size_t frameCount);
+
+	/* Producer side */
+	size_t framesFree() const;
+	size_t getWriteRegion(void **data, size_t frameCount);
+	void commitWrite(size_t frameCount);
+	size_t write(const void *data, size_t frameCount);
+
+	/* Drops all frames, neither side may be running */
+	void reset();
+
+private:
+	status_t mStatus;
+	uint8_t *mData;
+	size_t mFrameCount;
+	size_t mFrameSize;
+
+	/* Read index, written by consumer only */
+	volatile int32_t mFront;
+	/* Write index, written by producer only */
+	volatile int32_t mRear;
+};
+
+}; /* namespace android */
+
+#endif /* _RINGBUFFER_H_ */
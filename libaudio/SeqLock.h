@@ -0,0 +1,73 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SEQ_LOCK_H_
+#define _SEQ_LOCK_H_
+
+#include <stdint.h>
+#include <sched.h>
+#include <cutils/atomic.h>
+
+namespace android {
+
+/*
+ * Sequence counter publishing data, which does not fit a single atomic
+ * word, from the audio thread to readers without ever blocking the writer.
+ *
+ * The count is odd while an update is in progress. Readers copy the data
+ * between readBegin() and readRetry() and start over if a writer got in
+ * between. Writers must be serialized by the caller.
+ */
+class SeqLock {
+public:
+	SeqLock() :
+		mSeq(0)
+	{
+	}
+
+	void writeBegin()
+	{
+		android_atomic_acquire_store(mSeq + 1, &mSeq);
+	}
+
+	void writeEnd()
+	{
+		android_atomic_release_store(mSeq + 1, &mSeq);
+	}
+
+	int32_t readBegin() const
+	{
+		int32_t seq;
+
+		while ((seq = android_atomic_acquire_load(&mSeq)) & 1)
+			sched_yield();
+
+		return seq;
+	}
+
+	bool readRetry(int32_t seq) const
+	{
+		return android_atomic_release_load(&mSeq) != seq;
+	}
+
+private:
+	volatile int32_t mSeq;
+};
+
+}; /* namespace android */
+
+#endif /* _SEQ_LOCK_H_ */
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "StandbyTimer"
+
+#include <cutils/log.h>
+#include "StandbyTimer.h"
+#include "AudioHardwareASoC.h"
+#include "AudioStreamOutALSA.h"
+#include "utils.h"
+
+namespace android {
+
+StandbyTimer::StandbyTimer(AudioHardware *hw) :
+	Thread(false),
+	mHardware(hw),
+	mDeadline(0)
+{
+	TRACE();
+}
+
+void StandbyTimer::schedule(nsecs_t when)
+{
+	TRACE();
+	AutoMutex lock(mLock);
+
+	if (!mDeadline || when < mDeadline) {
+		mDeadline = when;
+		mCond.signal();
+	}
+}
+
+void StandbyTimer::stop()
+{
+	TRACE();
+
+	requestExit();
+
+	mLock.lock();
+	mCond.signal();
+	mLock.unlock();
+
+	requestExitAndWait();
+}
+
+bool StandbyTimer::threadLoop()
+{
+	TRACE();
+	nsecs_t now, next;
+
+	mLock.lock();
+
+	while (!exitPending()) {
+		if (!mDeadline) {
+			mCond.wait(mLock);
+			continue;
+		}
+
+		now = systemTime();
+
+		if (now >= mDeadline)
+			break;
+
+		mCond.waitRelative(mLock, mDeadline - now);
+	}
+
+	if (exitPending()) {
+		mLock.unlock();
+		return false;
+	}
+
+	mDeadline = 0;
+	mLock.unlock();
+
+	/* Takes the stream locks, so must run without mLock */
+	next = mHardware->checkStandbyDelay(systemTime());
+
+	if (next)
+		schedule(next);
+
+	return true;
+}
+
+}; /* namespace android */
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _STANDBY_TIMER_H_
+#define _STANDBY_TIMER_H_
+
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class AudioHardware;
+
+/*
+ * Puts streams into standby once their standby delay expires.
+ *
+ * Streams asked to go to standby only pause their pcm and schedule a check
+ * at the end of the delay. The timer thread then lets AudioHardware check
+ * all streams, so it holds no stream references or locks while sleeping.
+ * Deferred codec volume writes, wake lock and route releases are done on
+ * the same thread.
+ */
+class StandbyTimer : public Thread {
+public:
+	StandbyTimer(AudioHardware *hw);
+
+	/* Wakes the thread at when, unless an earlier check is scheduled */
+	void schedule(nsecs_t when);
+	void stop();
+
+private:
+	virtual bool threadLoop();
+
+	AudioHardware *mHardware;
+	Mutex mLock;
+	Condition mCond;
+	/* 0 if nothing is scheduled */
+	nsecs_t mDeadline;
+};
+
+}; /* namespace android */
+
+#endif /* _STANDBY_TIMER_H_ */
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "StreamLock"
+
+#include <cutils/log.h>
+#include <cutils/atomic.h>
+#include "StreamLock.h"
+#include "utils.h"
+
+namespace android {
+
+StreamLock::StreamLock() :
+	mRequests(0)
+{
+}
+
+void StreamLock::lock()
+{
+	TRACE_VERBOSE();
+
+	if (android_atomic_acquire_load(&mRequests)) {
+		AutoMutex lock(mHandoffLock);
+
+		while (android_atomic_acquire_load(&mRequests))
+			mHandoffCond.wait(mHandoffLock);
+	}
+
+	mLock.lock();
+}
+
+bool StreamLock::tryLock()
+{
+	return mLock.tryLock() == NO_ERROR;
+}
+
+void StreamLock::unlock()
+{
+	TRACE_VERBOSE();
+	mLock.unlock();
+}
+
+void StreamLock::request()
+{
+	TRACE();
+	android_atomic_inc(&mRequests);
+}
+
+void StreamLock::lockRequested()
+{
+	TRACE();
+	mLock.lock();
+
+	AutoMutex lock(mHandoffLock);
+
+	/* Last pending request served, let the audio thread in again */
+	if (android_atomic_dec(&mRequests) == 1)
+		mHandoffCond.broadcast();
+}
+
+}; /* namespace android */
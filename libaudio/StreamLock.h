@@ -0,0 +1,68 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _STREAM_LOCK_H_
+#define _STREAM_LOCK_H_
+
+#include <stdint.h>
+#include <utils/threads.h>
+
+namespace android {
+
+/*
+ * Stream mutex with handoff to control threads.
+ *
+ * The audio thread reacquires the stream lock right after releasing it on
+ * every write() or read(), so a plain mutex would let it starve any other
+ * thread waiting for the lock. Control paths (standby, routing, mode changes)
+ * announce themselves with request() before blocking, and lock() on the
+ * audio thread then waits until all announced requests got the lock and
+ * released it, instead of sleeping for a fixed amount of time.
+ *
+ * Every request() must be followed by exactly one lockRequested().
+ */
+class StreamLock {
+public:
+	StreamLock();
+
+	/* Audio thread side, yields to pending requests */
+	void lock();
+	bool tryLock();
+	void unlock();
+
+	/* Control side */
+	void request();
+	void lockRequested();
+
+	/* request() + lockRequested() */
+	void lockPriority()
+	{
+		request();
+		lockRequested();
+	}
+
+private:
+	Mutex mLock;
+	/* Protects nothing but the wakeup of yielding threads */
+	Mutex mHandoffLock;
+	Condition mHandoffCond;
+	volatile int32_t mRequests;
+};
+
+}; /* namespace android */
+
+#endif /* _STREAM_LOCK_H_ */
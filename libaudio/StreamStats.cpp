@@ -0,0 +1,220 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "StreamStats"
+
+#include <string.h>
+#include <stdio.h>
+
+#include <cutils/log.h>
+#include "StreamStats.h"
+#include "utils.h"
+
+namespace android {
+
+StreamStats::StreamStats(bool input, bool client) :
+	mPcmXruns(0),
+	mActiveSince(0),
+	mRouteSwitches(0),
+	mRouteNs(0),
+	mRouteMaxNs(0)
+{
+	memset(&mStats, 0, sizeof(mStats));
+	mStats.version = STREAM_STATS_VERSION;
+	mStats.size = sizeof(mStats);
+	mStats.input = input;
+	mStats.client = client;
+}
+
+static inline void account(uint64_t *total, uint64_t *max, nsecs_t ns)
+{
+	if (ns < 0)
+		ns = 0;
+
+	*total += ns;
+
+	if ((uint64_t)ns > *max)
+		*max = ns;
+}
+
+void StreamStats::transfer(nsecs_t start, nsecs_t blocked, size_t frames,
+							unsigned pcmXruns)
+{
+	nsecs_t call = systemTime() - start;
+	int bucket = 0;
+
+	while (bucket < STREAM_STATS_HIST_BUCKETS - 1
+	       && call >= (STREAM_STATS_HIST_BASE_NS << bucket))
+		++bucket;
+
+	mSeq.writeBegin();
+
+	++mStats.transfers;
+	mStats.frames += frames;
+	account(&mStats.callNs, &mStats.callMaxNs, call);
+	account(&mStats.blockedNs, &mStats.blockedMaxNs, blocked);
+	++mStats.callHist[bucket];
+
+	if (pcmXruns != mPcmXruns) {
+		mStats.xruns += pcmXruns - mPcmXruns;
+		mPcmXruns = pcmXruns;
+	}
+
+	mSeq.writeEnd();
+}
+
+void StreamStats::error()
+{
+	mSeq.writeBegin();
+	++mStats.errors;
+	mSeq.writeEnd();
+}
+
+void StreamStats::standbyExit(nsecs_t start)
+{
+	nsecs_t now = systemTime();
+
+	mSeq.writeBegin();
+	++mStats.standbyExits;
+	account(&mStats.wakeupNs, &mStats.wakeupMaxNs, now - start);
+	mPcmXruns = 0;
+	mActiveSince = now;
+	mSeq.writeEnd();
+}
+
+void StreamStats::standbyEnter(nsecs_t start)
+{
+	nsecs_t now = systemTime();
+
+	mSeq.writeBegin();
+	++mStats.standbyEnters;
+	account(&mStats.sleepNs, &mStats.sleepMaxNs, now - start);
+
+	if (mActiveSince) {
+		mStats.activeNs += start - mActiveSince;
+		mActiveSince = 0;
+	}
+
+	mSeq.writeEnd();
+}
+
+void StreamStats::routeSwitch(nsecs_t start)
+{
+	nsecs_t now = systemTime();
+	AutoMutex lock(mRouteLock);
+
+	++mRouteSwitches;
+	account(&mRouteNs, &mRouteMaxNs, now - start);
+}
+
+void StreamStats::get(struct audio_stream_stats *stats, uint32_t sampleRate)
+{
+	nsecs_t activeSince;
+	int32_t seq;
+
+	do {
+		seq = mSeq.readBegin();
+		*stats = mStats;
+		activeSince = mActiveSince;
+	} while (mSeq.readRetry(seq));
+
+	stats->sampleRate = sampleRate;
+
+	if (activeSince)
+		stats->activeNs += systemTime() - activeSince;
+
+	AutoMutex lock(mRouteLock);
+
+	stats->routeSwitches = mRouteSwitches;
+	stats->routeNs = mRouteNs;
+	stats->routeMaxNs = mRouteMaxNs;
+}
+
+void StreamStats::dump(String8 &result, uint32_t sampleRate)
+{
+	const size_t SIZE = 256;
+	char buffer[SIZE];
+	struct audio_stream_stats s;
+
+	get(&s, sampleRate);
+
+	snprintf(buffer, SIZE, "\t\tStats: %llu transfers, %llu frames, "
+		 "%u xruns, %u errors\n", (unsigned long long)s.transfers,
+		 (unsigned long long)s.frames, s.xruns, s.errors);
+	result.append(buffer);
+	snprintf(buffer, SIZE, "\t\t  call avg %llu us max %llu us, "
+		 "blocked %llu ms max %llu us\n",
+		 s.transfers ? (unsigned long long)(s.callNs / s.transfers
+								/ 1000) : 0,
+		 (unsigned long long)s.callMaxNs / 1000,
+		 (unsigned long long)s.blockedNs / 1000000,
+		 (unsigned long long)s.blockedMaxNs / 1000);
+	result.append(buffer);
+
+	result.append("\t\t  call histogram (us):");
+
+	for (int i = 0; i < STREAM_STATS_HIST_BUCKETS; ++i) {
+		if (i < STREAM_STATS_HIST_BUCKETS - 1)
+			snprintf(buffer, SIZE, " <%lld:%u",
+			 (long long)(STREAM_STATS_HIST_BASE_NS << i) / 1000,
+			 s.callHist[i]);
+		else
+			snprintf(buffer, SIZE, " more:%u", s.callHist[i]);
+		result.append(buffer);
+	}
+
+	result.append("\n");
+
+	snprintf(buffer, SIZE, "\t\t  standby exits %u avg %llu us "
+		 "max %llu us, enters %u avg %llu us max %llu us\n",
+		 s.standbyExits, s.standbyExits ? (unsigned long long)
+				(s.wakeupNs / s.standbyExits / 1000) : 0,
+		 (unsigned long long)s.wakeupMaxNs / 1000,
+		 s.standbyEnters, s.standbyEnters ? (unsigned long long)
+				(s.sleepNs / s.standbyEnters / 1000) : 0,
+		 (unsigned long long)s.sleepMaxNs / 1000);
+	result.append(buffer);
+	snprintf(buffer, SIZE, "\t\t  route switches %u avg %llu us "
+		 "max %llu us, active %llu ms\n", s.routeSwitches,
+		 s.routeSwitches ? (unsigned long long)
+				(s.routeNs / s.routeSwitches / 1000) : 0,
+		 (unsigned long long)s.routeMaxNs / 1000,
+		 (unsigned long long)s.activeNs / 1000000);
+	result.append(buffer);
+}
+
+/*
+ * Serializes the structure as it is in memory, two hex digits per byte,
+ * so it can be passed through the string based parameter interface.
+ */
+void StreamStats::appendHex(String8 &result,
+				const struct audio_stream_stats *stats)
+{
+	static const char digits[] = "0123456789abcdef";
+	const uint8_t *p = (const uint8_t *)stats;
+	char buffer[2 * sizeof(*stats) + 1];
+
+	for (size_t i = 0; i < sizeof(*stats); ++i) {
+		buffer[2 * i] = digits[p[i] >> 4];
+		buffer[2 * i + 1] = digits[p[i] & 0xf];
+	}
+
+	buffer[2 * sizeof(*stats)] = '\0';
+	result.append(buffer);
+}
+
+}; /* namespace android */
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _STREAM_STATS_H_
+#define _STREAM_STATS_H_
+
+#include <stdint.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <utils/String8.h>
+
+#include "SeqLock.h"
+
+namespace android {
+
+#define STREAM_STATS_VERSION		2
+/* Transfer call durations, bucket n counts calls shorter than 250us << n */
+#define STREAM_STATS_HIST_BUCKETS	10
+#define STREAM_STATS_HIST_BASE_NS	250000LL
+
+/*
+ * Binary stream statistics, as returned by getStats() of the streams and
+ * the stream_stats parameter of AudioHardware. Fields only ever get
+ * appended, readers should check size. Times are in nanoseconds and
+ * everything counts since the stream was opened.
+ */
+struct audio_stream_stats {
+	uint32_t version;
+	uint32_t size;
+	uint32_t input;
+	uint32_t sampleRate;
+
+	/* xruns recovered by the pcm layer */
+	uint32_t xruns;
+	/* failed transfers, recovered by standby and reopen */
+	uint32_t errors;
+	uint32_t standbyEnters;
+	uint32_t standbyExits;
+	uint32_t routeSwitches;
+	/* software mixed stream of the output mixer, since version 2 */
+	uint32_t client;
+
+	uint64_t transfers;
+	uint64_t frames;
+	/* whole write()/read() calls */
+	uint64_t callNs;
+	uint64_t callMaxNs;
+	/* blocked in pcm_write()/pcm_read() */
+	uint64_t blockedNs;
+	uint64_t blockedMaxNs;
+	/* standby exit (pcm open) and enter (pcm close) */
+	uint64_t wakeupNs;
+	uint64_t wakeupMaxNs;
+	uint64_t sleepNs;
+	uint64_t sleepMaxNs;
+	/* mixer reprogramming on route changes */
+	uint64_t routeNs;
+	uint64_t routeMaxNs;
+	/* time spent out of standby */
+	uint64_t activeNs;
+
+	uint32_t callHist[STREAM_STATS_HIST_BUCKETS];
+};
+
+/*
+ * Collects audio_stream_stats of a stream, read from any thread.
+ *
+ * Transfer and standby accounting is published through a sequence counter,
+ * so the audio thread never blocks on readers. Its callers must not run
+ * concurrently, the hardware streams hold their stream lock and client
+ * streams are only written and put to standby by their AudioFlinger
+ * thread. Route switches are rare and may be reported by any thread.
+ */
+class StreamStats {
+public:
+	StreamStats(bool input, bool client = false);
+
+	/*
+	 * start is the beginning of the write()/read() call, blocked the time
+	 * spent in the driver and pcmXruns the xrun count of the pcm.
+	 */
+	void transfer(nsecs_t start, nsecs_t blocked, size_t frames,
+							unsigned pcmXruns);
+	void error();
+	/* start is the time before the pcm got opened or closed */
+	void standbyExit(nsecs_t start);
+	void standbyEnter(nsecs_t start);
+	void routeSwitch(nsecs_t start);
+
+	void get(struct audio_stream_stats *stats, uint32_t sampleRate);
+	void dump(String8 &result, uint32_t sampleRate);
+
+	static void appendHex(String8 &result,
+				const struct audio_stream_stats *stats);
+
+private:
+	SeqLock mSeq;
+	struct audio_stream_stats mStats;
+	/* xruns of the open pcm already accounted */
+	unsigned mPcmXruns;
+	/* start of the current active period, 0 in standby */
+	nsecs_t mActiveSince;
+
+	/* route switch fields of the record, kept apart from mStats */
+	Mutex mRouteLock;
+	uint32_t mRouteSwitches;
+	uint64_t mRouteNs;
+	uint64_t mRouteMaxNs;
+};
+
+}; /* namespace android */
+
+#endif /* _STREAM_STATS_H_ */
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/atomic.h>
+#include "VolumeRamp.h"
+#include "MixKernels.h"
+#include "config.h"
+
+namespace android {
+
+static inline int32_t packGains(int16_t left, int16_t right)
+{
+	return (uint16_t)left | ((uint32_t)(uint16_t)right << 16);
+}
+
+VolumeRamp::VolumeRamp(uint32_t sampleRate) :
+	mTarget(packGains(MATRIX_COEFF_ONE, MATRIX_COEFF_ONE)),
+	mRampTarget(mTarget),
+	mStarted(false),
+	mSteps(0)
+{
+	mGain[0] = mGain[1] = MATRIX_COEFF_ONE << kGainShift;
+	mStep[0] = mStep[1] = 0;
+
+	mRampBlocks = sampleRate * AUDIO_HW_VOLUME_RAMP_MS / 1000 / kRampBlock;
+
+	if (!mRampBlocks)
+		mRampBlocks = 1;
+}
+
+void VolumeRamp::setTarget(int16_t left, int16_t right)
+{
+	android_atomic_release_store(packGains(left, right), &mTarget);
+}
+
+void VolumeRamp::mix(int16_t *out, const int16_t *in, size_t frameCount)
+{
+	int32_t packed = android_atomic_acquire_load(&mTarget);
+
+	if (packed != mRampTarget || !mStarted) {
+		mRampTarget = packed;
+		mSteps = mStarted ? mRampBlocks : 0;
+
+		for (int c = 0; c < 2; ++c) {
+			int32_t gain = target(c) << kGainShift;
+
+			if (mSteps)
+				mStep[c] = (gain - mGain[c]) / (int32_t)mSteps;
+			else
+				mGain[c] = gain;
+		}
+
+		mStarted = true;
+	}
+
+	while (frameCount) {
+		size_t frames = frameCount;
+		int16_t gl, gr;
+
+		if (mSteps) {
+			if (frames > kRampBlock)
+				frames = kRampBlock;
+
+			mGain[0] += mStep[0];
+			mGain[1] += mStep[1];
+
+			/* Land exactly on the target, whatever the rounding */
+			if (!--mSteps) {
+				mGain[0] = target(0) << kGainShift;
+				mGain[1] = target(1) << kGainShift;
+			}
+		}
+
+		gl = mGain[0] >> kGainShift;
+		gr = mGain[1] >> kGainShift;
+
+		if (gl == MATRIX_COEFF_ONE && gr == MATRIX_COEFF_ONE)
+			mix_s16(out, in, 2 * frames);
+		else if (gl || gr)
+			mix_gain_s16(out, in, frames, gl, gr);
+
+		out += 2 * frames;
+		in += 2 * frames;
+		frameCount -= frames;
+	}
+}
+
+}; /* namespace android */
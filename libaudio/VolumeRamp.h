@@ -0,0 +1,75 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _VOLUME_RAMP_H_
+#define _VOLUME_RAMP_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+/*
+ * Software gain of a stereo stream, applied while adding it to a mix.
+ *
+ * Gain changes are ramped linearly over AUDIO_HW_VOLUME_RAMP_MS, in steps
+ * of kRampBlock frames with a constant gain each, so the ramp still runs
+ * through the specialized mixing kernels. Unity gain is a plain saturating
+ * add and silence is skipped altogether.
+ *
+ * setTarget() may be called from any thread, mix() only from the mixer
+ * thread. The first mix() starts at the target, without a ramp.
+ */
+class VolumeRamp {
+public:
+	VolumeRamp(uint32_t sampleRate);
+
+	/* 2.14 fixed-point gains, 0 .. 2.0 */
+	void setTarget(int16_t left, int16_t right);
+
+	void mix(int16_t *out, const int16_t *in, size_t frameCount);
+
+	/* Gain the ramp is heading to, last seen by mix() */
+	int16_t target(int channel) const
+	{
+		return (int16_t)(mRampTarget >> (16 * channel));
+	}
+
+	bool isRamping() const
+	{
+		return mSteps != 0;
+	}
+
+private:
+	static const size_t kRampBlock = 16;
+	/* Fraction bits of mGain below the 2.14 gain */
+	static const int kGainShift = 12;
+
+	/* Both gains packed, left one in bottom halfword */
+	volatile int32_t mTarget;
+	int32_t mRampTarget;
+	bool mStarted;
+
+	int32_t mGain[2];
+	int32_t mStep[2];
+	size_t mSteps;
+	size_t mRampBlocks;
+};
+
+}; /* namespace android */
+
+#endif /* _VOLUME_RAMP_H_ */
@@ -27,17 +27,23 @@ struct pcm;
 #define PCM_STEREO     0x00000000
 #define PCM_MONO       0x01000000
 
+#define PCM_MMAP       0x02000000
+
 #define PCM_44100HZ    0x00000000
 #define PCM_48000HZ    0x00100000
 #define PCM_8000HZ     0x00200000
+#define PCM_11025HZ    0x00300000
+#define PCM_16000HZ    0x00400000
+#define PCM_22050HZ    0x00500000
+#define PCM_32000HZ    0x00600000
 #define PCM_RATE_MASK  0x00F00000
 
 #define PCM_PERIOD_CNT_MIN 2
 #define PCM_PERIOD_CNT_SHIFT 16
 #define PCM_PERIOD_CNT_MASK (0xF << PCM_PERIOD_CNT_SHIFT)
 #define PCM_PERIOD_SZ_MIN 128
-#define PCM_PERIOD_SZ_SHIFT 12
-#define PCM_PERIOD_SZ_MASK (0xF << PCM_PERIOD_SZ_SHIFT)
+#define PCM_PERIOD_SZ_SHIFT 4
+#define PCM_PERIOD_SZ_MASK (0xFF << PCM_PERIOD_SZ_SHIFT)
 
 /* Acquire/release a pcm channel.
  * Returns non-zero on error
@@ -46,6 +52,13 @@ struct pcm *pcm_open(unsigned flags);
 int pcm_close(struct pcm *pcm);
 int pcm_ready(struct pcm *pcm);
 int pcm_start(struct pcm *pcm);
+/* Stops the channel dropping queued frames, the next transfer restarts it */
+int pcm_stop(struct pcm *pcm);
+/* Starts playback of the frames queued so far, without waiting for the
+ * fifo to get full. Does nothing if the channel is not prepared or has
+ * nothing queued.
+ */
+int pcm_start_queued(struct pcm *pcm);
 
 /* Returns a human readable reason for the last error. */
 const char *pcm_error(struct pcm *pcm);
@@ -55,6 +68,40 @@ const char *pcm_error(struct pcm *pcm);
  */
 unsigned pcm_buffer_size(struct pcm *pcm);
 
+/* Return the period geometry negotiated with the driver, in frames. */
+unsigned pcm_period_size(struct pcm *pcm);
+unsigned pcm_period_count(struct pcm *pcm);
+
+/* Return the sample rate negotiated with the driver, in Hz. */
+unsigned pcm_rate(struct pcm *pcm);
+
+/* Convert between sample rates in Hz and the PCM_*HZ flags.
+ * pcm_rate_flags() returns -1 for rates without a flag.
+ */
+unsigned pcm_flags_rate(unsigned flags);
+int pcm_rate_flags(unsigned rate);
+
+/* Fills rates with the sample rates, in ascending order, the device
+ * selected by flags (direction, PCM_BT, PCM_MONO) accepts. Only rates
+ * with a PCM_*HZ flag are probed. Returns their number, 0 if the device
+ * cannot be opened.
+ */
+unsigned pcm_get_rates(unsigned flags, unsigned *rates, unsigned count);
+
+/* Returns the number of xruns (underruns on playback, overruns on capture)
+ * recovered since the channel was opened.
+ */
+unsigned pcm_get_xruns(struct pcm *pcm);
+
+/* Returns the number of frames that can be written to (or read from)
+ * the fifo right now and the time the hardware pointer was last updated.
+ * Returns 1 if the channel is running, 0 if it is not (the timestamp
+ * is invalid then) and negative value on error.
+ */
+struct timespec;
+int pcm_get_htimestamp(struct pcm *pcm, unsigned *avail,
+		       struct timespec *tstamp);
+
 /* Write data to the fifo.
  * Will start playback on the first write or on a write that
  * occurs after a fifo underrun.
@@ -62,6 +109,63 @@ unsigned pcm_buffer_size(struct pcm *pcm);
 int pcm_write(struct pcm *pcm, void *data, unsigned count);
 int pcm_read(struct pcm *pcm, void *data, unsigned count);
 
+/* mmap transport, for channels opened with PCM_MMAP.
+ *
+ * pcm_mmap_begin() returns the DMA ring in areas and the frame offset and
+ * number of contiguous frames that can be accessed there. On input frames
+ * holds the maximum number of frames wanted. The accessed frames are passed
+ * back to the driver with pcm_mmap_commit(), at the offset returned by
+ * pcm_mmap_begin(). Playback is started as soon as
+ * the ring gets full, capture on first access. Xruns are recovered
+ * transparently and counted.
+ *
+ * pcm_write() and pcm_read() work on mmapped channels as well, copying
+ * to/from the ring directly.
+ */
+int pcm_mmap_avail(struct pcm *pcm);
+int pcm_mmap_begin(struct pcm *pcm, void **areas,
+		   unsigned *offset, unsigned *frames);
+int pcm_mmap_commit(struct pcm *pcm, unsigned offset, unsigned frames);
+/* Like pcm_mmap_begin(), but waits until at least one frame can be
+ * accessed. Returns -EINVAL for channels opened without PCM_MMAP and
+ * -EPIPE on an xrun while waiting, which the next call recovers.
+ */
+int pcm_mmap_acquire(struct pcm *pcm, void **areas,
+		     unsigned *offset, unsigned *frames);
+
+/* Waits until the ring can be accessed.
+ * Returns 0 on timeout, positive value when ready, -EPIPE on xrun and
+ * other negative values on error.
+ */
+int pcm_wait(struct pcm *pcm, int timeout);
+
+/* Simulated sound card, for running and measuring the stack on a host.
+ * pcm_open() uses it instead of the kernel driver after pcm_sim_enable()
+ * or when ALSA_PCM_SIM is set in the environment (ALSA_PCM_SIM_WAV,
+ * ALSA_PCM_SIM_XRUN, ALSA_PCM_SIM_TONE, ALSA_PCM_SIM_RATES, a comma
+ * separated list, and ALSA_PCM_SIM_LOOPBACK set the options then).
+ * Only available in builds of alsa_pcm.c with WITH_PCM_SIM defined and
+ * alsa_pcm_sim.c linked in, which the device libaudio is not.
+ */
+struct pcm_sim_config {
+	/* Playback is recorded to <prefix>-<device>-<n>.wav if set */
+	const char *wav_prefix;
+	/* Inject an xrun every n periods, 0 for none */
+	unsigned xrun_interval;
+	/* Frequency of the capture test tone in Hz, 0 for silence */
+	unsigned tone;
+	/* Sample rates the card accepts, 0 terminated, all if empty */
+	unsigned rates[8];
+	/* Capture records what playback plays at the same time, instead
+	 * of the test tone, as if the output was wired to the input */
+	int loopback;
+};
+
+/* NULL switches back to the kernel driver. */
+void pcm_sim_enable(const struct pcm_sim_config *config);
+/* Makes the next period of a simulated channel end in an xrun. */
+void pcm_sim_inject_xrun(struct pcm *pcm);
+
 struct mixer;
 struct mixer_ctl;
 
@@ -78,6 +182,12 @@ struct mixer_ctl *mixer_get_nth_control(struct mixer *mixer, unsigned n);
 int mixer_ctl_set(struct mixer_ctl *ctl, unsigned percent);
 
 int mixer_ctl_select(struct mixer_ctl *ctl, const char *value);
+
+/* Resolves an enum item name once, for mixer_ctl_select_index().
+ * Returns the item index or -1 if not found.
+ */
+int mixer_ctl_get_enum_index(struct mixer_ctl *ctl, const char *value);
+int mixer_ctl_select_index(struct mixer_ctl *ctl, unsigned index);
 void mixer_ctl_print(struct mixer_ctl *ctl);
 
 #endif
@@ -15,6 +15,9 @@
  * limitations under the License.
  */
 
+#define LOG_TAG "alsa_mixer"
+#include <cutils/log.h>
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,6 +25,10 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <linux/ioctl.h>
 #define __force
@@ -102,6 +109,9 @@ struct mixer {
 	struct mixer_ctl *ctl;
 	struct mixer_ctl **lookup;
 	unsigned count;
+	/* topology snapshot backing info and enum names, if loaded */
+	void *snapshot;
+	size_t snapshot_size;
 };
 
 void mixer_close(struct mixer *mixer)
@@ -120,7 +130,7 @@ void mixer_close(struct mixer *mixer)
 
 			max = mixer->ctl[n].info->value.enumerated.items;
 
-			for (m = 0; m < max; m++)
+			for (m = 0; m < max && !mixer->snapshot; m++)
 				free(mixer->ctl[n].ename[m]);
 
 			free(mixer->ctl[n].ename);
@@ -132,7 +142,9 @@ void mixer_close(struct mixer *mixer)
 	if (mixer->lookup)
 		free(mixer->lookup);
 
-	if (mixer->info)
+	if (mixer->snapshot)
+		munmap(mixer->snapshot, mixer->snapshot_size);
+	else if (mixer->info)
 		free(mixer->info);
 
 	free(mixer);
@@ -152,9 +164,209 @@ static int mixer_ctl_compare(const void *a, const void *b)
 					(const char *)ctl_b->info->id.name);
 }
 
+/*
+ * Mixer topology snapshot
+ *
+ * Enumerating all controls takes one ioctl per control and one more per
+ * enum item, which adds up on codecs with hundreds of controls. The result
+ * is saved per card and mapped back on later opens, after checking that
+ * the card info and the control id list still match.
+ *
+ * Layout: header, snd_ctl_elem_info[count], then the names of all enum
+ * items of all controls, in order, as NUL terminated strings.
+ */
+
+/* Created by init for the media user, mediaserver cannot write to /data */
+#ifndef MIXER_SNAPSHOT_DIR
+#define MIXER_SNAPSHOT_DIR	"/data/misc/audio"
+#endif
+#define MIXER_SNAPSHOT_MAGIC	0x4e53584d /* "MXSN" */
+#define MIXER_SNAPSHOT_VERSION	1
+
+struct mixer_snapshot_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t count;
+	struct snd_ctl_card_info card;
+};
+
+static void mixer_snapshot_path(char *path, size_t len,
+					struct snd_ctl_card_info *card)
+{
+	char id[sizeof(card->id) + 1];
+	unsigned n;
+
+	for (n = 0; n < sizeof(card->id) && card->id[n]; n++)
+		id[n] = isalnum(card->id[n]) ? card->id[n] : '_';
+
+	id[n] = 0;
+
+	snprintf(path, len, MIXER_SNAPSHOT_DIR "/mixer_%s.snapshot", id);
+}
+
+/* Returns 0 if mixer->info and enum names were set up from the snapshot. */
+static int mixer_snapshot_load(struct mixer *mixer,
+			struct snd_ctl_card_info *card, struct snd_ctl_elem_id *eid)
+{
+	struct mixer_snapshot_header *hdr;
+	struct stat st;
+	char path[PATH_MAX];
+	const char *names, *end;
+	void *map;
+	unsigned n, m;
+	size_t size;
+	int fd;
+
+	mixer_snapshot_path(path, sizeof(path), card);
+
+	fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(*hdr)) {
+		close(fd);
+		return -1;
+	}
+
+	size = st.st_size;
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return -1;
+
+	hdr = map;
+	names = (const char *)map + sizeof(*hdr)
+			+ mixer->count * sizeof(struct snd_ctl_elem_info);
+	end = (const char *)map + size;
+
+	if (hdr->magic != MIXER_SNAPSHOT_MAGIC
+	    || hdr->version != MIXER_SNAPSHOT_VERSION
+	    || hdr->size != size || hdr->count != mixer->count
+	    || names > end
+	    || memcmp(&hdr->card, card, sizeof(*card)))
+		goto fail;
+
+	mixer->info = (struct snd_ctl_elem_info *)(hdr + 1);
+
+	/* Controls added, removed or renumbered since the snapshot */
+	for (n = 0; n < mixer->count; n++)
+		if (memcmp(&mixer->info[n].id, &eid[n], sizeof(*eid)))
+			goto fail;
+
+	for (n = 0; n < mixer->count; n++) {
+		struct snd_ctl_elem_info *ei = mixer->info + n;
+
+		mixer->ctl[n].info = ei;
+		mixer->ctl[n].mixer = mixer;
+		mixer->lookup[n] = &mixer->ctl[n];
+
+		if (ei->type != SNDRV_CTL_ELEM_TYPE_ENUMERATED)
+			continue;
+
+		char **enames = calloc(ei->value.enumerated.items,
+							sizeof(char*));
+		if (!enames)
+			goto fail;
+
+		mixer->ctl[n].ename = enames;
+
+		for (m = 0; m < ei->value.enumerated.items; m++) {
+			const char *name = names;
+
+			while (names < end && *names)
+				names++;
+
+			if (names++ == end)
+				goto fail;
+
+			enames[m] = (char *)name;
+		}
+	}
+
+	mixer->snapshot = map;
+	mixer->snapshot_size = size;
+
+	return 0;
+
+fail:
+	for (n = 0; n < mixer->count; n++) {
+		if (mixer->ctl[n].ename)
+			free(mixer->ctl[n].ename);
+
+		mixer->ctl[n].ename = NULL;
+	}
+
+	mixer->info = NULL;
+	munmap(map, size);
+
+	return -1;
+}
+
+static void mixer_snapshot_save(struct mixer *mixer,
+					struct snd_ctl_card_info *card)
+{
+	struct mixer_snapshot_header hdr;
+	char path[PATH_MAX];
+	/* path and the .tmp suffix */
+	char tmp[PATH_MAX + 4];
+	unsigned n, m;
+	size_t size;
+	FILE *file;
+
+	size = sizeof(hdr) + mixer->count * sizeof(struct snd_ctl_elem_info);
+
+	for (n = 0; n < mixer->count; n++) {
+		if (!mixer->ctl[n].ename)
+			continue;
+
+		for (m = 0; m < mixer->info[n].value.enumerated.items; m++)
+			size += strlen(mixer->ctl[n].ename[m]) + 1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = MIXER_SNAPSHOT_MAGIC;
+	hdr.version = MIXER_SNAPSHOT_VERSION;
+	hdr.size = size;
+	hdr.count = mixer->count;
+	hdr.card = *card;
+
+	mixer_snapshot_path(path, sizeof(path), card);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	file = fopen(tmp, "w");
+
+	/* Every later mixer_open() enumerates all controls again */
+	if (!file) {
+		LOGW("cannot save mixer snapshot %s: %s", tmp, strerror(errno));
+		return;
+	}
+
+	fwrite(&hdr, sizeof(hdr), 1, file);
+	fwrite(mixer->info, sizeof(*mixer->info), mixer->count, file);
+
+	for (n = 0; n < mixer->count; n++) {
+		if (!mixer->ctl[n].ename)
+			continue;
+
+		for (m = 0; m < mixer->info[n].value.enumerated.items; m++)
+			fwrite(mixer->ctl[n].ename[m],
+				strlen(mixer->ctl[n].ename[m]) + 1, 1, file);
+	}
+
+	/* Replace the old snapshot only with a complete one */
+	if (fclose(file) || rename(tmp, path)) {
+		LOGW("cannot save mixer snapshot %s: %s", path, strerror(errno));
+		unlink(tmp);
+	}
+}
+
 struct mixer *mixer_open(void) {
 	struct snd_ctl_elem_list elist;
 	struct snd_ctl_elem_info tmp;
+	struct snd_ctl_card_info card;
 	struct snd_ctl_elem_id *eid = NULL;
 	struct mixer *mixer = NULL;
 	unsigned n, m;
@@ -170,16 +382,21 @@ struct mixer *mixer_open(void) {
 	if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_LIST, &elist) < 0)
 		goto fail;
 
+	memset(&card, 0, sizeof(card));
+
+	if (ioctl(fd, SNDRV_CTL_IOCTL_CARD_INFO, &card) < 0)
+		goto fail;
+
 	mixer = calloc(1, sizeof(*mixer));
 
 	if (!mixer)
 		goto fail;
 
+	mixer->fd = fd;
 	mixer->ctl = calloc(elist.count, sizeof(struct mixer_ctl));
-	mixer->info = calloc(elist.count, sizeof(struct snd_ctl_elem_info));
 	mixer->lookup = calloc(elist.count, sizeof(struct mixer_ctl *));
 
-	if (!mixer->ctl || !mixer->info || !mixer->lookup)
+	if (!mixer->ctl || !mixer->lookup)
 		goto fail;
 
 	eid = calloc(elist.count, sizeof(struct snd_ctl_elem_id));
@@ -195,6 +412,14 @@ struct mixer *mixer_open(void) {
 	if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_LIST, &elist) < 0)
 		goto fail;
 
+	if (!mixer_snapshot_load(mixer, &card, eid))
+		goto done;
+
+	mixer->info = calloc(elist.count, sizeof(struct snd_ctl_elem_info));
+
+	if (!mixer->info)
+		goto fail;
+
 	for (n = 0; n < mixer->count; n++) {
 		struct snd_ctl_elem_info *ei = mixer->info + n;
 		ei->id.numid = eid[n].numid;
@@ -231,6 +456,9 @@ struct mixer *mixer_open(void) {
 		}
 	}
 
+	mixer_snapshot_save(mixer, &card);
+
+done:
 	qsort(mixer->lookup, mixer->count,
 				sizeof(*mixer->lookup), mixer_ctl_compare);
 
@@ -468,10 +696,9 @@ int mixer_ctl_set(struct mixer_ctl *ctl, unsigned percent)
 	return ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev);
 }
 
-int mixer_ctl_select(struct mixer_ctl *ctl, const char *value)
+int mixer_ctl_get_enum_index(struct mixer_ctl *ctl, const char *value)
 {
 	unsigned n, max;
-	struct snd_ctl_elem_value ev;
 
 	if (ctl->info->type != SNDRV_CTL_ELEM_TYPE_ENUMERATED) {
 		errno = EINVAL;
@@ -480,20 +707,40 @@ int mixer_ctl_select(struct mixer_ctl *ctl, const char *value)
 
 	max = ctl->info->value.enumerated.items;
 
-	for (n = 0; n < max; n++) {
-		if (!strcmp(value, ctl->ename[n])) {
-			memset(&ev, 0, sizeof(ev));
-			ev.value.enumerated.item[0] = n;
-			ev.id.numid = ctl->info->id.numid;
+	for (n = 0; n < max; n++)
+		if (!strcmp(value, ctl->ename[n]))
+			return n;
+
+	errno = EINVAL;
+	return -1;
+}
 
-			if (ioctl(ctl->mixer->fd,
-			    SNDRV_CTL_IOCTL_ELEM_WRITE, &ev) < 0)
-				return -1;
+int mixer_ctl_select_index(struct mixer_ctl *ctl, unsigned index)
+{
+	struct snd_ctl_elem_value ev;
 
-			return 0;
-		}
+	if (ctl->info->type != SNDRV_CTL_ELEM_TYPE_ENUMERATED
+	    || index >= ctl->info->value.enumerated.items) {
+		errno = EINVAL;
+		return -1;
 	}
 
-	errno = EINVAL;
-	return -1;
+	memset(&ev, 0, sizeof(ev));
+	ev.value.enumerated.item[0] = index;
+	ev.id.numid = ctl->info->id.numid;
+
+	if (ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev) < 0)
+		return -1;
+
+	return 0;
+}
+
+int mixer_ctl_select(struct mixer_ctl *ctl, const char *value)
+{
+	int index = mixer_ctl_get_enum_index(ctl, value);
+
+	if (index < 0)
+		return -1;
+
+	return mixer_ctl_select_index(ctl, index);
 }
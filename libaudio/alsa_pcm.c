@@ -28,6 +28,9 @@
 #include <errno.h>
 #include <unistd.h>
 
+#include <limits.h>
+#include <poll.h>
+
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/time.h>
@@ -35,11 +38,7 @@
 #include <linux/ioctl.h>
 
 #include "alsa_audio.h"
-
-#define __force
-#define __bitwise
-#define __user
-#include "asound.h"
+#include "alsa_pcm_backend.h"
 
 #define DEBUG 0
 
@@ -109,6 +108,18 @@ static void param_set_int(struct snd_pcm_hw_params *p, int n, unsigned val)
 	}
 }
 
+static unsigned param_get_int(struct snd_pcm_hw_params *p, int n)
+{
+	if (param_is_interval(n)) {
+		struct snd_interval *i = param_to_interval(p, n);
+
+		if (i->integer)
+			return i->max;
+	}
+
+	return 0;
+}
+
 static void param_init(struct snd_pcm_hw_params *p)
 {
 	int n;
@@ -195,17 +206,80 @@ static void param_dump(struct snd_pcm_hw_params *p) {}
 static void info_dump(struct snd_pcm_info *info) {}
 #endif
 
-#define PCM_ERROR_MAX 128
+/* Timeout of waiting for the DMA ring in mmap mode, in ms */
+#define PCM_MMAP_TIMEOUT 1000
 
-struct pcm {
-	int fd;
-	unsigned flags;
-	int running:1;
-	int underruns;
-	unsigned buffer_size;
-	char error[PCM_ERROR_MAX];
+/* Kernel PCM device backend */
+
+static int kernel_open(struct pcm *pcm, const char *dname)
+{
+	pcm->fd = open(dname, O_RDWR);
+
+	return (pcm->fd < 0) ? -1 : 0;
+}
+
+static int kernel_close(struct pcm *pcm)
+{
+	return close(pcm->fd);
+}
+
+static int kernel_ioctl(struct pcm *pcm, unsigned request, void *arg)
+{
+	return ioctl(pcm->fd, request, arg);
+}
+
+static void *kernel_mmap(struct pcm *pcm, size_t length, int prot,
+								off_t offset)
+{
+	return mmap(NULL, length, prot, MAP_FILE | MAP_SHARED, pcm->fd, offset);
+}
+
+static int kernel_munmap(struct pcm *pcm, void *addr, size_t length)
+{
+	(void)pcm;
+
+	return munmap(addr, length);
+}
+
+static int kernel_poll(struct pcm *pcm, short events, int timeout)
+{
+	struct pollfd pfd;
+	int ret;
+
+	pfd.fd = pcm->fd;
+	pfd.events = events;
+	pfd.revents = 0;
+
+	do {
+		ret = poll(&pfd, 1, timeout);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret <= 0)
+		return ret;
+
+	return pfd.revents;
+}
+
+const struct pcm_backend pcm_backend_kernel = {
+	.name = "kernel",
+	.open = kernel_open,
+	.close = kernel_close,
+	.ioctl = kernel_ioctl,
+	.mmap = kernel_mmap,
+	.munmap = kernel_munmap,
+	.poll = kernel_poll,
 };
 
+static inline int pcm_ioctl(struct pcm *pcm, unsigned request, void *arg)
+{
+	return pcm->backend->ioctl(pcm, request, arg);
+}
+
+static inline unsigned pcm_frame_size(struct pcm *pcm)
+{
+	return (pcm->flags & PCM_MONO) ? 2 : 4;
+}
+
 unsigned pcm_buffer_size(struct pcm *pcm)
 {
 	return pcm->buffer_size;
@@ -233,6 +307,90 @@ static int oops(struct pcm *pcm, int e, const char *fmt, ...)
 	return -1;
 }
 
+unsigned pcm_period_size(struct pcm *pcm)
+{
+	return pcm->period_size;
+}
+
+unsigned pcm_period_count(struct pcm *pcm)
+{
+	return pcm->period_cnt;
+}
+
+unsigned pcm_rate(struct pcm *pcm)
+{
+	return pcm->rate;
+}
+
+/* Rates with a PCM_*HZ flag, in ascending order */
+static const struct {
+	unsigned rate;
+	unsigned flags;
+} pcm_rates[] = {
+	{ 8000, PCM_8000HZ },
+	{ 11025, PCM_11025HZ },
+	{ 16000, PCM_16000HZ },
+	{ 22050, PCM_22050HZ },
+	{ 32000, PCM_32000HZ },
+	{ 44100, PCM_44100HZ },
+	{ 48000, PCM_48000HZ },
+};
+
+unsigned pcm_flags_rate(unsigned flags)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof(pcm_rates) / sizeof(pcm_rates[0]); ++i)
+		if (pcm_rates[i].flags == (flags & PCM_RATE_MASK))
+			return pcm_rates[i].rate;
+
+	return 0;
+}
+
+int pcm_rate_flags(unsigned rate)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof(pcm_rates) / sizeof(pcm_rates[0]); ++i)
+		if (pcm_rates[i].rate == rate)
+			return pcm_rates[i].flags;
+
+	return -1;
+}
+
+unsigned pcm_get_xruns(struct pcm *pcm)
+{
+	return pcm->underruns;
+}
+
+int pcm_get_htimestamp(struct pcm *pcm, unsigned *avail,
+						struct timespec *tstamp)
+{
+	struct snd_pcm_status status;
+
+	if (pcm->fd < 0)
+		return -EINVAL;
+
+	memset(&status, 0, sizeof(status));
+
+	if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_STATUS, &status))
+		return oops(pcm, errno, "cannot get status");
+
+	if (avail) {
+		*avail = status.avail;
+
+		if (*avail > pcm->buffer_size)
+			*avail = pcm->buffer_size;
+	}
+
+	if (tstamp)
+		*tstamp = status.tstamp;
+
+	return status.state == SNDRV_PCM_STATE_RUNNING;
+}
+
+static int pcm_mmap_transfer(struct pcm *pcm, void *data, unsigned count);
+
 int pcm_write(struct pcm *pcm, void *data, unsigned count)
 {
 	struct snd_xferi x;
@@ -240,16 +398,19 @@ int pcm_write(struct pcm *pcm, void *data, unsigned count)
 	if (pcm->flags & PCM_IN)
 		return -EINVAL;
 
+	if (pcm->flags & PCM_MMAP)
+		return pcm_mmap_transfer(pcm, data, count);
+
 	x.buf = data;
 	x.frames = (pcm->flags & PCM_MONO) ? (count / 2) : (count / 4);
 
 	for (;;) {
 		if (!pcm->running) {
-			if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_PREPARE))
+			if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_PREPARE, NULL))
 				return oops(pcm, errno,
 						"cannot prepare channel");
 
-			if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_WRITEI_FRAMES, &x))
+			if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_WRITEI_FRAMES, &x))
 				return oops(pcm, errno,
 						"cannot write initial data");
 
@@ -257,7 +418,7 @@ int pcm_write(struct pcm *pcm, void *data, unsigned count)
 			return 0;
 		}
 
-		if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_WRITEI_FRAMES, &x)) {
+		if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_WRITEI_FRAMES, &x)) {
 			pcm->running = 0;
 
 			if (errno == EPIPE) {
@@ -278,19 +439,54 @@ int pcm_write(struct pcm *pcm, void *data, unsigned count)
 int pcm_start(struct pcm *pcm)
 {
 	if (!pcm->running) {
-		if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_PREPARE))
+		if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_PREPARE, NULL))
 			return oops(pcm, errno, "cannot prepare channel");
 
 		if ((pcm->flags & PCM_IN)
-		    && ioctl(pcm->fd, SNDRV_PCM_IOCTL_START))
+		    && pcm_ioctl(pcm, SNDRV_PCM_IOCTL_START, NULL))
 			return oops(pcm, errno, "cannot start channel");
 
+		pcm->prepared = 1;
 		pcm->running = 1;
 	}
 
 	return 0;
 }
 
+int pcm_stop(struct pcm *pcm)
+{
+	if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_DROP, NULL))
+		return oops(pcm, errno, "cannot stop channel");
+
+	pcm->prepared = 0;
+	pcm->running = 0;
+	return 0;
+}
+
+int pcm_start_queued(struct pcm *pcm)
+{
+	struct snd_pcm_status status;
+
+	if (pcm->flags & PCM_IN)
+		return -EINVAL;
+
+	memset(&status, 0, sizeof(status));
+
+	if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_STATUS, &status))
+		return oops(pcm, errno, "cannot get status");
+
+	/* Running already, stopped or nothing queued */
+	if (status.state != SNDRV_PCM_STATE_PREPARED
+	    || status.avail >= pcm->buffer_size)
+		return 0;
+
+	if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_START, NULL))
+		return oops(pcm, errno, "cannot start channel");
+
+	pcm->running = 1;
+	return 0;
+}
+
 int pcm_read(struct pcm *pcm, void *data, unsigned count)
 {
 	struct snd_xferi x;
@@ -298,24 +494,27 @@ int pcm_read(struct pcm *pcm, void *data, unsigned count)
 	if (!(pcm->flags & PCM_IN))
 		return -EINVAL;
 
+	if (pcm->flags & PCM_MMAP)
+		return pcm_mmap_transfer(pcm, data, count);
+
 	x.buf = data;
 	x.frames = (pcm->flags & PCM_MONO) ? (count / 2) : (count / 4);
 
 //    LOGV("read() %d frames", x.frames);
 	for (;;) {
 		if (!pcm->running) {
-			if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_PREPARE))
+			if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_PREPARE, NULL))
 				return oops(pcm, errno,
 						"cannot prepare channel");
 
-			if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_START))
+			if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_START, NULL))
 				return oops(pcm, errno,
 						"cannot start channel");
 
 			pcm->running = 1;
 		}
 
-		if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_READI_FRAMES, &x)) {
+		if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_READI_FRAMES, &x)) {
 			pcm->running = 0;
 
 			if (errno == EPIPE) {
@@ -334,8 +533,342 @@ int pcm_read(struct pcm *pcm, void *data, unsigned count)
 	}
 }
 
+/* mmap transport */
+
+static int pcm_sync_ptr(struct pcm *pcm, unsigned flags)
+{
+	if (pcm->sync_ptr) {
+		pcm->sync_ptr->flags = flags;
+
+		if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_SYNC_PTR, pcm->sync_ptr))
+			return -1;
+
+		return 0;
+	}
+
+	if ((flags & SNDRV_PCM_SYNC_PTR_HWSYNC)
+	    && pcm_ioctl(pcm, SNDRV_PCM_IOCTL_HWSYNC, NULL))
+		return -1;
+
+	return 0;
+}
+
+static int pcm_mmap_prepare(struct pcm *pcm)
+{
+	if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_PREPARE, NULL))
+		return oops(pcm, errno, "cannot prepare channel");
+
+	/*
+	 * The driver reset its application pointer, read it back instead of
+	 * pushing the stale one on next sync
+	 */
+	if (pcm_sync_ptr(pcm, SNDRV_PCM_SYNC_PTR_APPL))
+		return oops(pcm, errno, "cannot sync appl pointer");
+
+	pcm->prepared = 1;
+	pcm->running = 0;
+
+	/* Playback is started once the ring gets full */
+	if (!(pcm->flags & PCM_IN))
+		return 0;
+
+	if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_START, NULL))
+		return oops(pcm, errno, "cannot start channel");
+
+	pcm->running = 1;
+	return 0;
+}
+
+static int pcm_mmap_init(struct pcm *pcm)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	int prot = PROT_READ | PROT_WRITE;
+
+	pcm->mmap_buffer = pcm->backend->mmap(pcm,
+				pcm->buffer_size * pcm_frame_size(pcm),
+				prot, SNDRV_PCM_MMAP_OFFSET_DATA);
+
+	if (pcm->mmap_buffer == MAP_FAILED) {
+		pcm->mmap_buffer = NULL;
+		return oops(pcm, errno, "cannot map DMA buffer");
+	}
+
+	pcm->mmap_status = pcm->backend->mmap(pcm, page_size, PROT_READ,
+				SNDRV_PCM_MMAP_OFFSET_STATUS);
+
+	if (pcm->mmap_status == MAP_FAILED)
+		pcm->mmap_status = NULL;
+
+	pcm->mmap_control = pcm->backend->mmap(pcm, page_size, prot,
+				SNDRV_PCM_MMAP_OFFSET_CONTROL);
+
+	if (pcm->mmap_control == MAP_FAILED)
+		pcm->mmap_control = NULL;
+
+	/*
+	 * Some architectures (e.g. ARM with non-coherent caches) refuse to
+	 * map status and control records. Fall back to SYNC_PTR ioctl then.
+	 */
+	if (!pcm->mmap_status || !pcm->mmap_control) {
+		if (pcm->mmap_status)
+			pcm->backend->munmap(pcm, pcm->mmap_status, page_size);
+
+		if (pcm->mmap_control)
+			pcm->backend->munmap(pcm, pcm->mmap_control,
+								page_size);
+
+		pcm->sync_ptr = calloc(1, sizeof(*pcm->sync_ptr));
+
+		if (!pcm->sync_ptr)
+			return oops(pcm, ENOMEM, "cannot allocate sync_ptr");
+
+		pcm->mmap_status = &pcm->sync_ptr->s.status;
+		pcm->mmap_control = &pcm->sync_ptr->c.control;
+	}
+
+	pcm->mmap_control->avail_min = 1;
+
+	if (pcm_sync_ptr(pcm, 0))
+		return oops(pcm, errno, "cannot sync pointers");
+
+	return 0;
+}
+
+static void pcm_mmap_release(struct pcm *pcm)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+
+	if (pcm->sync_ptr) {
+		free(pcm->sync_ptr);
+	} else {
+		if (pcm->mmap_status)
+			pcm->backend->munmap(pcm, pcm->mmap_status, page_size);
+
+		if (pcm->mmap_control)
+			pcm->backend->munmap(pcm, pcm->mmap_control,
+								page_size);
+	}
+
+	if (pcm->mmap_buffer)
+		pcm->backend->munmap(pcm, pcm->mmap_buffer,
+				pcm->buffer_size * pcm_frame_size(pcm));
+
+	pcm->sync_ptr = NULL;
+	pcm->mmap_status = NULL;
+	pcm->mmap_control = NULL;
+	pcm->mmap_buffer = NULL;
+}
+
+int pcm_mmap_avail(struct pcm *pcm)
+{
+	int avail, xrun;
+
+	if (!(pcm->flags & PCM_MMAP))
+		return -EINVAL;
+
+	if (!pcm->prepared && pcm_mmap_prepare(pcm))
+		return -1;
+
+	/*
+	 * On xrun the kernel fails SYNC_PTR before copying the status back,
+	 * so the state read from it would still be the stale RUNNING one
+	 */
+	if (pcm_sync_ptr(pcm, SNDRV_PCM_SYNC_PTR_HWSYNC)) {
+		if (errno != EPIPE)
+			return oops(pcm, errno, "cannot sync hw pointer");
+
+		xrun = 1;
+	} else {
+		xrun = (pcm->mmap_status->state == SNDRV_PCM_STATE_XRUN);
+	}
+
+	if (xrun) {
+		/*
+		 * we failed to make our window, try to restart
+		 */
+		pcm->underruns++;
+
+		if (pcm_mmap_prepare(pcm))
+			return -1;
+
+		if (pcm_sync_ptr(pcm, SNDRV_PCM_SYNC_PTR_HWSYNC))
+			return oops(pcm, errno, "cannot sync hw pointer");
+	}
+
+	if (pcm->flags & PCM_IN) {
+		avail = pcm->mmap_status->hw_ptr
+					- pcm->mmap_control->appl_ptr;
+
+		if (avail < 0)
+			avail += pcm->boundary;
+	} else {
+		avail = pcm->mmap_status->hw_ptr + pcm->buffer_size
+					- pcm->mmap_control->appl_ptr;
+
+		if (avail < 0)
+			avail += pcm->boundary;
+		else if ((unsigned)avail >= pcm->boundary)
+			avail -= pcm->boundary;
+	}
+
+	return avail;
+}
+
+int pcm_mmap_begin(struct pcm *pcm, void **areas,
+				unsigned *offset, unsigned *frames)
+{
+	unsigned continuous, copy_frames;
+	int avail;
+
+	avail = pcm_mmap_avail(pcm);
+
+	if (avail < 0)
+		return avail;
+
+	*areas = pcm->mmap_buffer;
+	*offset = pcm->mmap_control->appl_ptr % pcm->buffer_size;
+
+	copy_frames = *frames;
+
+	if (copy_frames > (unsigned)avail)
+		copy_frames = avail;
+
+	continuous = pcm->buffer_size - *offset;
+
+	if (copy_frames > continuous)
+		copy_frames = continuous;
+
+	*frames = copy_frames;
+	return 0;
+}
+
+int pcm_mmap_commit(struct pcm *pcm, unsigned offset, unsigned frames)
+{
+	unsigned appl_ptr = pcm->mmap_control->appl_ptr;
+
+	/* Catches a commit not matching the last pcm_mmap_begin() */
+	if (offset != appl_ptr % pcm->buffer_size)
+		return oops(pcm, EINVAL, "commit at %u, ring is at %u",
+					offset, appl_ptr % pcm->buffer_size);
+
+	appl_ptr += frames;
+
+	if (appl_ptr >= pcm->boundary)
+		appl_ptr -= pcm->boundary;
+
+	pcm->mmap_control->appl_ptr = appl_ptr;
+
+	if (pcm_sync_ptr(pcm, 0))
+		return oops(pcm, errno, "cannot sync appl pointer");
+
+	if ((pcm->flags & PCM_IN) || pcm->running)
+		return 0;
+
+	/* Start playback as soon as the ring is full */
+	if (pcm_mmap_avail(pcm) > 0)
+		return 0;
+
+	if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_START, NULL))
+		return oops(pcm, errno, "cannot start channel");
+
+	pcm->running = 1;
+	return 0;
+}
+
+int pcm_wait(struct pcm *pcm, int timeout)
+{
+	int ret;
+
+	ret = pcm->backend->poll(pcm,
+			(pcm->flags & PCM_IN) ? POLLIN : POLLOUT, timeout);
+
+	if (ret < 0)
+		return oops(pcm, errno, "poll failed");
+
+	if (ret & (POLLERR | POLLNVAL)) {
+		/* xrun, it gets recovered by next pcm_mmap_avail() */
+		errno = EPIPE;
+		oops(pcm, EPIPE, "xrun");
+		return -EPIPE;
+	}
+
+	return ret;
+}
+
+int pcm_mmap_acquire(struct pcm *pcm, void **areas,
+				unsigned *offset, unsigned *frames)
+{
+	int ret;
+
+	if (!(pcm->flags & PCM_MMAP))
+		return -EINVAL;
+
+	for (;;) {
+		ret = pcm_mmap_avail(pcm);
+
+		if (ret < 0)
+			return ret;
+
+		if (ret)
+			break;
+
+		ret = pcm_wait(pcm, PCM_MMAP_TIMEOUT);
+
+		if (ret < 0)
+			return ret;
+
+		if (!ret)
+			return oops(pcm, ETIMEDOUT, "timeout waiting for DMA");
+	}
+
+	if (pcm_mmap_begin(pcm, areas, offset, frames))
+		return -1;
+
+	return 0;
+}
+
+static int pcm_mmap_transfer(struct pcm *pcm, void *data, unsigned count)
+{
+	unsigned frame_size = pcm_frame_size(pcm);
+	unsigned frames = count / frame_size;
+	char *ptr = data;
+
+	while (frames) {
+		unsigned offset, chunk;
+		void *area;
+		char *ring;
+		int ret;
+
+		chunk = frames;
+		ret = pcm_mmap_acquire(pcm, &area, &offset, &chunk);
+
+		/* xrun while waiting, next acquire restarts the channel */
+		if (ret == -EPIPE)
+			continue;
+
+		if (ret)
+			return ret;
+
+		ring = (char *)area + offset * frame_size;
+
+		if (pcm->flags & PCM_IN)
+			memcpy(ptr, ring, chunk * frame_size);
+		else
+			memcpy(ring, ptr, chunk * frame_size);
+
+		if (pcm_mmap_commit(pcm, offset, chunk))
+			return -1;
+
+		ptr += chunk * frame_size;
+		frames -= chunk;
+	}
+
+	return 0;
+}
+
 static struct pcm bad_pcm = {
 	.fd = -1,
+	.backend = &pcm_backend_kernel,
 };
 
 int pcm_close(struct pcm *pcm)
@@ -343,13 +876,102 @@ int pcm_close(struct pcm *pcm)
 	if (pcm == &bad_pcm)
 		return 0;
 
+	if (pcm->flags & PCM_MMAP)
+		pcm_mmap_release(pcm);
+
 	if (pcm->fd >= 0)
-		close(pcm->fd);
+		pcm->backend->close(pcm);
 
 	free(pcm);
 	return 0;
 }
 
+static const char *pcm_device_name(unsigned flags)
+{
+	if (flags & PCM_BT) {
+		if (flags & PCM_IN)
+			return "/dev/snd/pcmC0D1c";
+		else
+			return "/dev/snd/pcmC0D1p";
+	} else {
+		if (flags & PCM_IN)
+			return "/dev/snd/pcmC0D0c";
+		else
+			return "/dev/snd/pcmC0D0p";
+	}
+}
+
+/* Parameters common to pcm_open() and pcm_get_rates() */
+static void pcm_params_init(struct snd_pcm_hw_params *params, unsigned flags)
+{
+	param_init(params);
+	param_set_mask(params, SNDRV_PCM_HW_PARAM_ACCESS,
+		       (flags & PCM_MMAP) ? SNDRV_PCM_ACCESS_MMAP_INTERLEAVED
+					  : SNDRV_PCM_ACCESS_RW_INTERLEAVED);
+	param_set_mask(params, SNDRV_PCM_HW_PARAM_FORMAT,
+		       SNDRV_PCM_FORMAT_S16_LE);
+	param_set_mask(params, SNDRV_PCM_HW_PARAM_SUBFORMAT,
+		       SNDRV_PCM_SUBFORMAT_STD);
+	param_set_int(params, SNDRV_PCM_HW_PARAM_SAMPLE_BITS, 16);
+	param_set_int(params, SNDRV_PCM_HW_PARAM_FRAME_BITS,
+		      (flags & PCM_MONO) ? 16 : 32);
+	param_set_int(params, SNDRV_PCM_HW_PARAM_CHANNELS,
+		      (flags & PCM_MONO) ? 1 : 2);
+}
+
+static const struct pcm_backend *pcm_backend_select(void)
+{
+#ifdef WITH_PCM_SIM
+	if (pcm_sim_selected())
+		return &pcm_backend_sim;
+#endif
+	return &pcm_backend_kernel;
+}
+
+unsigned pcm_get_rates(unsigned flags, unsigned *rates, unsigned count)
+{
+	const char *dname = pcm_device_name(flags);
+	struct snd_pcm_hw_params params;
+	struct pcm *pcm;
+	unsigned found = 0;
+	unsigned i;
+
+	pcm = calloc(1, sizeof(struct pcm));
+
+	if (!pcm)
+		return 0;
+
+	pcm->flags = flags;
+	pcm->backend = pcm_backend_select();
+
+	if (pcm->backend->open(pcm, dname)) {
+		LOGE("pcm_get_rates() cannot open device '%s'", dname);
+		free(pcm);
+		return 0;
+	}
+
+	for (i = 0; i < sizeof(pcm_rates) / sizeof(pcm_rates[0]); ++i) {
+		if (found == count)
+			break;
+
+		pcm_params_init(&params, flags);
+		param_set_int(&params, SNDRV_PCM_HW_PARAM_RATE,
+							pcm_rates[i].rate);
+
+		/* Fails if no configuration is left */
+		if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_HW_REFINE, &params))
+			continue;
+
+		LOGV("pcm_get_rates() %s: %u Hz", dname, pcm_rates[i].rate);
+		rates[found++] = pcm_rates[i].rate;
+	}
+
+	pcm->backend->close(pcm);
+	free(pcm);
+
+	return found;
+}
+
 struct pcm *pcm_open(unsigned flags) {
 	const char *dname;
 	struct pcm *pcm;
@@ -358,27 +980,25 @@ struct pcm *pcm_open(unsigned flags) {
 	struct snd_pcm_sw_params sparams;
 	unsigned period_sz;
 	unsigned period_cnt;
+	unsigned rate;
+	unsigned boundary;
 
 	LOGV("pcm_open(0x%08x)",flags);
 
+	rate = pcm_flags_rate(flags);
+
+	if (!rate) {
+		LOGE("pcm_open() invalid rate flags 0x%08x",
+						flags & PCM_RATE_MASK);
+		return &bad_pcm;
+	}
+
 	pcm = calloc(1, sizeof(struct pcm));
 
 	if (!pcm)
 		return &bad_pcm;
 
-	if (flags & PCM_BT) {
-		if (flags & PCM_IN) {
-			dname = "/dev/snd/pcmC0D1c";
-		} else {
-			dname = "/dev/snd/pcmC0D1p";
-		}
-	} else {
-		if (flags & PCM_IN) {
-			dname = "/dev/snd/pcmC0D0c";
-		} else {
-			dname = "/dev/snd/pcmC0D0p";
-		}
-	}
+	dname = pcm_device_name(flags);
 
 	LOGV("pcm_open() period sz multiplier %d",
 		((flags & PCM_PERIOD_SZ_MASK) >> PCM_PERIOD_SZ_SHIFT) + 1);
@@ -389,60 +1009,58 @@ struct pcm *pcm_open(unsigned flags) {
 	period_cnt = ((flags & PCM_PERIOD_CNT_MASK)
 				>> PCM_PERIOD_CNT_SHIFT) + PCM_PERIOD_CNT_MIN;
 
-	pcm->flags = flags;
-	pcm->fd = open(dname, O_RDWR);
-
-	if (pcm->fd < 0) {
-		oops(pcm, errno, "cannot open device '%s'");
-		return pcm;
-	}
+	/* BT link is clocked by the headset, no DMA ring to map */
+	if (flags & PCM_BT)
+		flags &= ~PCM_MMAP;
 
-	if (flags & PCM_BT) {
-		param_init(&params);
-
-		if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_HW_PARAMS, &params)) {
-			oops(pcm, errno, "cannot set hw params");
-			goto fail;
-		}
+	pcm->flags = flags;
+	pcm->backend = pcm_backend_select();
 
+	if (pcm->backend->open(pcm, dname)) {
+		pcm->fd = -1;
+		oops(pcm, errno, "cannot open device '%s'", dname);
 		return pcm;
 	}
 
-	if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_INFO, &info)) {
+	if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_INFO, &info)) {
 		oops(pcm, errno, "cannot get info - %s");
 		goto fail;
 	}
 
 	info_dump(&info);
 
-	LOGV("pcm_open() period_cnt %d period_sz %d channels %d",
-	     period_cnt, period_sz, (flags & PCM_MONO) ? 1 : 2);
+	LOGV("pcm_open() period_cnt %d period_sz %d channels %d rate %u",
+	     period_cnt, period_sz, (flags & PCM_MONO) ? 1 : 2, rate);
 
-	param_init(&params);
-	param_set_mask(&params, SNDRV_PCM_HW_PARAM_ACCESS,
-		       SNDRV_PCM_ACCESS_RW_INTERLEAVED);
-	param_set_mask(&params, SNDRV_PCM_HW_PARAM_FORMAT,
-		       SNDRV_PCM_FORMAT_S16_LE);
-	param_set_mask(&params, SNDRV_PCM_HW_PARAM_SUBFORMAT,
-		       SNDRV_PCM_SUBFORMAT_STD);
+	pcm_params_init(&params, flags);
 	param_set_min(&params, SNDRV_PCM_HW_PARAM_PERIOD_SIZE, period_sz);
-	param_set_int(&params, SNDRV_PCM_HW_PARAM_SAMPLE_BITS, 16);
-	param_set_int(&params, SNDRV_PCM_HW_PARAM_FRAME_BITS,
-		      (flags & PCM_MONO) ? 16 : 32);
-	param_set_int(&params, SNDRV_PCM_HW_PARAM_CHANNELS,
-		      (flags & PCM_MONO) ? 1 : 2);
 	param_set_int(&params, SNDRV_PCM_HW_PARAM_PERIODS, period_cnt);
-	param_set_int(&params, SNDRV_PCM_HW_PARAM_RATE, 44100);
+	param_set_int(&params, SNDRV_PCM_HW_PARAM_RATE, rate);
 
-	if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_HW_PARAMS, &params)) {
+	if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_HW_PARAMS, &params)) {
 		oops(pcm, errno, "cannot set hw params");
 		goto fail;
 	}
 
 	param_dump(&params);
 
+	/* The driver is free to pick a larger period than requested */
+	if (param_get_int(&params, SNDRV_PCM_HW_PARAM_PERIOD_SIZE))
+		period_sz = param_get_int(&params,
+					SNDRV_PCM_HW_PARAM_PERIOD_SIZE);
+
+	if (param_get_int(&params, SNDRV_PCM_HW_PARAM_PERIODS))
+		period_cnt = param_get_int(&params,
+					SNDRV_PCM_HW_PARAM_PERIODS);
+
+	/* Same as the kernel computes, old kernels do not report it back */
+	boundary = period_cnt * period_sz;
+
+	while (boundary * 2 <= INT_MAX - period_cnt * period_sz)
+		boundary *= 2;
+
 	memset(&sparams, 0, sizeof(sparams));
-	sparams.tstamp_mode = SNDRV_PCM_TSTAMP_NONE;
+	sparams.tstamp_mode = SNDRV_PCM_TSTAMP_ENABLE;
 	sparams.period_step = 1;
 	sparams.avail_min = 1;
 	sparams.start_threshold = period_cnt * period_sz;
@@ -451,17 +1069,43 @@ struct pcm *pcm_open(unsigned flags) {
 	sparams.silence_size = 0;
 	sparams.silence_threshold = 0;
 
-	if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_SW_PARAMS, &sparams)) {
+	if (flags & PCM_BT) {
+		/*
+		 * The SCO link has to keep running when nobody reads it
+		 * (the codec takes the uplink through its own SRC) or the
+		 * feeder falls behind, play silence instead of stale data
+		 */
+		sparams.stop_threshold = boundary;
+
+		if (!(flags & PCM_IN))
+			sparams.silence_size = boundary;
+	}
+
+	if (pcm_ioctl(pcm, SNDRV_PCM_IOCTL_SW_PARAMS, &sparams)) {
 		oops(pcm, errno, "cannot set sw params");
 		goto fail;
 	}
 
+	pcm->period_size = period_sz;
+	pcm->period_cnt = period_cnt;
+	pcm->rate = rate;
 	pcm->buffer_size = period_cnt * period_sz;
+	pcm->boundary = sparams.boundary;
 	pcm->underruns = 0;
+
+	if (!pcm->boundary)
+		pcm->boundary = boundary;
+
+	if ((flags & PCM_MMAP) && pcm_mmap_init(pcm))
+		goto fail;
+
 	return pcm;
 
 fail:
-	close(pcm->fd);
+	if (flags & PCM_MMAP)
+		pcm_mmap_release(pcm);
+
+	pcm->backend->close(pcm);
 	free(pcm);
 	return &bad_pcm;
 }
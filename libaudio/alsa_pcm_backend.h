@@ -0,0 +1,85 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ALSA_PCM_BACKEND_H_
+#define _ALSA_PCM_BACKEND_H_
+
+#include <sys/types.h>
+#include <linux/ioctl.h>
+
+#define __force
+#define __bitwise
+#define __user
+#include "asound.h"
+
+/*
+ * PCM backends
+ *
+ * All pcm_* logic in alsa_pcm.c talks to the sound card through these
+ * operations only, so the kernel driver can be replaced by a simulated
+ * card. The semantics are those of the respective system calls on a
+ * kernel PCM device node.
+ */
+
+struct pcm;
+
+struct pcm_backend {
+	const char *name;
+	/* Opens the device and sets pcm->fd (and pcm->priv if needed) */
+	int (*open)(struct pcm *pcm, const char *dname);
+	int (*close)(struct pcm *pcm);
+	int (*ioctl)(struct pcm *pcm, unsigned request, void *arg);
+	void *(*mmap)(struct pcm *pcm, size_t length, int prot, off_t offset);
+	int (*munmap)(struct pcm *pcm, void *addr, size_t length);
+	/* Returns revents, 0 on timeout or negative value on error */
+	int (*poll)(struct pcm *pcm, short events, int timeout);
+};
+
+extern const struct pcm_backend pcm_backend_kernel;
+
+/* The simulated card is only built in with WITH_PCM_SIM defined */
+#ifdef WITH_PCM_SIM
+extern const struct pcm_backend pcm_backend_sim;
+
+/* Returns non-zero if pcm_open() should use the simulated card. */
+int pcm_sim_selected(void);
+#endif
+
+#define PCM_ERROR_MAX 128
+
+struct pcm {
+	int fd;
+	unsigned flags;
+	int running:1;
+	int prepared:1;
+	int underruns;
+	unsigned buffer_size;
+	unsigned period_size;
+	unsigned period_cnt;
+	unsigned rate;
+	unsigned boundary;
+	/* mmap mode only */
+	void *mmap_buffer;
+	struct snd_pcm_mmap_status *mmap_status;
+	struct snd_pcm_mmap_control *mmap_control;
+	struct snd_pcm_sync_ptr *sync_ptr;
+	const struct pcm_backend *backend;
+	void *priv;
+	char error[PCM_ERROR_MAX];
+};
+
+#endif /* _ALSA_PCM_BACKEND_H_ */
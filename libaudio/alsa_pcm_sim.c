@@ -0,0 +1,846 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulated sound card
+ *
+ * Implements the subset of the kernel PCM interface used by alsa_pcm.c on
+ * top of CLOCK_MONOTONIC, so libaudio can run and be measured on a plain
+ * Linux host. The hardware pointer advances by whole periods at the
+ * configured rate, like a DMA engine raising period interrupts. Playback
+ * consumes the ring and can be recorded to a WAV file, capture fills it
+ * with a test tone. Xruns happen for real when the application is late
+ * and can also be injected.
+ *
+ * Status and control records cannot be mapped, so the mmap transport
+ * uses the SYNC_PTR path.
+ */
+
+#define LOG_TAG "alsa_pcm_sim"
+//#define LOG_NDEBUG 0
+#include <cutils/log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h>
+
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#include "alsa_audio.h"
+#include "alsa_pcm_backend.h"
+
+#define SIM_DEFAULT_RATE	44100
+#define SIM_DEFAULT_CHANNELS	2
+#define SIM_DEFAULT_PERIOD	1024
+#define SIM_DEFAULT_PERIODS	4
+#define SIM_TONE_AMPLITUDE	16384
+#define SIM_RATES_MAX		(sizeof(sim_config.rates) / sizeof(unsigned))
+
+struct sim_pcm {
+	unsigned flags;
+	unsigned rate;
+	unsigned channels;
+	unsigned period_size;
+	unsigned buffer_size;
+	unsigned boundary;
+	snd_pcm_state_t state;
+	/* Free running frame counters */
+	uint64_t hw_ptr;
+	uint64_t appl_ptr;
+	/* hw_ptr and CLOCK_MONOTONIC time at start */
+	uint64_t start_hw;
+	uint64_t start_ns;
+	uint64_t periods;
+	struct timespec tstamp;
+	struct timespec trigger_tstamp;
+	int16_t *ring;
+	double tone_phase;
+	volatile int xrun_req;
+	/* stop_threshold at boundary, xruns do not stop the stream */
+	int free_run;
+	/* Recorded playback */
+	FILE *wav;
+	uint32_t wav_frames;
+	char name[32];
+};
+
+static struct pcm_sim_config sim_config;
+static int sim_selected = -1;
+static int sim_count;
+
+static uint64_t sim_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sim_sleep_until(uint64_t ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+								== EINTR)
+		;
+}
+
+void pcm_sim_enable(const struct pcm_sim_config *config)
+{
+	if (config) {
+		sim_config = *config;
+		sim_selected = 1;
+	} else {
+		sim_selected = 0;
+	}
+}
+
+int pcm_sim_selected(void)
+{
+	const char *env;
+
+	if (sim_selected >= 0)
+		return sim_selected;
+
+	/* Lets unmodified clients run on the simulated card */
+	sim_selected = getenv("ALSA_PCM_SIM") != NULL;
+
+	if (!sim_selected)
+		return 0;
+
+	sim_config.wav_prefix = getenv("ALSA_PCM_SIM_WAV");
+
+	env = getenv("ALSA_PCM_SIM_XRUN");
+
+	if (env)
+		sim_config.xrun_interval = atoi(env);
+
+	env = getenv("ALSA_PCM_SIM_TONE");
+	sim_config.tone = env ? (unsigned)atoi(env) : 1000;
+
+	sim_config.loopback = getenv("ALSA_PCM_SIM_LOOPBACK") != NULL;
+
+	env = getenv("ALSA_PCM_SIM_RATES");
+
+	if (env) {
+		unsigned n = 0;
+		char *end;
+
+		while (*env && n < SIM_RATES_MAX - 1) {
+			sim_config.rates[n] = strtoul(env, &end, 10);
+
+			if (end == env)
+				break;
+
+			if (sim_config.rates[n])
+				++n;
+
+			env = (*end == ',') ? end + 1 : end;
+		}
+	}
+
+	return 1;
+}
+
+void pcm_sim_inject_xrun(struct pcm *pcm)
+{
+	struct sim_pcm *sim = pcm->priv;
+
+	if (pcm->backend != &pcm_backend_sim || !sim)
+		return;
+
+	sim->xrun_req = 1;
+}
+
+/*
+ * WAV recording
+ */
+
+static void sim_put_le32(unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static void sim_wav_header(struct sim_pcm *sim)
+{
+	unsigned char hdr[44];
+	unsigned frame_size = 2 * sim->channels;
+	uint32_t data_size = sim->wav_frames * frame_size;
+
+	memcpy(hdr, "RIFF", 4);
+	sim_put_le32(hdr + 4, 36 + data_size);
+	memcpy(hdr + 8, "WAVEfmt ", 8);
+	sim_put_le32(hdr + 16, 16);
+	/* PCM format tag, channels */
+	sim_put_le32(hdr + 20, 1 | (sim->channels << 16));
+	sim_put_le32(hdr + 24, sim->rate);
+	sim_put_le32(hdr + 28, sim->rate * frame_size);
+	/* block align, bits per sample */
+	sim_put_le32(hdr + 32, frame_size | (16 << 16));
+	memcpy(hdr + 36, "data", 4);
+	sim_put_le32(hdr + 40, data_size);
+
+	fseek(sim->wav, 0, SEEK_SET);
+	fwrite(hdr, sizeof(hdr), 1, sim->wav);
+	fseek(sim->wav, 0, SEEK_END);
+}
+
+static void sim_wav_open(struct sim_pcm *sim)
+{
+	char path[PATH_MAX];
+
+	if (!sim_config.wav_prefix || (sim->flags & PCM_IN) || sim->wav)
+		return;
+
+	snprintf(path, sizeof(path), "%s-%s-%d.wav",
+				sim_config.wav_prefix, sim->name, sim_count);
+
+	sim->wav = fopen(path, "wb");
+
+	if (!sim->wav) {
+		LOGE("cannot create %s: %s", path, strerror(errno));
+		return;
+	}
+
+	sim->wav_frames = 0;
+	sim_wav_header(sim);
+}
+
+static void sim_wav_close(struct sim_pcm *sim)
+{
+	if (!sim->wav)
+		return;
+
+	sim_wav_header(sim);
+	fclose(sim->wav);
+	sim->wav = NULL;
+}
+
+/*
+ * DMA engine
+ */
+
+static inline unsigned sim_avail(struct sim_pcm *sim)
+{
+	if (sim->flags & PCM_IN)
+		return sim->hw_ptr - sim->appl_ptr;
+
+	return sim->hw_ptr + sim->buffer_size - sim->appl_ptr;
+}
+
+/*
+ * Loopback line, indexed by time in frames. Playback puts the first channel
+ * of its frames on it as they are queued, at the time they are going to be
+ * played, so capture finds them there whichever stream gets updated first.
+ * Capture takes them off the line at the time they are recorded. Streams
+ * are not synchronised, just like a cable between two sound cards.
+ */
+#define SIM_LOOP_FRAMES		65536
+
+static int16_t sim_loop[SIM_LOOP_FRAMES];
+
+/* Position of the frame at ptr on the loopback line */
+static unsigned sim_loop_pos(struct sim_pcm *sim, uint64_t ptr)
+{
+	uint64_t us = (sim->start_ns + (ptr - sim->start_hw)
+				* 1000000000ULL / sim->rate) / 1000;
+
+	return (us * sim->rate / 1000000) % SIM_LOOP_FRAMES;
+}
+
+/* Puts queued playback frames from ptr to end on the loopback line */
+static void sim_loop_play(struct sim_pcm *sim, uint64_t ptr, uint64_t end)
+{
+	unsigned pos;
+
+	if (!sim_config.loopback || (sim->flags & PCM_IN)
+	    || sim->state != SNDRV_PCM_STATE_RUNNING || ptr >= end)
+		return;
+
+	pos = sim_loop_pos(sim, ptr);
+
+	for (; ptr < end; ++ptr, pos = (pos + 1) % SIM_LOOP_FRAMES)
+		sim_loop[pos] = sim->ring[(ptr % sim->buffer_size)
+							* sim->channels];
+}
+
+/* Plays back or records one period at the hardware pointer. */
+static void sim_period(struct sim_pcm *sim)
+{
+	unsigned offset = sim->hw_ptr % sim->buffer_size;
+	int16_t *ring = sim->ring + offset * sim->channels;
+	unsigned loop = 0;
+	unsigned n, ch;
+
+	if (!(sim->flags & PCM_IN)) {
+		if (sim->wav) {
+			fwrite(ring, 2 * sim->channels, sim->period_size,
+								sim->wav);
+			sim->wav_frames += sim->period_size;
+		}
+
+		return;
+	}
+
+	if (sim_config.loopback)
+		loop = sim_loop_pos(sim, sim->hw_ptr);
+
+	for (n = 0; n < sim->period_size; ++n) {
+		int16_t sample = 0;
+
+		if (sim_config.loopback) {
+			sample = sim_loop[loop];
+			sim_loop[loop] = 0;
+			loop = (loop + 1) % SIM_LOOP_FRAMES;
+		} else if (sim_config.tone) {
+			sample = SIM_TONE_AMPLITUDE * sin(sim->tone_phase);
+			sim->tone_phase += 2 * M_PI * sim_config.tone
+								/ sim->rate;
+
+			if (sim->tone_phase > 2 * M_PI)
+				sim->tone_phase -= 2 * M_PI;
+		}
+
+		for (ch = 0; ch < sim->channels; ++ch)
+			*ring++ = sample;
+	}
+}
+
+/* Advances the hardware pointer to the current time. */
+static void sim_update(struct sim_pcm *sim)
+{
+	uint64_t now, elapsed, target, boundary_ns;
+	struct timespec rt;
+
+	if (sim->state != SNDRV_PCM_STATE_RUNNING)
+		return;
+
+	now = sim_now();
+	elapsed = (now - sim->start_ns) * sim->rate / 1000000000ULL;
+	target = sim->start_hw
+			+ elapsed / sim->period_size * sim->period_size;
+
+	if (target == sim->hw_ptr)
+		return;
+
+	while (sim->hw_ptr < target) {
+		++sim->periods;
+
+		if (sim->xrun_req || (sim_config.xrun_interval
+		    && !(sim->periods % sim_config.xrun_interval))) {
+			LOGV("%s: injected xrun", sim->name);
+			sim->xrun_req = 0;
+			sim->state = SNDRV_PCM_STATE_XRUN;
+			break;
+		}
+
+		/* Playback ran out of data */
+		if (!(sim->flags & PCM_IN)
+		    && sim->hw_ptr + sim->period_size > sim->appl_ptr) {
+			if (!sim->free_run) {
+				sim->state = SNDRV_PCM_STATE_XRUN;
+				break;
+			}
+
+			/* Plays silence, the application catches up */
+			memset(sim->ring + (sim->hw_ptr % sim->buffer_size)
+					* sim->channels, 0,
+					2 * sim->channels * sim->period_size);
+			sim->appl_ptr = sim->hw_ptr + sim->period_size;
+			sim_loop_play(sim, sim->hw_ptr, sim->appl_ptr);
+		}
+
+		sim_period(sim);
+		sim->hw_ptr += sim->period_size;
+
+		/* Capture ring full */
+		if ((sim->flags & PCM_IN)
+		    && sim_avail(sim) >= sim->buffer_size) {
+			if (!sim->free_run) {
+				sim->state = SNDRV_PCM_STATE_XRUN;
+				break;
+			}
+
+			/* Oldest period gets overwritten */
+			sim->appl_ptr += sim->period_size;
+		}
+	}
+
+	/* Time stamp of the last period boundary, in gettimeofday() time */
+	boundary_ns = sim->start_ns + (sim->hw_ptr - sim->start_hw)
+					* 1000000000ULL / sim->rate;
+	clock_gettime(CLOCK_REALTIME, &rt);
+	boundary_ns = rt.tv_sec * 1000000000ULL + rt.tv_nsec
+					- (now - boundary_ns);
+	sim->tstamp.tv_sec = boundary_ns / 1000000000ULL;
+	sim->tstamp.tv_nsec = boundary_ns % 1000000000ULL;
+}
+
+/* Sleeps until the hardware pointer moves, at most until deadline. */
+static void sim_wait(struct sim_pcm *sim, uint64_t deadline)
+{
+	uint64_t next = sim->start_ns + (sim->hw_ptr - sim->start_hw
+			+ sim->period_size) * 1000000000ULL / sim->rate;
+
+	if (deadline && deadline < next)
+		next = deadline;
+
+	sim_sleep_until(next);
+}
+
+static void sim_start(struct sim_pcm *sim)
+{
+	sim->state = SNDRV_PCM_STATE_RUNNING;
+	sim->start_hw = sim->hw_ptr;
+	sim->start_ns = sim_now();
+	clock_gettime(CLOCK_REALTIME, &sim->trigger_tstamp);
+	sim->tstamp = sim->trigger_tstamp;
+	sim_loop_play(sim, sim->hw_ptr, sim->appl_ptr);
+}
+
+static void sim_copy(struct sim_pcm *sim, char *data, unsigned frames)
+{
+	unsigned frame_size = 2 * sim->channels;
+
+	while (frames) {
+		unsigned offset = sim->appl_ptr % sim->buffer_size;
+		unsigned chunk = sim->buffer_size - offset;
+		char *ring = (char *)sim->ring + offset * frame_size;
+
+		if (chunk > frames)
+			chunk = frames;
+
+		if (sim->flags & PCM_IN)
+			memcpy(data, ring, chunk * frame_size);
+		else
+			memcpy(ring, data, chunk * frame_size);
+
+		data += chunk * frame_size;
+		sim_loop_play(sim, sim->appl_ptr, sim->appl_ptr + chunk);
+		sim->appl_ptr += chunk;
+		frames -= chunk;
+	}
+}
+
+static int sim_transfer(struct sim_pcm *sim, struct snd_xferi *x)
+{
+	char *data = x->buf;
+	unsigned frames = x->frames;
+
+	if (sim->state == SNDRV_PCM_STATE_PREPARED && (sim->flags & PCM_IN))
+		sim_start(sim);
+
+	while (frames) {
+		unsigned avail;
+
+		sim_update(sim);
+
+		if (sim->state == SNDRV_PCM_STATE_XRUN) {
+			errno = EPIPE;
+			return -1;
+		}
+
+		if (sim->state != SNDRV_PCM_STATE_PREPARED
+		    && sim->state != SNDRV_PCM_STATE_RUNNING) {
+			errno = EBADFD;
+			return -1;
+		}
+
+		avail = sim_avail(sim);
+
+		if (!avail) {
+			sim_wait(sim, 0);
+			continue;
+		}
+
+		if (avail > frames)
+			avail = frames;
+
+		sim_copy(sim, data, avail);
+		data += avail * 2 * sim->channels;
+		frames -= avail;
+
+		/* start_threshold is the whole buffer */
+		if (sim->state == SNDRV_PCM_STATE_PREPARED
+		    && !sim_avail(sim))
+			sim_start(sim);
+	}
+
+	x->result = x->frames;
+	return 0;
+}
+
+/*
+ * Backend operations
+ */
+
+static struct snd_interval *sim_interval(struct snd_pcm_hw_params *p, int n)
+{
+	return &p->intervals[n - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL];
+}
+
+static unsigned sim_param(struct snd_pcm_hw_params *p, int n, unsigned def)
+{
+	struct snd_interval *i = sim_interval(p, n);
+
+	return i->min ? i->min : def;
+}
+
+static void sim_param_set(struct snd_pcm_hw_params *p, int n, unsigned val)
+{
+	struct snd_interval *i = sim_interval(p, n);
+
+	i->min = val;
+	i->max = val;
+	i->integer = 1;
+}
+
+/* Returns the lowest accepted rate within the interval, 0 if there is none */
+static unsigned sim_refine_rate(struct snd_pcm_hw_params *p)
+{
+	struct snd_interval *i = sim_interval(p, SNDRV_PCM_HW_PARAM_RATE);
+	unsigned min = i->min ? i->min : SIM_DEFAULT_RATE;
+	unsigned best = 0;
+	unsigned n;
+
+	if (!sim_config.rates[0])
+		return (min <= i->max) ? min : 0;
+
+	for (n = 0; n < SIM_RATES_MAX && sim_config.rates[n]; ++n) {
+		unsigned rate = sim_config.rates[n];
+
+		if (rate >= min && rate <= i->max && (!best || rate < best))
+			best = rate;
+	}
+
+	return best;
+}
+
+static int sim_hw_refine(struct snd_pcm_hw_params *p)
+{
+	struct snd_interval *i = sim_interval(p, SNDRV_PCM_HW_PARAM_RATE);
+	unsigned rate = sim_refine_rate(p);
+
+	if (!rate) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	i->min = rate;
+	return 0;
+}
+
+static int sim_hw_params(struct sim_pcm *sim, struct snd_pcm_hw_params *p)
+{
+	unsigned periods;
+
+	sim->channels = sim_param(p, SNDRV_PCM_HW_PARAM_CHANNELS,
+							SIM_DEFAULT_CHANNELS);
+	sim->rate = sim_refine_rate(p);
+
+	if (!sim->rate) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	sim->period_size = sim_param(p, SNDRV_PCM_HW_PARAM_PERIOD_SIZE,
+							SIM_DEFAULT_PERIOD);
+	periods = sim_param(p, SNDRV_PCM_HW_PARAM_PERIODS,
+							SIM_DEFAULT_PERIODS);
+	sim->buffer_size = periods * sim->period_size;
+
+	sim_param_set(p, SNDRV_PCM_HW_PARAM_CHANNELS, sim->channels);
+	sim_param_set(p, SNDRV_PCM_HW_PARAM_RATE, sim->rate);
+	sim_param_set(p, SNDRV_PCM_HW_PARAM_PERIOD_SIZE, sim->period_size);
+	sim_param_set(p, SNDRV_PCM_HW_PARAM_PERIODS, periods);
+	sim_param_set(p, SNDRV_PCM_HW_PARAM_BUFFER_SIZE, sim->buffer_size);
+
+	free(sim->ring);
+	sim->ring = calloc(sim->buffer_size, 2 * sim->channels);
+
+	if (!sim->ring) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	sim->boundary = sim->buffer_size;
+
+	while (sim->boundary * 2 <= INT_MAX - sim->buffer_size)
+		sim->boundary *= 2;
+
+	sim->state = SNDRV_PCM_STATE_SETUP;
+	sim_wav_open(sim);
+
+	LOGV("%s: %u Hz, %u channels, %u x %u frames", sim->name, sim->rate,
+				sim->channels, periods, sim->period_size);
+
+	return 0;
+}
+
+static int sim_sync_ptr(struct sim_pcm *sim, struct snd_pcm_sync_ptr *sp)
+{
+	/*
+	 * Like snd_pcm_sync_ptr(), an xrun fails the call before anything
+	 * is applied or copied back
+	 */
+	if (sp->flags & SNDRV_PCM_SYNC_PTR_HWSYNC) {
+		sim_update(sim);
+
+		if (sim->state == SNDRV_PCM_STATE_XRUN) {
+			errno = EPIPE;
+			return -1;
+		}
+	}
+
+	if (!(sp->flags & SNDRV_PCM_SYNC_PTR_APPL)) {
+		/* Unwrap the application pointer */
+		unsigned cur = sim->appl_ptr % sim->boundary;
+		unsigned appl = sp->c.control.appl_ptr;
+		uint64_t prev = sim->appl_ptr;
+
+		sim->appl_ptr += (appl + sim->boundary - cur) % sim->boundary;
+		sim_loop_play(sim, prev, sim->appl_ptr);
+	}
+
+	sp->s.status.state = sim->state;
+	sp->s.status.hw_ptr = sim->hw_ptr % sim->boundary;
+	sp->s.status.tstamp = sim->tstamp;
+	sp->c.control.appl_ptr = sim->appl_ptr % sim->boundary;
+
+	return 0;
+}
+
+static void sim_status(struct sim_pcm *sim, struct snd_pcm_status *status)
+{
+	unsigned avail;
+
+	sim_update(sim);
+
+	avail = sim_avail(sim);
+	memset(status, 0, sizeof(*status));
+	status->state = sim->state;
+	status->trigger_tstamp = sim->trigger_tstamp;
+	status->tstamp = sim->tstamp;
+	status->appl_ptr = sim->appl_ptr % sim->boundary;
+	status->hw_ptr = sim->hw_ptr % sim->boundary;
+	status->avail = avail;
+	status->avail_max = avail;
+	status->delay = (sim->flags & PCM_IN) ? avail
+					: sim->buffer_size - avail;
+}
+
+static int sim_open(struct pcm *pcm, const char *dname)
+{
+	struct sim_pcm *sim;
+	const char *name = strrchr(dname, '/');
+
+	sim = calloc(1, sizeof(*sim));
+
+	if (!sim) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	snprintf(sim->name, sizeof(sim->name), "%s", name ? name + 1 : dname);
+	sim->flags = pcm->flags;
+	sim->state = SNDRV_PCM_STATE_OPEN;
+
+	pcm->priv = sim;
+	pcm->fd = sim_count++;
+
+	LOGV("%s: opened on simulated card", sim->name);
+
+	return 0;
+}
+
+static int sim_close(struct pcm *pcm)
+{
+	struct sim_pcm *sim = pcm->priv;
+
+	if (!sim)
+		return 0;
+
+	sim_wav_close(sim);
+	free(sim->ring);
+	free(sim);
+	pcm->priv = NULL;
+
+	return 0;
+}
+
+static int sim_ioctl(struct pcm *pcm, unsigned request, void *arg)
+{
+	struct sim_pcm *sim = pcm->priv;
+	struct snd_pcm_sw_params *sp;
+
+	switch (request) {
+	case SNDRV_PCM_IOCTL_INFO:
+		memset(arg, 0, sizeof(struct snd_pcm_info));
+		return 0;
+
+	case SNDRV_PCM_IOCTL_HW_REFINE:
+		return sim_hw_refine(arg);
+
+	case SNDRV_PCM_IOCTL_HW_PARAMS:
+		return sim_hw_params(sim, arg);
+
+	case SNDRV_PCM_IOCTL_SW_PARAMS:
+		sp = arg;
+		sim->free_run = sp->stop_threshold >= sim->boundary;
+		sp->boundary = sim->boundary;
+		return 0;
+
+	case SNDRV_PCM_IOCTL_PREPARE:
+		if (!sim->ring)
+			break;
+
+		sim->state = SNDRV_PCM_STATE_PREPARED;
+		sim->hw_ptr = 0;
+		sim->appl_ptr = 0;
+		return 0;
+
+	case SNDRV_PCM_IOCTL_START:
+		if (sim->state != SNDRV_PCM_STATE_PREPARED)
+			break;
+
+		sim_start(sim);
+		return 0;
+
+	case SNDRV_PCM_IOCTL_DROP:
+		if (sim->ring)
+			sim->state = SNDRV_PCM_STATE_SETUP;
+
+		return 0;
+
+	case SNDRV_PCM_IOCTL_HWSYNC:
+		sim_update(sim);
+
+		if (sim->state == SNDRV_PCM_STATE_XRUN) {
+			errno = EPIPE;
+			return -1;
+		}
+
+		return 0;
+
+	case SNDRV_PCM_IOCTL_SYNC_PTR:
+		return sim_sync_ptr(sim, arg);
+
+	case SNDRV_PCM_IOCTL_STATUS:
+		sim_status(sim, arg);
+		return 0;
+
+	case SNDRV_PCM_IOCTL_WRITEI_FRAMES:
+	case SNDRV_PCM_IOCTL_READI_FRAMES:
+		return sim_transfer(sim, arg);
+
+	default:
+		errno = ENOTTY;
+		return -1;
+	}
+
+	errno = EBADFD;
+	return -1;
+}
+
+static void *sim_mmap(struct pcm *pcm, size_t length, int prot, off_t offset)
+{
+	struct sim_pcm *sim = pcm->priv;
+
+	/* The ring is always read and write */
+	(void)prot;
+
+	if (offset != SNDRV_PCM_MMAP_OFFSET_DATA || !sim->ring
+	    || length > sim->buffer_size * 2 * sim->channels) {
+		errno = ENXIO;
+		return MAP_FAILED;
+	}
+
+	return sim->ring;
+}
+
+static int sim_munmap(struct pcm *pcm, void *addr, size_t length)
+{
+	struct sim_pcm *sim = pcm->priv;
+
+	(void)length;
+
+	/* The ring is freed on close */
+	if (addr != sim->ring) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int sim_poll(struct pcm *pcm, short events, int timeout)
+{
+	struct sim_pcm *sim = pcm->priv;
+	uint64_t deadline = 0;
+
+	if (timeout >= 0)
+		deadline = sim_now() + timeout * 1000000ULL;
+
+	for (;;) {
+		sim_update(sim);
+
+		if (sim->state == SNDRV_PCM_STATE_XRUN)
+			return POLLERR;
+
+		if (sim->state == SNDRV_PCM_STATE_RUNNING
+		    || sim->state == SNDRV_PCM_STATE_PREPARED) {
+			if (sim_avail(sim))
+				return events;
+		}
+
+		if (sim->state != SNDRV_PCM_STATE_RUNNING) {
+			/* Nothing will ever change */
+			if (deadline)
+				sim_sleep_until(deadline);
+
+			return 0;
+		}
+
+		if (deadline && sim_now() >= deadline)
+			return 0;
+
+		sim_wait(sim, deadline);
+	}
+}
+
+const struct pcm_backend pcm_backend_sim = {
+	.name = "sim",
+	.open = sim_open,
+	.close = sim_close,
+	.ioctl = sim_ioctl,
+	.mmap = sim_mmap,
+	.munmap = sim_munmap,
+	.poll = sim_poll,
+};
@@ -0,0 +1,420 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+/*
+ * Full duplex benchmark of the pcm layer, for picking the period geometry
+ * of a board. Playback has to be looped back to capture, with a cable on
+ * real hardware or ALSA_PCM_SIM_LOOPBACK on the simulated card.
+ *
+ * For every geometry tested it prints one line per test, as space
+ * separated key=value pairs:
+ *
+ *   latency    impulse written to impulse read back, in ms, as seen by
+ *              an application writing and reading whole periods, next
+ *              to the playback buffer length
+ *   throughput frames moved in both directions over a few seconds,
+ *              relative to the nominal rate, xruns and CPU time used
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "alsa_audio.h"
+
+#define IMPULSE_FRAMES		32
+#define IMPULSE_AMPLITUDE	16384
+
+static const unsigned sweep_mult[] = { 1, 2, 4, 8, 16, 32 };
+static const unsigned sweep_cnt[] = { 2, 4 };
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+struct bench {
+	unsigned rate;
+	unsigned mmap;
+	unsigned mono;
+	unsigned seconds;
+	unsigned runs;
+	unsigned threshold;
+};
+
+struct duplex {
+	struct pcm *out;
+	struct pcm *in;
+	unsigned period;
+	unsigned in_channels;
+	int16_t *out_buf;
+	int16_t *in_buf;
+};
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static double cpu_ms(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000.0
+			+ (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000.0;
+}
+
+static void duplex_close(struct duplex *d)
+{
+	pcm_close(d->out);
+	pcm_close(d->in);
+	free(d->out_buf);
+	free(d->in_buf);
+	memset(d, 0, sizeof(*d));
+}
+
+static int duplex_open(struct duplex *d, const struct bench *b,
+						unsigned mult, unsigned cnt)
+{
+	unsigned flags;
+
+	memset(d, 0, sizeof(*d));
+
+	flags = pcm_rate_flags(b->rate)
+		| ((mult - 1) << PCM_PERIOD_SZ_SHIFT)
+		| ((cnt - PCM_PERIOD_CNT_MIN) << PCM_PERIOD_CNT_SHIFT);
+
+	if (b->mmap)
+		flags |= PCM_MMAP;
+
+	d->out = pcm_open(PCM_OUT | PCM_STEREO | flags);
+
+	if (!pcm_ready(d->out)) {
+		fprintf(stderr, "alsabench: cannot open output: %s\n",
+							pcm_error(d->out));
+		goto fail;
+	}
+
+	d->in = pcm_open(PCM_IN | (b->mono ? PCM_MONO : PCM_STEREO) | flags);
+
+	if (!pcm_ready(d->in)) {
+		fprintf(stderr, "alsabench: cannot open input: %s\n",
+							pcm_error(d->in));
+		goto fail;
+	}
+
+	d->period = pcm_period_size(d->out);
+	d->in_channels = b->mono ? 1 : 2;
+
+	if (pcm_period_size(d->in) != d->period
+	    || pcm_rate(d->in) != pcm_rate(d->out)) {
+		fprintf(stderr, "alsabench: input got %u frames at %u hz, "
+				"output %u frames at %u hz\n",
+				pcm_period_size(d->in), pcm_rate(d->in),
+				d->period, pcm_rate(d->out));
+		goto fail;
+	}
+
+	d->out_buf = calloc(d->period, 2 * sizeof(int16_t));
+	d->in_buf = calloc(d->period, d->in_channels * sizeof(int16_t));
+
+	if (!d->out_buf || !d->in_buf) {
+		fprintf(stderr, "alsabench: out of memory\n");
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	duplex_close(d);
+	return -1;
+}
+
+/* Fills the playback buffer with silence, which starts it */
+static int duplex_prime(struct duplex *d)
+{
+	unsigned n;
+
+	memset(d->out_buf, 0, d->period * 2 * sizeof(int16_t));
+
+	for (n = 0; n < pcm_period_count(d->out); ++n)
+		if (pcm_write(d->out, d->out_buf,
+					d->period * 2 * sizeof(int16_t)))
+			return -1;
+
+	return 0;
+}
+
+/*
+ * One period each way. Both directions block in turn and run from the
+ * same clock, so this keeps the playback buffer full and capture empty.
+ */
+static int duplex_cycle(struct duplex *d)
+{
+	if (pcm_write(d->out, d->out_buf, d->period * 2 * sizeof(int16_t))) {
+		fprintf(stderr, "alsabench: write failed: %s\n",
+							pcm_error(d->out));
+		return -1;
+	}
+
+	if (pcm_read(d->in, d->in_buf,
+				d->period * d->in_channels * sizeof(int16_t))) {
+		fprintf(stderr, "alsabench: read failed: %s\n",
+							pcm_error(d->in));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Index of the first frame above the threshold, -1 if there is none */
+static int find_impulse(const struct duplex *d, unsigned threshold)
+{
+	unsigned n;
+
+	for (n = 0; n < d->period; ++n) {
+		int sample = d->in_buf[n * d->in_channels];
+
+		if ((unsigned)abs(sample) >= threshold)
+			return n;
+	}
+
+	return -1;
+}
+
+static int bench_latency(const struct bench *b, unsigned mult, unsigned cnt)
+{
+	struct duplex d;
+	double sent, ms, min = 0, max = 0, sum = 0;
+	unsigned run, n, frames, found = 0;
+	int pos;
+
+	if (duplex_open(&d, b, mult, cnt))
+		return -1;
+
+	if (duplex_prime(&d))
+		goto fail;
+
+	for (run = 0; run < b->runs; ++run) {
+		/* Let anything left of the previous impulse die out */
+		memset(d.out_buf, 0, d.period * 2 * sizeof(int16_t));
+
+		for (n = 0; n < 2 * cnt + 2; ++n)
+			if (duplex_cycle(&d))
+				goto fail;
+
+		for (n = 0; n < IMPULSE_FRAMES && n < d.period; ++n) {
+			d.out_buf[2 * n] = IMPULSE_AMPLITUDE;
+			d.out_buf[2 * n + 1] = IMPULSE_AMPLITUDE;
+		}
+
+		sent = now_ms();
+
+		if (duplex_cycle(&d))
+			goto fail;
+
+		memset(d.out_buf, 0, d.period * 2 * sizeof(int16_t));
+		pos = find_impulse(&d, b->threshold);
+
+		/* Give up after a second */
+		for (frames = d.period; pos < 0 && frames < b->rate;
+							frames += d.period) {
+			if (duplex_cycle(&d))
+				goto fail;
+
+			pos = find_impulse(&d, b->threshold);
+		}
+
+		if (pos < 0)
+			continue;
+
+		ms = now_ms() - sent;
+
+		if (!found || ms < min)
+			min = ms;
+
+		if (!found || ms > max)
+			max = ms;
+
+		sum += ms;
+		++found;
+	}
+
+	printf("latency rate=%u period=%u periods=%u runs=%u missed=%u "
+		"min_ms=%.2f avg_ms=%.2f max_ms=%.2f buffer_ms=%.2f\n",
+		pcm_rate(d.out), d.period, pcm_period_count(d.out), b->runs,
+		b->runs - found, min, found ? sum / found : 0.0, max,
+		d.period * pcm_period_count(d.out) * 1000.0 / pcm_rate(d.out));
+
+	duplex_close(&d);
+	return 0;
+
+fail:
+	duplex_close(&d);
+	return -1;
+}
+
+static int bench_throughput(const struct bench *b, unsigned mult, unsigned cnt)
+{
+	struct duplex d;
+	double start, elapsed, cpu;
+	unsigned long frames = 0, total;
+
+	if (duplex_open(&d, b, mult, cnt))
+		return -1;
+
+	/* Timing starts once both directions run */
+	if (duplex_prime(&d) || duplex_cycle(&d))
+		goto fail;
+
+	total = (unsigned long)b->seconds * pcm_rate(d.out);
+	start = now_ms();
+	cpu = cpu_ms();
+
+	while (frames < total) {
+		if (duplex_cycle(&d))
+			goto fail;
+
+		frames += d.period;
+	}
+
+	elapsed = now_ms() - start;
+	cpu = cpu_ms() - cpu;
+
+	printf("throughput rate=%u period=%u periods=%u frames=%lu "
+		"ratio=%.4f out_xruns=%u in_xruns=%u cpu_pct=%.2f\n",
+		pcm_rate(d.out), d.period, pcm_period_count(d.out), frames,
+		frames * 1000.0 / elapsed / pcm_rate(d.out),
+		pcm_get_xruns(d.out), pcm_get_xruns(d.in),
+		100.0 * cpu / elapsed);
+
+	duplex_close(&d);
+	return 0;
+
+fail:
+	duplex_close(&d);
+	return -1;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: alsabench [-r rate] [-p period_mult] [-n period_cnt]\n"
+		"                 [-t seconds] [-i runs] [-T threshold]"
+		" [-m] [-M] [-l|-x]\n"
+		"  -p, -n  period geometry, all of them if not given\n"
+		"  -m      use mmap\n"
+		"  -M      capture mono\n"
+		"  -l      latency test only\n"
+		"  -x      throughput test only\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct bench b;
+	unsigned mult = 0, cnt = 0;
+	int latency = 1, throughput = 1;
+	unsigned i, j;
+	int opt, ret = 0;
+
+	b.rate = 44100;
+	b.mmap = 0;
+	b.mono = 0;
+	b.seconds = 5;
+	b.runs = 10;
+	b.threshold = IMPULSE_AMPLITUDE / 4;
+
+	while ((opt = getopt(argc, argv, "r:p:n:t:i:T:mMlx")) != -1) {
+		switch (opt) {
+		case 'r':
+			b.rate = atoi(optarg);
+			break;
+		case 'p':
+			mult = atoi(optarg);
+			break;
+		case 'n':
+			cnt = atoi(optarg);
+			break;
+		case 't':
+			b.seconds = atoi(optarg);
+			break;
+		case 'i':
+			b.runs = atoi(optarg);
+			break;
+		case 'T':
+			b.threshold = atoi(optarg);
+			break;
+		case 'm':
+			b.mmap = 1;
+			break;
+		case 'M':
+			b.mono = 1;
+			break;
+		case 'l':
+			throughput = 0;
+			break;
+		case 'x':
+			latency = 0;
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+
+	if (pcm_rate_flags(b.rate) < 0) {
+		fprintf(stderr, "alsabench: unsupported rate %u hz\n", b.rate);
+		return -1;
+	}
+
+	if ((mult && (mult > 1 + (PCM_PERIOD_SZ_MASK >> PCM_PERIOD_SZ_SHIFT)))
+	    || (cnt && (cnt < PCM_PERIOD_CNT_MIN || cnt > PCM_PERIOD_CNT_MIN
+			+ (PCM_PERIOD_CNT_MASK >> PCM_PERIOD_CNT_SHIFT)))) {
+		fprintf(stderr, "alsabench: invalid period geometry\n");
+		return -1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(sweep_mult); ++i) {
+		unsigned m = mult ? mult : sweep_mult[i];
+
+		for (j = 0; j < ARRAY_SIZE(sweep_cnt); ++j) {
+			unsigned c = cnt ? cnt : sweep_cnt[j];
+
+			if (latency && bench_latency(&b, m, c))
+				ret = -1;
+
+			if (throughput && bench_throughput(&b, m, c))
+				ret = -1;
+
+			fflush(stdout);
+
+			if (cnt)
+				break;
+		}
+
+		if (mult)
+			break;
+	}
+
+	return ret;
+}
@@ -53,6 +53,14 @@ int play_file(unsigned rate, unsigned channels, int fd, unsigned count)
 	ssize_t bufsize;
 	char *data;
 	unsigned flags = PCM_OUT;
+	int rate_flags = pcm_rate_flags(rate);
+
+	if (rate_flags < 0) {
+		fprintf(stderr, "aplay: unsupported rate %u hz\n", rate);
+		return -1;
+	}
+
+	flags |= rate_flags;
 
 	if (channels == 1)
 		flags |= PCM_MONO;
@@ -18,8 +18,8 @@
 #ifndef _ALSA_SOC_AUDIO_CONFIG_H
 #define _ALSA_SOC_AUDIO_CONFIG_H
 
-// TODO: determine actual audio DSP and hardware latency
-// Additionnal latency introduced by audio DSP and hardware in ms
+// Additional latency introduced by codec digital filters in ms, on top of
+// the kernel pcm buffer, which is accounted at run time
 #define AUDIO_HW_OUT_LATENCY_MS 0
 // Default audio output sample rate
 #define AUDIO_HW_OUT_SAMPLERATE 44100
@@ -33,11 +33,46 @@
 #define AUDIO_HW_OUT_PERIOD_CNT 4
 // Default audio output buffer size in bytes
 #define AUDIO_HW_OUT_PERIOD_BYTES (AUDIO_HW_OUT_PERIOD_SZ * 2 * sizeof(int16_t))
+// Low latency output profile, for UI sounds and games
+#define AUDIO_HW_OUT_LL_PERIOD_MULT 1 // (1 * 128 = 128 frames)
+#define AUDIO_HW_OUT_LL_PERIOD_CNT 2
+// Deep buffer output profile, for music playback with screen off
+#define AUDIO_HW_OUT_DEEP_PERIOD_MULT 32 // (32 * 128 = 4096 frames)
+#define AUDIO_HW_OUT_DEEP_PERIOD_SZ \
+		(PCM_PERIOD_SZ_MIN * AUDIO_HW_OUT_DEEP_PERIOD_MULT)
+#define AUDIO_HW_OUT_DEEP_PERIOD_CNT 4
+// Let the audio policy play music through a second output using the deep
+// buffer profile, other streams stay on the primary output. Off until
+// switching profiles under playing music is glitch-free, every system
+// sound on the primary output would pause the music for a deep buffer.
+#define AUDIO_POLICY_DEEP_BUFFER_MUSIC 0
+// Parameter selecting output profile: low_latency, normal or deep_buffer
+#define AUDIO_PARAMETER_OUTPUT_PROFILE "output_profile"
+// Parameter returning hex encoded audio_stream_stats of all streams
+#define AUDIO_PARAMETER_STREAM_STATS "stream_stats"
+// Trace ring snapshot, saved when dump() gets the --trace argument. Recording
+// is off until dump() gets --trace-on, --trace-off stops it again. The
+// directory is created by init for the media user.
+#define AUDIO_HW_TRACE_PATH "/data/misc/audio/libaudio.trace"
+// Output latency in ms for given kernel pcm buffer geometry
+#define AUDIO_HW_OUT_LATENCY(size, cnt, rate) \
+		((1000 * (size) * (cnt)) / (rate) + AUDIO_HW_OUT_LATENCY_MS)
+// Access the kernel pcm out buffer through mmap (falls back to read/write)
+#define AUDIO_HW_OUT_MMAP 1
+// Software gain changes of output streams are ramped over this many ms
+#define AUDIO_HW_VOLUME_RAMP_MS 5
+// Codec volume controls are written at most once in this many ms, changes
+// coming faster (volume key repeats) are coalesced to the last one
+#define AUDIO_HW_VOLUME_SETTLE_MS 100
 
 // Default audio input sample rate
 #define AUDIO_HW_IN_SAMPLERATE 44100
 // Default audio input channel mask
 #define AUDIO_HW_IN_CHANNELS (AudioSystem::CHANNEL_IN_STEREO)
+#define AUDIO_HW_IN_CHANNEL_COUNT 2
+// Capture mono from the codec for mono streams on single microphone routes
+// instead of downmixing in software (falls back to stereo)
+#define AUDIO_HW_IN_MONO 1
 // Default audio input sample format
 #define AUDIO_HW_IN_FORMAT (AudioSystem::PCM_16_BIT)
 // Number of buffers in audio driver for input
@@ -48,5 +83,35 @@
 #define AUDIO_HW_IN_PERIOD_CNT 4
 // Default audio input buffer size in bytes
 #define AUDIO_HW_IN_PERIOD_BYTES (AUDIO_HW_IN_PERIOD_SZ * 2 * sizeof(int16_t))
+// Access the kernel pcm in buffer through mmap (falls back to read/write)
+#define AUDIO_HW_IN_MMAP 1
+// Input stream parameter selecting the capture resampler tier, when the
+// codec does not run at the stream rate: fast, default or high
+#define AUDIO_PARAMETER_RESAMPLER_QUALITY "resampler_quality"
+
+// Bluetooth SCO link, in both directions mono at the rate of the headset
+#define AUDIO_HW_BT_SAMPLERATE 8000
+// Shortest periods of the link, for lowest latency (1 * 128 = 128 frames)
+#define AUDIO_HW_BT_PERIOD_MULT 1
+#define AUDIO_HW_BT_PERIOD_CNT 2
+// Output mixer frames queued for the link at most
+#define AUDIO_HW_BT_QUEUE_SZ (AUDIO_HW_OUT_PERIOD_SZ * 4)
+// Downlink resampler tier, voice band only needs the fast one
+#define AUDIO_HW_BT_RESAMPLER_QUALITY (Resampler::QUALITY_FAST)
+
+// Playback and capture pcms are started and stopped independently. Set to 0
+// for codecs which need the other direction reopened on every wake up.
+#define AUDIO_HW_FULL_DUPLEX 1
+
+// Streams asked to go to standby only pause the pcm for this many ms, keeping
+// it open and routed, so a stream restarting soon does not pay for the reopen
+// and route setup. 0 puts them to standby immediately.
+#define AUDIO_HW_STANDBY_DELAY_MS 1000
+// Parameter overriding the standby delay at run time, in ms
+#define AUDIO_PARAMETER_STANDBY_DELAY "standby_delay"
+// The wake lock and routes of streams gone to standby are released this many
+// ms after the last of them, a stream waking up meanwhile takes them over
+// without a sysfs write or a route cycle. 0 releases them immediately.
+#define AUDIO_HW_POWER_HOLD_MS 250
 
 #endif /* _ALSA_SOC_AUDIO_CONFIG_H */
@@ -15,16 +15,38 @@
  * limitations under the License.
  */
 
-#define LOG_NDEBUG 0
-#define LOG_TAG "DownSampler"
+/*
+ * Capture resampler benchmark.
+ *
+ * Runs the Resampler in each quality tier and the former two stage
+ * DownSampler chain (44100 -> 22050 FIR decimator followed by FIR + linear
+ * interpolation down to 16000) over the same synthetic input and reports
+ * the cost per output frame and the CPU time per second of audio.
+ *
+ * usage: resample_bench [seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
 
 #include <cutils/log.h>
 #include <utils/Errors.h>
-#include "DownSampler.h"
+#include "BufferProvider.h"
+#include "Resampler.h"
 #include "utils.h"
 
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER
+#endif
+
+using namespace android;
+
 /*
- * DownSampler
+ * Legacy DownSampler chain, kept verbatim as the reference point.
  */
 
 /*
@@ -61,7 +83,6 @@ static const int32_t filter_22khz_coeff[] = {
 static int32_t fir_convolve(const int16_t *a, const int32_t *b,
 						int num_samples, int skip)
 {
-	TRACE_VERBOSE();
 	int32_t sum = 1 << 13;
 
 	for (int i = 0; i < num_samples; ++i, a += skip, ++b)
@@ -73,7 +94,6 @@ static int32_t fir_convolve(const int16_t *a, const int32_t *b,
 /* Clip from 16.16 fixed-point to 0.16 fixed-point. */
 static int16_t clip(int32_t x)
 {
-	TRACE_VERBOSE();
 
 	if (x < -32768)
 		x = -32768;
@@ -94,7 +114,6 @@ static int16_t clip(int32_t x)
 static int resample_2_1(int16_t *input, int16_t *output,
 						int *num_samples_in, int skip)
 {
-	TRACE_VERBOSE();
 
 	if (*num_samples_in < (int)NUM_COEFF_22KHZ)
 		return 0;
@@ -157,7 +176,6 @@ static const int32_t filter_16khz_coeff[] = {
 static int resample_441_320(int16_t *input, int16_t *output,
 						int *num_samples_in, int skip)
 {
-	TRACE_VERBOSE();
 	const int num_blocks = (*num_samples_in - OVERLAP_16KHZ)
 						/ RESAMPLE_16KHZ_SAMPLES_IN;
 
@@ -198,63 +216,39 @@ static int resample_441_320(int16_t *input, int16_t *output,
 	return RESAMPLE_16KHZ_SAMPLES_OUT * num_blocks;
 }
 
-namespace android {
-
-DownSampler::DownSampler(uint32_t outSampleRate,
-				uint32_t channelCount, uint32_t frameCount,
-				BufferProvider *provider) :
-	mStatus(NO_INIT),
-	mProvider(provider),
-	mSampleRate(outSampleRate),
-	mChannelCount(channelCount),
-	mFrameCount(frameCount),
-	mOutBufIdx(0)
-{
-	TRACE();
-	LOGD("DownSampler() cstor %p SR %d channels %d "
-		"frames %d", this, mSampleRate, mChannelCount, mFrameCount);
-
-	for (unsigned int i = 0; i < NELEM(mTmpBuf); ++i)
-		mTmpBuf[i] = 0;
-
-	if (mSampleRate != 8000 && mSampleRate != 11025
-		&& mSampleRate != 16000 && mSampleRate != 22050) {
-		LOGE("DownSampler cstor: "
-			"bad sampling rate: %d", mSampleRate);
-		return;
-	}
-
-	for (unsigned int i = 0; i < NELEM(mTmpBuf); ++i) {
-		mTmpBuf[i] = new int16_t[channelCount*mFrameCount];
-
-		if (!mTmpBuf[i]) {
-			LOGE("DownSampler: Failed to allocate "
-				"work buffer %d/%d", i, NELEM(mTmpBuf));
-			return;
+class LegacyDownSampler : public BufferProvider {
+public:
+	LegacyDownSampler(uint32_t outSampleRate, uint32_t channelCount,
+				uint32_t frameCount, BufferProvider *provider) :
+		mProvider(provider),
+		mSampleRate(outSampleRate),
+		mChannelCount(channelCount),
+		mFrameCount(frameCount),
+		mOutBufIdx(0)
+	{
+		for (unsigned int i = 0; i < NELEM(mTmpBuf); ++i) {
+			mTmpBuf[i] = new int16_t[channelCount*mFrameCount];
+			mInTmpBuf[i] = 0;
 		}
-
-		mInTmpBuf[i] = 0;
 	}
 
-	mStatus = NO_ERROR;
-}
-
-DownSampler::~DownSampler()
-{
-	TRACE();
-
-	for (unsigned int i = 0; i < NELEM(mTmpBuf); ++i)
-		if (mTmpBuf[i])
+	virtual ~LegacyDownSampler()
+	{
+		for (unsigned int i = 0; i < NELEM(mTmpBuf); ++i)
 			delete[] mTmpBuf[i];
-}
+	}
 
-void DownSampler::reset()
-{
-	TRACE();
+	virtual status_t getNextBuffer(Buffer *buffer);
 
-	for (unsigned int i = 0; i < NELEM(mInTmpBuf); ++i)
-		mInTmpBuf[i] = 0;
-}
+private:
+	BufferProvider *mProvider;
+	uint32_t mSampleRate;
+	uint32_t mChannelCount;
+	uint32_t mFrameCount;
+	int mOutBufIdx;
+	int16_t *mTmpBuf[4];
+	int mInTmpBuf[4];
+};
 
 static inline void copySamples(int16_t *dst, const int16_t *src, size_t cnt)
 {
@@ -266,12 +260,8 @@ static inline void moveSamples(int16_t *dst, const int16_t *src, size_t cnt)
 	memmove(dst, src, cnt*sizeof(*dst));
 }
 
-status_t DownSampler::getNextBuffer(BufferProvider::Buffer *buffer)
+status_t LegacyDownSampler::getNextBuffer(BufferProvider::Buffer *buffer)
 {
-	TRACE_VERBOSE();
-
-	if (mStatus != NO_ERROR)
-		return mStatus;
 
 	if (!buffer || !buffer->raw || !buffer->frameCount)
 		return BAD_VALUE;
@@ -378,4 +368,198 @@ status_t DownSampler::getNextBuffer(BufferProvider::Buffer *buffer)
 	return 0;
 }
 
-}; /* namespace android */
+/*
+ * Test signal source: a sine sweep with a bit of noise, precomputed, so
+ * generating it does not count into the measurement.
+ */
+#define SIGNAL_FRAMES		65536
+
+class SignalProvider : public BufferProvider {
+public:
+	SignalProvider(uint32_t sampleRate, uint32_t channelCount) :
+		mChannelCount(channelCount),
+		mPos(0)
+	{
+		double phase = 0.0;
+		double freq = 100.0;
+		uint32_t seed = 1;
+
+		mSignal = new int16_t[SIGNAL_FRAMES*channelCount];
+
+		for (size_t i = 0; i < SIGNAL_FRAMES; ++i) {
+			seed = seed * 1103515245 + 12345;
+			int noise = (int)((seed >> 16) & 0x3ff) - 512;
+			int s = (int)(16000.0 * sin(phase)) + noise;
+
+			for (uint32_t ch = 0; ch < channelCount; ++ch)
+				mSignal[i*channelCount + ch] = (ch & 1) ? -s : s;
+
+			phase += 2.0 * M_PI * freq / sampleRate;
+			freq *= 1.0001;
+
+			if (freq > sampleRate / 2)
+				freq = 100.0;
+		}
+	}
+
+	virtual ~SignalProvider()
+	{
+		delete[] mSignal;
+	}
+
+	virtual status_t getNextBuffer(Buffer *buffer)
+	{
+		int16_t *out = buffer->i16;
+		size_t frames = buffer->frameCount;
+
+		while (frames) {
+			size_t chunk = SIGNAL_FRAMES - mPos;
+
+			if (chunk > frames)
+				chunk = frames;
+
+			memcpy(out, mSignal + mPos*mChannelCount,
+				chunk*mChannelCount*sizeof(*out));
+			out += chunk*mChannelCount;
+			frames -= chunk;
+			mPos = (mPos + chunk) % SIGNAL_FRAMES;
+		}
+
+		return NO_ERROR;
+	}
+
+private:
+	uint32_t mChannelCount;
+	size_t mPos;
+	int16_t *mSignal;
+};
+
+#define BENCH_IN_RATE		44100
+#define BENCH_PERIOD_SZ		1024
+#define BENCH_OUT_CHUNK		256
+
+struct BenchResult {
+	double nsPerFrame;
+	double cyclesPerFrame;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#ifdef HAVE_CYCLE_COUNTER
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static int run(BufferProvider *provider, uint32_t channelCount,
+			uint32_t frames, BenchResult *result)
+{
+	int16_t out[BENCH_OUT_CHUNK * 2];
+	uint32_t done = 0;
+	uint64_t ns, cycles;
+
+	ns = now_ns();
+	cycles = now_cycles();
+
+	while (done < frames) {
+		BufferProvider::Buffer buf;
+
+		buf.i16 = out;
+		buf.frameCount = BENCH_OUT_CHUNK;
+
+		if (provider->getNextBuffer(&buf) || !buf.frameCount)
+			return -1;
+
+		done += buf.frameCount;
+	}
+
+	cycles = now_cycles() - cycles;
+	ns = now_ns() - ns;
+
+	result->nsPerFrame = (double)ns / done;
+	result->cyclesPerFrame = (double)cycles / done;
+	return 0;
+}
+
+static void print_result(const char *name, uint32_t rate,
+				uint32_t channelCount, const BenchResult *r)
+{
+	printf("%-10s %6u Hz %u ch %10.1f ns/frame %8.2f ms/s", name, rate,
+					channelCount, r->nsPerFrame,
+					r->nsPerFrame * rate / 1000000.0);
+#ifdef HAVE_CYCLE_COUNTER
+	printf(" %10.1f cycles/frame", r->cyclesPerFrame);
+#endif
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	static const uint32_t rates[] = {
+		8000, 11025, 12000, 16000, 22050, 24000, 32000, 48000
+	};
+	double seconds = 10.0;
+
+	if (argc > 2) {
+		fprintf(stderr, "usage: resample_bench [seconds]\n");
+		return -1;
+	}
+
+	if (argc == 2)
+		seconds = atof(argv[1]);
+
+	for (unsigned int i = 0; i < NELEM(rates); ++i) {
+		for (uint32_t ch = 1; ch <= 2; ++ch) {
+			uint32_t frames = (uint32_t)(seconds * rates[i]);
+			BenchResult r;
+
+			for (int q = Resampler::QUALITY_FAST;
+					q <= Resampler::QUALITY_HIGH; ++q) {
+				Resampler::Quality quality = (Resampler::Quality)q;
+				SignalProvider src(BENCH_IN_RATE, ch);
+				Resampler resampler(BENCH_IN_RATE, rates[i], ch,
+						BENCH_PERIOD_SZ, &src, quality);
+
+				if (resampler.initCheck() != NO_ERROR
+				    || run(&resampler, ch, frames, &r)) {
+					fprintf(stderr, "Resampler %s failed "
+						"for %u Hz\n",
+						Resampler::qualityName(quality),
+						rates[i]);
+					return -1;
+				}
+
+				print_result(Resampler::qualityName(quality),
+							rates[i], ch, &r);
+			}
+
+			/* The old chain only supported these rates */
+			if (rates[i] != 8000 && rates[i] != 11025
+			    && rates[i] != 16000 && rates[i] != 22050)
+				continue;
+
+			SignalProvider legacySrc(BENCH_IN_RATE, ch);
+			LegacyDownSampler legacy(rates[i], ch,
+						BENCH_PERIOD_SZ, &legacySrc);
+
+			if (run(&legacy, ch, frames, &r)) {
+				fprintf(stderr, "legacy chain failed for %u Hz\n",
+								rates[i]);
+				return -1;
+			}
+
+			print_result("legacy", rates[i], ch, &r);
+		}
+	}
+
+	return 0;
+}
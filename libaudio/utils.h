@@ -18,34 +18,26 @@
 #ifndef _ALSA_SOC_AUDIO_UTILS_H_
 #define _ALSA_SOC_AUDIO_UTILS_H_
 
+#include <trace_ring.h>
+
 namespace android {
 
 //#define DRIVER_TRACE
 #define DEBUG_TRACE
 //#define DEBUG_TRACE_VERBOSE
 
-class Tracer {
-	const char *name;
-	static int level;
-public:
-	Tracer(const char *name) :
-		name(name) {
-		++level;
-		LOG(LOG_VERBOSE, "Tracer", "%*s %s enter", 2*level, ">", name);
-	}
-
-	~Tracer() {
-		LOG(LOG_VERBOSE, "Tracer", "%*s %s leave", 2*level, "<", name);
-		--level;
-	}
-};
-
 #ifdef DEBUG_TRACE
 
-#define TRACE()		Tracer __tracer__LINE__(__func__)
+/* Records into the binary trace ring of the calling thread */
+#define TRACE()		TraceScope __tracer__LINE__(__func__)
+#define TRACE_ARGS(a0, a1) \
+	do { \
+		if (trace_ring_enabled) \
+			trace_ring_record(__func__, TRACE_EVENT, (a0), (a1)); \
+	} while (0)
 
 #ifdef DEBUG_TRACE_VERBOSE
-#define TRACE_VERBOSE()	Tracer __tracer__LINE__(__func__)
+#define TRACE_VERBOSE()	TraceScope __tracer__LINE__(__func__)
 #else
 #define TRACE_VERBOSE()
 #endif
@@ -53,6 +45,7 @@ public:
 #else
 
 #define TRACE()
+#define TRACE_ARGS(a0, a1)
 #define TRACE_VERBOSE()
 
 #endif
@@ -66,6 +59,9 @@ enum {
 	DRV_PCM_CLOSE,
 	DRV_PCM_WRITE,
 	DRV_PCM_READ,
+	DRV_PCM_STATUS,
+	DRV_PCM_STOP,
+	DRV_PCM_START,
 	DRV_MIXER_OPEN,
 	DRV_MIXER_CLOSE,
 	DRV_MIXER_GET,
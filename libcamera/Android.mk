@@ -17,6 +17,7 @@ LOCAL_SRC_FILES:= \
 	V4L2CameraHardware.cpp
 
 LOCAL_SHARED_LIBRARIES := libutils libui liblog libbinder libcutils
+LOCAL_STATIC_LIBRARIES := libtracering
 LOCAL_SHARED_LIBRARIES += libcamera_client
 
 ifeq ($(BOARD_USES_OVERLAY),true)
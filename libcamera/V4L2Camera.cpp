@@ -31,8 +31,6 @@
 #include "V4L2Device.h"
 #include "utils.h"
 
-int Tracer::level = 0;
-
 using namespace android;
 
 namespace android {
@@ -1548,6 +1546,27 @@ status_t V4L2Camera::dump(int fd, const Vector<String16> &args)
 
 	snprintf(buffer, 255, "dump(%d)\n", fd);
 	result.append(buffer);
+
+#ifdef DEBUG_TRACE
+	for (size_t i = 0; i < args.size(); ++i) {
+		if (args[i] == String16("--trace-on")
+		    || args[i] == String16("--trace-off")) {
+			trace_ring_enable(args[i] == String16("--trace-on"));
+			continue;
+		}
+
+		if (args[i] != String16("--trace"))
+			continue;
+
+		int ret = trace_ring_save(CAMERA_TRACE_PATH);
+
+		snprintf(buffer, 255, "trace ring saved to %s: %s\n",
+					CAMERA_TRACE_PATH, strerror(-ret));
+		result.append(buffer);
+		break;
+	}
+#endif
+
 	::write(fd, result.string(), result.size());
 
 	return NO_ERROR;
@@ -12,25 +12,18 @@
 #endif
 
 #ifdef DEBUG_TRACE
-class Tracer {
-	const char *name;
-	static int level;
-public:
-	Tracer(const char *name) :
-		name(name)
-	{
-		++level;
-		LOG(LOG_VERBOSE, "Tracer", "%*s %s enter", 2*level, ">", name);
-	}
-
-	~Tracer()
-	{
-		LOG(LOG_VERBOSE, "Tracer", "%*s %s leave", 2*level, "<", name);
-		--level;
-	}
-};
+#include <trace_ring.h>
+
+/*
+ * Trace ring snapshot, saved when dump() gets the --trace argument.
+ * Recording is off until dump() gets --trace-on, --trace-off stops it.
+ * Shares the directory init creates for mediaserver with libaudio.
+ */
+#define CAMERA_TRACE_PATH "/data/misc/audio/camera.trace"
+
+/* Records into the binary trace ring of the calling thread */
 #define TRACE() \
-			Tracer __tracer__LINE__(__func__)
+			TraceScope __tracer__LINE__(__func__)
 #else
 #define TRACE()
 #endif
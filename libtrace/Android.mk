@@ -0,0 +1,33 @@
+LOCAL_PATH:= $(call my-dir)
+
+ifneq ($(filter spica,$(TARGET_DEVICE)),)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= trace_ring.c
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+LOCAL_MODULE:= libtracering
+LOCAL_MODULE_TAGS:= optional
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= trace_ring.c
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+LOCAL_MODULE:= libtracering
+LOCAL_MODULE_TAGS:= optional
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= tracedump.c
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+LOCAL_MODULE:= tracedump
+LOCAL_MODULE_TAGS:= debug
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= tracedump.c
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+LOCAL_MODULE:= tracedump
+LOCAL_MODULE_TAGS:= optional
+include $(BUILD_HOST_EXECUTABLE)
+
+endif
@@ -0,0 +1,320 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "trace_ring"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include <cutils/log.h>
+#include <cutils/atomic.h>
+
+#include <trace_ring.h>
+
+#define TRACE_RING_MASK		(TRACE_RING_SIZE - 1)
+
+struct trace_ring {
+	struct trace_ring *next;
+	/* 0 when the owning thread exited and the ring can be reused */
+	int owned;
+	uint32_t tid;
+	/* number of records written, wraps */
+	volatile int32_t head;
+	/* set once the ring got overwritten */
+	volatile int32_t full;
+	struct trace_record records[TRACE_RING_SIZE];
+};
+
+volatile int32_t trace_ring_enabled = 0;
+
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+static volatile int trace_key_valid;
+/* Protects the ring list, taken on thread attach, detach and save only */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring *trace_rings;
+
+static void trace_ring_detach(void *data)
+{
+	struct trace_ring *ring = data;
+
+	pthread_mutex_lock(&trace_lock);
+	ring->owned = 0;
+	pthread_mutex_unlock(&trace_lock);
+}
+
+static void trace_ring_init(void)
+{
+	if (pthread_key_create(&trace_key, trace_ring_detach)) {
+		LOGE("cannot create thread key");
+		return;
+	}
+
+	trace_key_valid = 1;
+}
+
+static struct trace_ring *trace_ring_attach(void)
+{
+	struct trace_ring *ring;
+
+	pthread_once(&trace_once, trace_ring_init);
+
+	if (!trace_key_valid)
+		return NULL;
+
+	pthread_mutex_lock(&trace_lock);
+
+	/* Rings of exited threads are reused */
+	for (ring = trace_rings; ring; ring = ring->next) {
+		if (!ring->owned) {
+			android_atomic_release_store(0, &ring->head);
+			ring->full = 0;
+			break;
+		}
+	}
+
+	if (!ring) {
+		ring = calloc(1, sizeof(*ring));
+
+		if (!ring) {
+			pthread_mutex_unlock(&trace_lock);
+			return NULL;
+		}
+
+		ring->next = trace_rings;
+		trace_rings = ring;
+	}
+
+	ring->owned = 1;
+	ring->tid = syscall(__NR_gettid);
+	pthread_mutex_unlock(&trace_lock);
+
+	pthread_setspecific(trace_key, ring);
+	return ring;
+}
+
+void trace_ring_enable(int enable)
+{
+	android_atomic_release_store(enable ? 1 : 0, &trace_ring_enabled);
+	LOGD("trace ring recording %s", enable ? "on" : "off");
+}
+
+void trace_ring_record(const char *name, uint32_t type,
+					uint32_t arg0, uint32_t arg1)
+{
+	struct trace_ring *ring = NULL;
+	struct trace_record *rec;
+	struct timespec ts;
+	uint32_t head;
+
+	if (trace_key_valid)
+		ring = pthread_getspecific(trace_key);
+
+	if (!ring) {
+		ring = trace_ring_attach();
+
+		if (!ring)
+			return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	/* Single writer, the reader checks head again after copying */
+	head = ring->head;
+	rec = &ring->records[head & TRACE_RING_MASK];
+	rec->tstamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	rec->name = (uintptr_t)name;
+	rec->type = type;
+	rec->arg0 = arg0;
+	rec->arg1 = arg1;
+	rec->reserved = 0;
+
+	if ((head & TRACE_RING_MASK) == TRACE_RING_MASK)
+		ring->full = 1;
+
+	android_atomic_release_store(head + 1, &ring->head);
+}
+
+/*
+ * Copies the records of a ring, oldest first. Records the owner overwrote
+ * while they were being copied are dropped.
+ */
+static unsigned trace_ring_copy(struct trace_ring *ring,
+					struct trace_record *records)
+{
+	uint32_t head, start, end, i;
+
+	end = android_atomic_acquire_load(&ring->head);
+	start = ring->full ? end - TRACE_RING_SIZE : 0;
+
+	for (i = start; i != end; ++i)
+		records[i - start] = ring->records[i & TRACE_RING_MASK];
+
+	/* the slot of record head - TRACE_RING_SIZE may be half written */
+	head = android_atomic_acquire_load(&ring->head);
+
+	if (head - start >= TRACE_RING_SIZE) {
+		uint32_t valid = head - TRACE_RING_SIZE + 1;
+
+		if (valid - start >= end - start)
+			return 0;
+
+		memmove(records, records + (valid - start),
+			(end - valid) * sizeof(*records));
+		start = valid;
+	}
+
+	return end - start;
+}
+
+static int trace_ptr_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+int trace_ring_save(const char *path)
+{
+	struct trace_file_header header;
+	struct trace_ring *ring;
+	struct trace_record *records = NULL;
+	unsigned *counts = NULL;
+	uint32_t *tids = NULL;
+	uint64_t *names = NULL;
+	uint32_t *offsets = NULL;
+	char tmp[256];
+	unsigned threads = 0, total = 0, name_count = 0, i, j;
+	uint32_t strings_size = 0;
+	FILE *file = NULL;
+	int ret = 0;
+
+	pthread_mutex_lock(&trace_lock);
+
+	for (ring = trace_rings; ring; ring = ring->next)
+		++threads;
+
+	records = malloc(threads * TRACE_RING_SIZE * sizeof(*records) + 1);
+	counts = calloc(threads + 1, sizeof(*counts));
+	tids = calloc(threads + 1, sizeof(*tids));
+
+	if (!records || !counts || !tids) {
+		pthread_mutex_unlock(&trace_lock);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (ring = trace_rings, i = 0; ring; ring = ring->next, ++i) {
+		tids[i] = ring->tid;
+		counts[i] = trace_ring_copy(ring, records + total);
+		total += counts[i];
+	}
+
+	pthread_mutex_unlock(&trace_lock);
+
+	/* Resolve names into a string table */
+	names = malloc(total * sizeof(*names) + 1);
+	offsets = malloc(total * sizeof(*offsets) + 1);
+
+	if (!names || !offsets) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < total; ++i)
+		names[i] = records[i].name;
+
+	qsort(names, total, sizeof(*names), trace_ptr_cmp);
+
+	for (i = 0; i < total; ++i) {
+		if (name_count && names[name_count - 1] == names[i])
+			continue;
+
+		names[name_count] = names[i];
+		offsets[name_count] = strings_size;
+		strings_size += strlen((const char *)(uintptr_t)names[i]) + 1;
+		++name_count;
+	}
+
+	for (i = 0; i < total; ++i) {
+		uint64_t *name = bsearch(&records[i].name, names, name_count,
+					sizeof(*names), trace_ptr_cmp);
+
+		records[i].name = offsets[name - names];
+	}
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	file = fopen(tmp, "wb");
+
+	if (!file) {
+		ret = -errno;
+		LOGE("cannot create %s: %s", tmp, strerror(errno));
+		goto out;
+	}
+
+	header.magic = TRACE_FILE_MAGIC;
+	header.version = TRACE_FILE_VERSION;
+	header.thread_count = threads;
+	header.strings_size = strings_size;
+	fwrite(&header, sizeof(header), 1, file);
+
+	for (i = 0; i < name_count; ++i) {
+		const char *name = (const char *)(uintptr_t)names[i];
+
+		fwrite(name, strlen(name) + 1, 1, file);
+	}
+
+	for (i = 0, j = 0; i < threads; j += counts[i++]) {
+		struct trace_file_thread thread;
+
+		thread.tid = tids[i];
+		thread.count = counts[i];
+		fwrite(&thread, sizeof(thread), 1, file);
+		fwrite(records + j, sizeof(*records), counts[i], file);
+	}
+
+	if (ferror(file) | fclose(file)) {
+		ret = -EIO;
+		unlink(tmp);
+		goto out;
+	}
+
+	if (rename(tmp, path)) {
+		ret = -errno;
+		unlink(tmp);
+		goto out;
+	}
+
+	LOGD("saved %u records of %u threads to %s", total, threads, path);
+
+out:
+	free(offsets);
+	free(names);
+	free(tids);
+	free(counts);
+	free(records);
+
+	return ret;
+}
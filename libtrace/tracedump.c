@@ -0,0 +1,217 @@
+/*
+ * Copyright 2012, The Android Open-Source Project
+ * Copyright 2012, Tomasz Figa <tomasz.figa at gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Decodes trace ring snapshots saved by trace_ring_save().
+ *
+ * usage: tracedump [-t tid] file
+ *
+ * Records of all threads are merged by time. Enter and leave records of
+ * each thread are indented by call depth and leaves show the time spent
+ * in the scope, if its enter is still in the snapshot.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <trace_ring.h>
+
+#define MAX_DEPTH	64
+
+struct entry {
+	struct trace_record rec;
+	unsigned thread;
+};
+
+struct thread {
+	uint32_t tid;
+	int depth;
+	uint64_t enter[MAX_DEPTH];
+};
+
+static int entry_cmp(const void *a, const void *b)
+{
+	const struct entry *x = a;
+	const struct entry *y = b;
+
+	if (x->rec.tstamp != y->rec.tstamp)
+		return (x->rec.tstamp > y->rec.tstamp) ? 1 : -1;
+
+	/* keeps the order of records of a thread with equal time stamps */
+	return (x > y) - (x < y);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-t tid] file\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	struct trace_file_header header;
+	struct thread *threads = NULL;
+	struct entry *entries = NULL;
+	char *strings = NULL;
+	unsigned total = 0, i;
+	uint32_t filter = 0;
+	uint64_t base;
+	FILE *file;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:")) != -1) {
+		switch (opt) {
+		case 't':
+			filter = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	file = fopen(argv[optind], "rb");
+
+	if (!file) {
+		fprintf(stderr, "cannot open %s: %s\n", argv[optind],
+							strerror(errno));
+		return 1;
+	}
+
+	if (fread(&header, sizeof(header), 1, file) != 1
+	    || header.magic != TRACE_FILE_MAGIC
+	    || header.version != TRACE_FILE_VERSION) {
+		fprintf(stderr, "%s: not a trace snapshot\n", argv[optind]);
+		return 1;
+	}
+
+	strings = malloc(header.strings_size + 1);
+	threads = calloc(header.thread_count + 1, sizeof(*threads));
+
+	if (!strings || !threads
+	    || fread(strings, 1, header.strings_size, file)
+						!= header.strings_size)
+		goto corrupt;
+
+	strings[header.strings_size] = '\0';
+
+	for (i = 0; i < header.thread_count; ++i) {
+		struct trace_file_thread thread;
+		struct entry *tmp;
+		unsigned j;
+
+		if (fread(&thread, sizeof(thread), 1, file) != 1
+		    || thread.count > TRACE_RING_SIZE)
+			goto corrupt;
+
+		threads[i].tid = thread.tid;
+
+		tmp = realloc(entries,
+				(total + thread.count + 1) * sizeof(*entries));
+
+		if (!tmp)
+			goto corrupt;
+
+		entries = tmp;
+
+		for (j = 0; j < thread.count; ++j) {
+			struct entry *e = &entries[total];
+
+			if (fread(&e->rec, sizeof(e->rec), 1, file) != 1
+			    || e->rec.name >= header.strings_size)
+				goto corrupt;
+
+			e->thread = i;
+
+			if (!filter || filter == thread.tid)
+				++total;
+		}
+	}
+
+	fclose(file);
+
+	qsort(entries, total, sizeof(*entries), entry_cmp);
+
+	base = total ? entries[0].rec.tstamp : 0;
+
+	for (i = 0; i < total; ++i) {
+		struct trace_record *rec = &entries[i].rec;
+		struct thread *t = &threads[entries[i].thread];
+		const char *name = strings + rec->name;
+		uint64_t ts = rec->tstamp - base;
+
+		printf("%6llu.%06llu %5u ",
+			(unsigned long long)(ts / 1000000000ULL),
+			(unsigned long long)(ts % 1000000000ULL / 1000),
+			t->tid);
+
+		switch (rec->type) {
+		case TRACE_ENTER:
+			printf("%*s> %s\n", 2 * t->depth, "", name);
+
+			if (t->depth < MAX_DEPTH)
+				t->enter[t->depth] = rec->tstamp;
+
+			++t->depth;
+			break;
+
+		case TRACE_LEAVE:
+			/* enter might have been overwritten already */
+			if (t->depth > 0) {
+				--t->depth;
+				printf("%*s< %s", 2 * t->depth, "", name);
+
+				if (t->depth < MAX_DEPTH)
+					printf(" (%llu us)", (unsigned long long)
+						(rec->tstamp
+						 - t->enter[t->depth]) / 1000);
+
+				printf("\n");
+			} else {
+				printf("< %s\n", name);
+			}
+			break;
+
+		default:
+			printf("%*s* %s %u %u\n", 2 * t->depth, "", name,
+							rec->arg0, rec->arg1);
+			break;
+		}
+	}
+
+	free(entries);
+	free(threads);
+	free(strings);
+
+	return 0;
+
+corrupt:
+	fprintf(stderr, "%s: truncated or corrupt snapshot\n", argv[optind]);
+	fclose(file);
+	free(entries);
+	free(threads);
+	free(strings);
+
+	return 1;
+}